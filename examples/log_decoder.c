@@ -0,0 +1,61 @@
+/**
+ * @file log_decoder.c
+ * @author MalTheLegend104
+ * @brief Binary log decoder
+ *
+ * Turns logs written by ws_binaryLogger() back into normal log lines.
+ *
+ * @version v1.0.0
+ * @copyright
+ * Copyright 2024 MalTheLegend104
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "../wall_shell.h"
+
+/**************************************************************************************************
+ * Usage: log_decoder <binary log> [output file]
+ * If no output file is given, the decoded lines are written to stdout.
+ * This has to be built with the same configuration as the program that wrote the log.
+ *************************************************************************************************/
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <binary log> [output file]\n", argv[0]);
+		return 1;
+	}
+
+	FILE* in = fopen(argv[1], "rb");
+	if (!in) {
+		fprintf(stderr, "Couldn't open \"%s\"\n", argv[1]);
+		return 1;
+	}
+
+	FILE* out = stdout;
+	if (argc > 2) {
+		out = fopen(argv[2], "w");
+		if (!out) {
+			fprintf(stderr, "Couldn't open \"%s\"\n", argv[2]);
+			fclose(in);
+			return 1;
+		}
+	}
+
+	ws_error_t err = ws_decodeBinaryLog(in, out);
+	if (err == WS_WS_SETUP_ERROR) fprintf(stderr, "\"%s\" is not a valid binary log, or is truncated.\n", argv[1]);
+	else if (err == WS_OUT_OF_MEMORY) fprintf(stderr, "Ran out of memory while decoding.\n");
+
+	fclose(in);
+	if (out != stdout) fclose(out);
+	return err == WS_NO_ERROR ? 0 : 1;
+}
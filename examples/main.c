@@ -100,6 +100,61 @@ int example2_help(int argc, char** argv) {
 	return 0;
 }
 
+// Commands can describe their arguments with a schema instead, and let WallShell parse them.
+// Help and tab completion of options come from the schema too, so there's no help function.
+const ws_arg_option_t repeat_options[] = {
+	{ "times", 'n', WS_ARG_INT, "count", "How many times to log the text. Defaults to 1." },
+	{ "shout", 's', WS_ARG_FLAG, NULL, "Log it as a warning." },
+};
+const ws_arg_positional_t repeat_positionals[] = {
+	{ "text", WS_ARG_STRING, "What to log.", true },
+};
+
+int repeat(const ws_args_t* args) {
+	// Options and positionals are in the same order as they're declared.
+	long times = args->options[0].present ? args->options[0].integer : 1;
+	bool shout = ws_getOption(args, "shout")->present;
+	for (long i = 0; i < times; i++) {
+		ws_logger(shout ? WS_WARN : WS_INFO, "%s", args->positionals[0].string);
+	}
+	// Anything past <text> ends up in rest, since the schema is variadic.
+	for (int i = 0; i < args->rest_count; i++) ws_logger(WS_LOG, "Extra: \"%s\"", args->rest[i]);
+	return 0;
+}
+
+// Completes <text> when tab is pressed. Whatever it adds is cached until the line is run, so while the word is being
+// typed, it's only called once.
+void repeat_complete(ws_completions_t* completions, int argc, char** argv, const char* prefix) {
+	const char* words[] = { "hello", "help", "goodbye" };
+	for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) ws_addCompletion(completions, words[i]);
+}
+
+const ws_arg_schema_t repeat_schema = {
+	"Logs some text, as many times as you want.",
+	repeat_options, 2,
+	repeat_positionals, 1,
+	true,
+	repeat
+};
+
+// Subcommands are commands of their own, registered under another one. "colors off" runs colorsOff with argv[0] = "off".
+int colorsOn(int argc, char** argv) {
+	ws_setColorMode(WS_COLOR_ALWAYS);
+	return 0;
+}
+
+int colorsOff(int argc, char** argv) {
+	ws_setColorMode(WS_COLOR_NEVER);
+	return 0;
+}
+
+// Registered with a cache_ttl_ms, so running it again within 5 seconds prints the same thing without calling it.
+int counter(int argc, char** argv) {
+	static int runs = 0;
+	fprintf(ws_getStream(WS_OUTPUT), "This has really run %d time(s).\n", ++runs);
+	return 0;
+}
+
 int main() {
 #ifdef THREADED_SUPPORT
 	// This is a single threaded application, we dont need the threadID.
@@ -121,6 +176,17 @@ int main() {
 	// You could also define the aliases here with malloc/calloc, rather than in a global scope.
 	ws_registerCommand((ws_command_t) { example2, example2_help, "example2", example2_aliases, 2 });
 
+	// The last one has a schema, so it doesn't need a main or help function.
+	ws_registerCommand((ws_command_t) { NULL, NULL, "repeat", NULL, 0, &repeat_schema, repeat_complete });
+
+	// "colors" only groups its subcommands, so it doesn't need a main function either.
+	// Running it on its own, or `help colors`, lists them.
+	ws_registerCommand((ws_command_t) { NULL, NULL, "colors", NULL, 0 });
+	ws_registerSubcommand("colors", (ws_command_t) { colorsOn, NULL, "on", NULL, 0 });
+	ws_registerSubcommand("colors", (ws_command_t) { colorsOff, NULL, "off", NULL, 0 });
+
+	ws_registerCommand((ws_command_t) { counter, NULL, "counter", NULL, 0, .cache_ttl_ms = 5000 });
+
 	// Main terminal function. Always call this last.
 	ws_terminalMain();
 
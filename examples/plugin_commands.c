@@ -0,0 +1,60 @@
+/**
+ * @file plugin_commands.c
+ * @author MalTheLegend104
+ * @brief Commands for the plugin example
+ *
+ * Built as a shared library, and loaded by plugin_example.c the first time one of these commands is used.
+ *
+ * @version v1.0.0
+ * @copyright
+ * Copyright 2024 MalTheLegend104
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "../wall_shell.h"
+
+/**************************************************************************************************
+ * These are ordinary command functions. They're looked up by name, so they can't be static.
+ * The WallShell functions they call are the ones in the program that loads the library.
+ *************************************************************************************************/
+
+int greetMain(int argc, char** argv) {
+	FILE* out = ws_getStream(WS_OUTPUT);
+	fprintf(out, "Hello, %s!\n", argc > 1 ? argv[1] : "world");
+	return 0;
+}
+
+int greetHelp(int argc, char** argv) {
+	const char* optional[] = {
+			"<name> -> Who to greet. Defaults to world."
+	};
+	ws_help_entry_specific_t entry = {
+			"Greet",
+			"Greets someone. Loaded from a plugin the first time it's used.",
+			NULL,
+			0,
+			optional,
+			1
+	};
+	ws_printSpecificHelp(&entry);
+	return 0;
+}
+
+int shoutMain(int argc, char** argv) {
+	FILE* out = ws_getStream(WS_OUTPUT);
+	for (int i = 1; i < argc; i++) {
+		for (const char* c = argv[i]; *c; c++) fputc(*c >= 'a' && *c <= 'z' ? *c - 'a' + 'A' : *c, out);
+		fputc(i + 1 < argc ? ' ' : '\n', out);
+	}
+	return 0;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file plugin_example.c
+ * @author MalTheLegend104
+ * @brief Plugin command example
+ *
+ * This file shows you how to register commands that are only loaded from a shared library once they're used.
+ *
+ * @version v1.0.0
+ * @copyright
+ * Copyright 2024 MalTheLegend104
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "../wall_shell.h"
+
+/**************************************************************************************************
+ * The commands registered here live in plugin_commands.c, which is built as a separate library.
+ * Nothing is loaded until "greet" or "help greet" is run, so registering them costs next to nothing.
+ * The library's path is passed in by CMake. Delete the library before running a command, and you'll see
+ * what happens when one can't be found.
+ *************************************************************************************************/
+#ifndef EXAMPLE_PLUGIN_PATH
+#define EXAMPLE_PLUGIN_PATH "./libexample_plugin.so"
+#endif
+
+const char* greet_aliases[] = { "hi" };
+
+int main() {
+	ws_setConsolePrefix("$ ");
+
+	ws_registerPluginCommand((ws_plugin_command_t) {
+			"greet",
+			greet_aliases,
+			1,
+			EXAMPLE_PLUGIN_PATH,
+			"greetMain",
+			"greetHelp"
+	});
+	// No help function in this one, so only running it loads the library.
+	ws_registerPluginCommand((ws_plugin_command_t) { "shout", NULL, 0, EXAMPLE_PLUGIN_PATH, "shoutMain", NULL });
+
+	ws_terminalMain();
+	ws_cleanAll();
+}
@@ -0,0 +1,82 @@
+/**
+ * @file server_example.c
+ * @author MalTheLegend104
+ * @brief Shell server example
+ *
+ * This file shows you how to serve WallShell over a Unix domain socket. Linux only.
+ *
+ * @version v1.0.0
+ * @copyright
+ * Copyright 2024 MalTheLegend104
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "../wall_shell.h"
+
+/**************************************************************************************************
+ * This example listens on /tmp/wallshell.sock, and gives everyone who connects their own shell.
+ * Connect with a raw terminal, for example:
+ *     socat -,raw,echo=0 UNIX-CONNECT:/tmp/wallshell.sock
+ * Anyone connected can run `shutdown` to stop the server.
+ *
+ * Run it with --protocol to serve programs instead. Each line sent is a command, answered with its
+ * exit code and output:
+ *     printf 'echo hi\nshutdown\n' | socat - UNIX-CONNECT:/tmp/wallshell.sock
+ *************************************************************************************************/
+
+ws_server_t* server = NULL;
+
+int shutdownMain(int argc, char** argv) {
+	ws_logger(WS_INFO, "Server shutting down.");
+	ws_stopServer(server);
+	return 0;
+}
+
+int echoMain(int argc, char** argv) {
+	// Printing to the session's stream sends it to whoever ran the command.
+	FILE* out = ws_getStream(WS_OUTPUT);
+	for (int i = 1; i < argc; i++) fprintf(out, i + 1 < argc ? "%s " : "%s", argv[i]);
+	fprintf(out, "\n");
+	return 0;
+}
+
+int shutdownHelp(int argc, char** argv) {
+	ws_help_entry_general_t entry = {
+			"Shutdown",
+			"Stops the server, disconnecting everyone.",
+			NULL,
+			0,
+			NULL,
+			0
+	};
+	ws_printGeneralHelp(&entry);
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	// Clients start with this prefix and the default colors.
+	ws_setConsolePrefix("remote> ");
+	ws_registerCommand((ws_command_t) { shutdownMain, shutdownHelp, "shutdown", NULL, 0 });
+	ws_registerCommand((ws_command_t) { echoMain, NULL, "echo", NULL, 0 });
+
+	server = ws_createServer("/tmp/wallshell.sock");
+	if (!server) {
+		perror("ws_createServer");
+		return 1;
+	}
+	if (argc > 1 && strcmp(argv[1], "--protocol") == 0) ws_setServerMode(server, WS_SERVER_PROTOCOL);
+	ws_logger(WS_INFO, "Listening on /tmp/wallshell.sock");
+	ws_runServer(server);
+	ws_destroyServer(server);
+	ws_cleanAll();
+}
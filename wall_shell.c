@@ -125,32 +125,273 @@ bool ws_internal_startsWith(const char* str, const char* prefix) {
 	return true;
 }
 
+/**
+ * @internal
+ * @brief Splits the next space separated token off a string, in place. Unlike strtok, it keeps no state of its own,
+ * so commands can be split on several threads at once.
+ * @param rest Where to start looking. Moved past the token that's returned.
+ * @return The token, or NULL if there are none left.
+ */
+char* ws_internal_nextToken(char** rest) {
+	char* start = *rest + strspn(*rest, " ");
+	if (*start == '\0') {
+		*rest = start;
+		return NULL;
+	}
+	char* end = start + strcspn(start, " ");
+	*rest = *end ? end + 1 : end;
+	*end = '\0';
+	return start;
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// Sessions
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+#ifdef THREADED_SUPPORT
+#ifndef WS_THREAD_LOCAL
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define WS_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__) || defined(__clang__)
+#define WS_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define WS_THREAD_LOCAL __declspec(thread)
+#else
+#error "WallShell couldn't find a thread local storage specifier. Define WS_THREAD_LOCAL in wallshell_config.h."
+#endif
+#endif // WS_THREAD_LOCAL
+#else
+#define WS_THREAD_LOCAL
+#endif // THREADED_SUPPORT
+
+// How far into an escape sequence the line editor is.
+typedef enum {
+	WS_ESCAPE_NONE = 0,
+	WS_ESCAPE_START,    // Got '\033'
+	WS_ESCAPE_SEQUENCE, // Got "\033[" or "\033O", waiting for the final character
+	WS_ESCAPE_SCANCODE  // Got 0xE0, the next character is a scancode
+} ws_escape_state_t;
+
+#ifndef WS_COMPLETION_CACHE_SIZE
+#define WS_COMPLETION_CACHE_SIZE 4
+#endif // WS_COMPLETION_CACHE_SIZE
+#ifndef WS_COMPLETION_BUF
+#define WS_COMPLETION_BUF 1024
+#endif // WS_COMPLETION_BUF
+
+/*
+ * What a command's completer added for one word. data holds the line before the word, the prefix the completer was
+ * called with, and then the candidates, each ending with '\0'.
+ */
+struct ws_completions {
+	void (*completer)(ws_completions_t* completions, int argc, char** argv, const char* prefix);
+	size_t context_len; // Including the '\0'.
+	size_t prefix_len;
+	size_t size;
+	int count;
+	// Set if a candidate didn't fit, in which case the results can't be narrowed down for longer prefixes.
+	bool truncated;
+	// When it was last used, for replacing the least recently used one. 0 if it's empty.
+	unsigned long last_used;
+	char data[WS_COMPLETION_BUF];
+};
+
+/*
+ * Everything that belongs to one person using the shell. Commands are shared by every session.
+ * Functions that don't take a session use the calling thread's current one, see ws_useSession().
+ */
+struct ws_session {
+	FILE* in_stream;
+	FILE* out_stream;
+	FILE* err_stream;
+	const char* prefix;
+	// For some systems (mostly POSIX), backspace gets sent as ascii delete rather than \b
+	bool backspace_as_ascii_delete;
+
+	char history[PREVIOUS_BUF_SIZE][MAX_COMMAND_BUF];
+	size_t history_size;
+	// The line being edited, and what was typed before scrolling through the history.
+	char command_buf[MAX_COMMAND_BUF];
+	char old_command[MAX_COMMAND_BUF];
+	// Line editing state. It's kept here, rather than in the terminal loop, so input can be fed in from anywhere.
+	bool new_command;
+	bool tab_pressed; // allows for autocompletion
+	bool last_was_cr;
+	ws_escape_state_t escape;
+	size_t position_in_previous;
+	size_t current_position;
+	// Results of command completers. Cleared whenever a line is run, since the command may change what they'd return.
+	ws_completions_t completions[WS_COMPLETION_CACHE_SIZE];
+	unsigned long completion_clock;
+
+	ws_color_t default_colors;
+	ws_color_t current_colors;
+	/*
+	 * What was last written to emitted_stream, so setting the same colors again writes nothing.
+	 * When the output stream changes, nothing is known about the new one until colors are written to it.
+	 */
+	FILE* emitted_stream;
+	ws_color_t emitted_colors;
+	bool emitted_valid;
+	bool stream_has_colors;
+	ws_color_mode_t color_mode;
+
+#ifdef THREADED_SUPPORT
+	ws_atomic_int_t exit_terminal;
+	// Set when the terminal should stop waiting for input early: it was stopped, or there are logs to print.
+	ws_atomic_ptr_t wake;
+	// Set once the terminal returns, reset when it starts again.
+	ws_atomic_ptr_t stopped;
+#else
+	bool exit_terminal;
+#endif // THREADED_SUPPORT
+#ifdef DISABLE_MALLOC
+	bool in_use;
+#endif // DISABLE_MALLOC
+};
+
+// Used by every thread that hasn't picked a session of its own.
+ws_session_t default_session = { .prefix = "> " };
+WS_THREAD_LOCAL ws_session_t* current_session = NULL;
+
+/**
+ * @internal
+ * @brief Gets the calling thread's current session.
+ */
+ws_session_t* ws_internal_session() { return current_session ? current_session : &default_session; }
+
+/**
+ * @internal
+ * @brief Puts a session back in the state a new one starts in. Its events must already be destroyed.
+ */
+void ws_internal_initSession(ws_session_t* session) {
+	memset(session, 0, sizeof(ws_session_t));
+	session->prefix = "> ";
+#ifdef THREADED_SUPPORT
+	ws_initAtomicInt(&session->exit_terminal, 0);
+	ws_initAtomicPtr(&session->wake, NULL);
+	ws_initAtomicPtr(&session->stopped, NULL);
+#endif // THREADED_SUPPORT
+}
+
+/**
+ * @brief Makes a session the calling thread's current one.
+ *
+ * Everything that doesn't take a session, like ws_setConsolePrefix() or ws_setConsoleColors(), uses the current one.
+ * Threads start out using the default session.
+ *
+ * @param session Session to use, or NULL for the default session.
+ * @return The session that was current before, so it can be restored.
+ */
+ws_session_t* ws_useSession(ws_session_t* session) {
+	ws_session_t* previous = ws_internal_session();
+	current_session = session;
+	return previous;
+}
+
+/**
+ * @brief Gets the calling thread's current session. Inside a command, this is the session that ran it.
+ * @return The current session, never NULL.
+ */
+ws_session_t* ws_getSession() { return ws_internal_session(); }
+
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 // Streams
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
-FILE* ws_out_stream = NULL;
-FILE* ws_err_stream = NULL;
-FILE* ws_in_stream = NULL;
+#ifndef WS_THREAD_STREAM_DEPTH
+#define WS_THREAD_STREAM_DEPTH 8
+#endif // WS_THREAD_STREAM_DEPTH
+
+// Streams pushed by the calling thread, indexed by ws_stream. The top of each one wins over the session's stream.
+WS_THREAD_LOCAL FILE* thread_streams[3][WS_THREAD_STREAM_DEPTH];
+WS_THREAD_LOCAL size_t thread_stream_count[3];
+
+/**
+ * @internal
+ * @brief Gets the stream the calling thread should use for a session: its own override if it pushed one, otherwise the
+ * session's. May be NULL if the session hasn't been given one.
+ */
+FILE* ws_internal_stream(ws_session_t* session, ws_stream type) {
+	if (thread_stream_count[type] > 0) return thread_streams[type][thread_stream_count[type] - 1];
+	switch (type) {
+		case WS_INPUT: return session->in_stream;
+		case WS_OUTPUT: return session->out_stream;
+		case WS_ERROR_S: return session->err_stream;
+		default: return NULL;
+	}
+}
+
+// Streams belong to the current session, unless the thread has pushed its own.
+#define ws_out_stream ws_internal_stream(ws_internal_session(), WS_OUTPUT)
+#define ws_err_stream ws_internal_stream(ws_internal_session(), WS_ERROR_S)
+#define ws_in_stream ws_internal_stream(ws_internal_session(), WS_INPUT)
 
 /**
- * @brief Sets the stream to the provided one.
+ * @brief Sets the current session's stream to the provided one.
  * @param type Type of stream to change.
  * @param stream Stream you wish to change it to.
  */
 void ws_setStream(ws_stream type, FILE* stream) {
+	ws_session_t* session = ws_internal_session();
 	switch (type) {
-		case WS_INPUT: ws_in_stream = stream;
+		case WS_INPUT: session->in_stream = stream;
 			break;
-		case WS_OUTPUT: ws_out_stream = stream;
+		case WS_OUTPUT: session->out_stream = stream;
 			break;
-		case WS_ERROR_S: ws_err_stream = stream;
+		case WS_ERROR_S: session->err_stream = stream;
 			break;
 		default: break;
 	}
 }
 
+/**
+ * @brief Gets one of the calling thread's streams. Commands should print to these, so their output goes wherever
+ * WallShell's does.
+ * @param type Type of stream to get.
+ * @return The stream pushed with ws_pushThreadStream(), otherwise the current session's. If the session hasn't been
+ * given one, the matching std stream.
+ */
+FILE* ws_getStream(ws_stream type) {
+	FILE* stream = ws_internal_stream(ws_internal_session(), type);
+	if (stream) return stream;
+	switch (type) {
+		case WS_INPUT: return stdin;
+		case WS_OUTPUT: return stdout;
+		case WS_ERROR_S: return stderr;
+		default: return NULL;
+	}
+}
+
+/**
+ * @brief Redirects one of the calling thread's streams, until it's popped again. Other threads aren't affected.
+ *
+ * Everything WallShell prints or reads on this thread uses the stream on top, instead of the current session's: command
+ * output, help, logs and prompts. Logs printed with an output stream pushed are never held back behind the prompt.
+ * Pushes nest, so a function can push its own stream without caring what its caller did.
+ *
+ * @param type Type of stream to redirect.
+ * @param stream Stream to use from now on.
+ * @return WS_STREAM_LIMIT_REACHED if WS_THREAD_STREAM_DEPTH streams are already pushed. WS_NO_ERROR otherwise.
+ */
+ws_error_t ws_pushThreadStream(ws_stream type, FILE* stream) {
+	if (thread_stream_count[type] >= WS_THREAD_STREAM_DEPTH) return WS_STREAM_LIMIT_REACHED;
+	thread_streams[type][thread_stream_count[type]++] = stream;
+	return WS_NO_ERROR;
+}
+
+/**
+ * @brief Undoes the last ws_pushThreadStream() of that type on the calling thread.
+ * @param type Type of stream to restore.
+ * @return The stream that was popped, so it can be closed, or NULL if none were pushed.
+ */
+FILE* ws_popThreadStream(ws_stream type) {
+	if (thread_stream_count[type] == 0) return NULL;
+	return thread_streams[type][--thread_stream_count[type]];
+}
+
 /**
  * @brief Initialize all streams to their defaults. All default to their std-versions. (stdout, stderr, stdin)
  */
@@ -160,16 +401,6 @@ void ws_initializeDefaultStreams() {
 	ws_setStream(WS_OUTPUT, stdout);
 }
 
-/**
- * @internal
- * @brief Internal function to reset streams to their default state.
- */
-void ws_internal_cleanStreams() {
-	ws_out_stream = NULL;
-	ws_err_stream = NULL;
-	ws_in_stream = NULL;
-}
-
 #ifndef CLEAR_ROW
 #define CLEAR_ROW fprintf(ws_out_stream, "\033[M");
 #endif // CLEAR_ROW
@@ -179,8 +410,6 @@ void ws_internal_cleanStreams() {
 // Custom Console Setup
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
-// For some systems (mostly POSIX), backspace gets sent as ascii delete rather than \b
-bool backspace_as_ascii_delete = false;
 #ifndef CUSTOM_WS_SETUP
 #ifndef _WIN32
 #include <termios.h>
@@ -248,7 +477,7 @@ ws_error_t ws_internal_setConsoleMode() {
 	// posix terminals send ASCII delete instead of backspace for some godforsaken reason
 	tcsetattr(STDIN_FILENO, TCSANOW, &new_settings);
 #endif // _WIN32
-	backspace_as_ascii_delete = true;
+	ws_internal_session()->backspace_as_ascii_delete = true;
 	return WS_NO_ERROR;
 }
 
@@ -264,22 +493,27 @@ void ws_resetConsoleState() {
 
 #ifdef _WIN32
 #include <conio.h>
+#include <io.h>
 #define SET_TERMINAL_LOCALE    SetConsoleOutputCP(CP_UTF8)
 #define ws_get_char_blocking(stream) _getch()
 #else
 #define PRINTING_NEEDS_FLUSH
 #define SET_TERMINAL_LOCALE
-#define ws_get_char_blocking(stream) getchar()
+#define ws_get_char_blocking(stream) fgetc(stream)
 #endif // _WIN32
 
 /**
  * @internal
  * @brief Non blocking version of getc().
  *
+ * On Windows this always reads the console. Elsewhere any stream with a file descriptor works.
+ *
+ * @param stream Stream to read from.
  * @return int Same as getc() and -2 if no new characters in the stream.
  */
-int ws_internal_getCharNonBlocking() {
+int ws_internal_getCharNonBlocking(FILE* stream) {
 #ifdef _WIN32
+	(void) stream;
 	if (_kbhit()) {
 		return _getch();
 	} else {
@@ -287,22 +521,23 @@ int ws_internal_getCharNonBlocking() {
 	}
 #else
 	fd_set set;
+	int fd = fileno(stream);
 	FD_ZERO(&set);
-	FD_SET(STDIN_FILENO, &set);
+	FD_SET(fd, &set);
 	struct timeval timeout = { 0, 0 }; // Immediate return
-	int ready = select(STDIN_FILENO + 1, &set, NULL, NULL, &timeout);
+	int ready = select(fd + 1, &set, NULL, NULL, &timeout);
 
 	if (ready == -1) {
 		perror("select");
 		exit(EXIT_FAILURE);
 	} else if (ready > 0) {
-		return getchar();
+		return fgetc(stream);
 	} else {
 		return -2;
 	}
 #endif
 }
-#define ws_get_char(stream) ws_internal_getCharNonBlocking()
+#define ws_get_char(stream) ws_internal_getCharNonBlocking(stream)
 #endif // CUSTOM_WS_SETUP
 
 // To aid portability, we allow the user to set backspace_as_ascii_delete
@@ -310,11 +545,12 @@ int ws_internal_getCharNonBlocking() {
  * @brief Some consoles send backspace as ASCII delete (0x7f) instead of '\\b'.
  *
  * If your system does this, set this to true. This only needs to be done if CUSTOM_WS_SETUP is defined.
- * For POSIX this is typically true, for Windows this is false.
+ * For POSIX this is typically true, for Windows this is false. Sessions made with ws_createSession() start out true.
+ * Applies to the current session.
  *
  * @param b Bool to set backspace_as_ascii_delete to.
  */
-void ws_setAsciiDeleteAsBackspace(bool b) { backspace_as_ascii_delete = b; }
+void ws_setAsciiDeleteAsBackspace(bool b) { ws_internal_session()->backspace_as_ascii_delete = b; }
 
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
@@ -331,27 +567,73 @@ void ws_setAsciiDeleteAsBackspace(bool b) { backspace_as_ascii_delete = b; }
 #endif
 /* Modern windows is supposed to support these escape codes, older windows versions use SetConsoleTextAttribute */
 /* https://stackoverflow.com/questions/4842424/list-of-ansi-color-escape-sequences */
-#define RESET_CONSOLE fprintf(ws_out_stream, "\033[0m")
+#define RESET_CONSOLE fputs("\033[0m", ws_out_stream)
+
+/*
+ * One escape sequence for every foreground/background pair, built the first time a color is set.
+ * Index 0 is the default color, 1-8 are the normal colors and 9-16 are the bright ones.
+ */
+#define WS_COLOR_COUNT 17
+char sgr_table[WS_COLOR_COUNT][WS_COLOR_COUNT][12];
+bool sgr_table_built = false;
+
+/**
+ * @internal
+ * @brief Gets the index of a color in sgr_table.
+ * @param code The color's SGR code.
+ * @param base SGR code of the first normal color, 30 for foregrounds and 40 for backgrounds.
+ * @return The index, or -1 if it isn't a known color.
+ */
+int ws_internal_colorIndex(int code, int base) {
+	if (code == 0) return 0;
+	if (code >= base && code <= base + 7) return code - base + 1;
+	if (code >= base + 60 && code <= base + 67) return code - (base + 60) + 9;
+	return -1;
+}
+
+/**
+ * @internal
+ * @brief Gets the SGR code for an index in sgr_table.
+ */
+int ws_internal_colorCode(int index, int base) {
+	if (index == 0) return 0;
+	return index <= 8 ? base + index - 1 : base + 60 + index - 9;
+}
+
+/**
+ * @internal
+ * @brief Builds sgr_table.
+ */
+void ws_internal_buildSgrTable() {
+	for (int f = 0; f < WS_COLOR_COUNT; f++) {
+		for (int b = 0; b < WS_COLOR_COUNT; b++) {
+			int fg = ws_internal_colorCode(f, 30);
+			int bg = ws_internal_colorCode(b, 40);
+			char* sgr = sgr_table[f][b];
+			// A default color can only be set with a reset, which is folded into the same sequence.
+			if (fg == 0 && bg == 0) snprintf(sgr, sizeof(sgr_table[f][b]), "\033[0m");
+			else if (fg == 0) snprintf(sgr, sizeof(sgr_table[f][b]), "\033[0;%dm", bg);
+			else if (bg == 0) snprintf(sgr, sizeof(sgr_table[f][b]), "\033[0;%dm", fg);
+			else snprintf(sgr, sizeof(sgr_table[f][b]), "\033[%d;%dm", fg, bg);
+		}
+	}
+	sgr_table_built = true;
+}
 
 /**
  * @internal
- * @brief Changes the console color using virtual terminal sequences.
+ * @brief Changes the console color using virtual terminal sequences. Always writes a single sequence.
  *
  * @param fg Foreground color
  * @param bg Background color
  */
 void ws_internal_changeConsoleColor(ws_fg_color_t fg, ws_bg_color_t bg) {
-	if (fg == WS_FG_DEFAULT || bg == WS_BG_DEFAULT) {
-		RESET_CONSOLE;
-	}
-
-	if (fg == WS_FG_DEFAULT && bg != WS_BG_DEFAULT) {
-		fprintf(ws_out_stream, "\033[%dm", bg);
-	} else if (fg != WS_FG_DEFAULT && bg == WS_BG_DEFAULT) {
-		fprintf(ws_out_stream, "\033[%dm", fg);
-	} else {
-		fprintf(ws_out_stream, "\033[%d;%dm", fg, bg);
-	}
+	int f = ws_internal_colorIndex(fg, 30);
+	int b = ws_internal_colorIndex(bg, 40);
+	if (f < 0 || b < 0) return;
+	// Only called with the color mutex held, so this can't race.
+	if (!sgr_table_built) ws_internal_buildSgrTable();
+	fputs(sgr_table[f][b], ws_out_stream);
 }
 
 #define SET_WS_COLORS(a, b) ws_internal_changeConsoleColor(a, b);
@@ -364,36 +646,65 @@ void ws_internal_changeConsoleColor(ws_fg_color_t fg, ws_bg_color_t bg) {
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 #ifdef THREADED_SUPPORT
-ws_mutex_t* color_mutex = NULL;
+// Created on first use. Several threads can get there at once, so only the first one's mutex is kept.
+ws_atomic_ptr_t color_mutex = WS_ATOMIC_INIT(NULL);
 void ws_internal_color_mutex_check() {
-	if (!color_mutex) color_mutex = ws_createMutex();
+	if (ws_getAtomicPtr(&color_mutex)) return;
+	ws_mutex_t* created = ws_createMutex();
 	// We don't really care if it's NULL.
+	if (!created) return;
+	void* expected = NULL;
+	if (!ws_compareExchangeAtomicPtr(&color_mutex, &expected, created)) ws_destroyMutex(created);
 }
 #define COLOR_MUTEX_CHECK ws_internal_color_mutex_check()
-#define LOCK_COLOR_MUTEX ws_lockMutex(color_mutex)
-#define UNLOCK_COLOR_MUTEX ws_unlockMutex(color_mutex)
+#define LOCK_COLOR_MUTEX ws_lockMutex((ws_mutex_t*) ws_getAtomicPtr(&color_mutex))
+#define UNLOCK_COLOR_MUTEX ws_unlockMutex((ws_mutex_t*) ws_getAtomicPtr(&color_mutex))
 
 #else
 #define COLOR_MUTEX_CHECK
 #define LOCK_COLOR_MUTEX
 #define UNLOCK_COLOR_MUTEX
 #endif
-ws_color_t default_colors = { WS_FG_DEFAULT, WS_BG_DEFAULT };
-ws_color_t current_colors = { WS_FG_DEFAULT, WS_BG_DEFAULT };
+/**
+ * @internal
+ * @brief Checks whether colors should be written to a stream.
+ *
+ * In WS_COLOR_AUTO, that's only if it's a terminal, so redirected output doesn't end up full of escape codes.
+ */
+bool ws_internal_streamHasColors(ws_color_mode_t color_mode, FILE* stream) {
+	if (color_mode != WS_COLOR_AUTO) return color_mode == WS_COLOR_ALWAYS;
+#if defined(CUSTOM_WS_COLORS) || defined(CUSTOM_WS_SETUP)
+	// There's no way to know what a custom setup writes to, so assume it can show colors.
+	(void) stream;
+	return true;
+#elif defined(_WIN32)
+	return _isatty(_fileno(stream)) != 0;
+#else
+	return isatty(fileno(stream)) != 0;
+#endif
+}
+
+/**
+ * @internal
+ * @brief Forgets what colors the output stream has, so the next update writes them again.
+ * Call after anything that might have changed the console's colors behind our back.
+ */
+void ws_internal_invalidateColors() {
+	COLOR_MUTEX_CHECK;
+	LOCK_COLOR_MUTEX;
+	ws_internal_session()->emitted_valid = false;
+	UNLOCK_COLOR_MUTEX;
+}
 
 /**
  * @internal
- * @brief Resets all color variables to their default state.
+ * @brief Resets all color variables to their default state. The colors themselves are reset with the session.
  */
 void ws_internal_cleanColors() {
 #ifdef THREADED_SUPPORT
-	if (color_mutex) ws_destroyMutex(color_mutex);
-	color_mutex = NULL;
+	ws_mutex_t* mut = (ws_mutex_t*) ws_exchangeAtomicPtr(&color_mutex, NULL);
+	if (mut) ws_destroyMutex(mut);
 #endif // THREADED_SUPPORT
-	default_colors.foreground = WS_FG_DEFAULT;
-	default_colors.background = WS_BG_DEFAULT;
-	current_colors.foreground = WS_FG_DEFAULT;
-	current_colors.background = WS_BG_DEFAULT;
 }
 
 /**
@@ -403,16 +714,33 @@ void ws_internal_cleanColors() {
  * @return ws_error_t WS_OUT_STREAM_NOT_SET if the output stream hasn't been set yet. WS_NO_ERROR otherwise.
  */
 ws_error_t ws_internal_updateColors() {
+	ws_session_t* session = ws_internal_session();
+	FILE* out = ws_internal_stream(session, WS_OUTPUT);
 	COLOR_MUTEX_CHECK;
 	LOCK_COLOR_MUTEX;
-	if (!ws_out_stream) return WS_OUT_STREAM_NOT_SET;
-	if (current_colors.foreground == WS_FG_DEFAULT) {
-		current_colors.foreground = default_colors.foreground;
+	if (!out) {
+		UNLOCK_COLOR_MUTEX;
+		return WS_OUT_STREAM_NOT_SET;
+	}
+	if (session->current_colors.foreground == WS_FG_DEFAULT) {
+		session->current_colors.foreground = session->default_colors.foreground;
 	}
-	if (current_colors.background == WS_BG_DEFAULT) {
-		current_colors.background = default_colors.background;
+	if (session->current_colors.background == WS_BG_DEFAULT) {
+		session->current_colors.background = session->default_colors.background;
+	}
+	if (session->emitted_stream != out) {
+		session->emitted_stream = out;
+		session->emitted_valid = false;
+		session->stream_has_colors = ws_internal_streamHasColors(session->color_mode, out);
+	}
+	// Skip the write if the stream can't show colors, or already has these ones.
+	ws_color_t current = session->current_colors;
+	if (session->stream_has_colors && (!session->emitted_valid || session->emitted_colors.foreground != current.foreground ||
+									   session->emitted_colors.background != current.background)) {
+		SET_WS_COLORS(current.foreground, current.background);
+		session->emitted_colors = current;
+		session->emitted_valid = true;
 	}
-	SET_WS_COLORS(current_colors.foreground, current_colors.background);
 	UNLOCK_COLOR_MUTEX;
 	return WS_NO_ERROR;
 }
@@ -424,7 +752,7 @@ ws_error_t ws_internal_updateColors() {
 void ws_setForegroundDefault(ws_fg_color_t c) {
 	COLOR_MUTEX_CHECK;
 	LOCK_COLOR_MUTEX;
-	default_colors.foreground = c;
+	ws_internal_session()->default_colors.foreground = c;
 	UNLOCK_COLOR_MUTEX;
 }
 
@@ -435,7 +763,7 @@ void ws_setForegroundDefault(ws_fg_color_t c) {
 void ws_setBackgroundDefault(ws_bg_color_t c) {
 	COLOR_MUTEX_CHECK;
 	LOCK_COLOR_MUTEX;
-	default_colors.background = c;
+	ws_internal_session()->default_colors.background = c;
 	UNLOCK_COLOR_MUTEX;
 }
 
@@ -448,17 +776,39 @@ void ws_setDefaultColors(ws_color_t c) {
 	ws_setBackgroundDefault(c.background);
 }
 
+/**
+ * @brief Sets when colors are written. Defaults to WS_COLOR_AUTO, which only writes them to terminals.
+ * @param mode WS_COLOR_AUTO, WS_COLOR_ALWAYS or WS_COLOR_NEVER.
+ */
+void ws_setColorMode(ws_color_mode_t mode) {
+	ws_session_t* session = ws_internal_session();
+	FILE* out = ws_internal_stream(session, WS_OUTPUT);
+	COLOR_MUTEX_CHECK;
+	LOCK_COLOR_MUTEX;
+	// Turning colors off shouldn't leave the console stuck in the last one.
+	if (out && session->emitted_stream == out && session->stream_has_colors &&
+		session->emitted_valid &&
+		(session->emitted_colors.foreground != WS_FG_DEFAULT || session->emitted_colors.background != WS_BG_DEFAULT)) {
+		SET_WS_COLORS(WS_FG_DEFAULT, WS_BG_DEFAULT);
+	}
+	session->color_mode = mode;
+	// Checked again on the next update.
+	session->emitted_stream = NULL;
+	session->emitted_valid = false;
+	UNLOCK_COLOR_MUTEX;
+}
+
 /**
  * @brief Get the current console colors.
  * @return  The ws_color_t of the current colors.
  */
-ws_color_t ws_getCurrentColors() { return current_colors; }
+ws_color_t ws_getCurrentColors() { return ws_internal_session()->current_colors; }
 
 /**
  * @brief Get the current default colors.
  * @return The ws_color_t of the default colors.
  */
-ws_color_t ws_getDefaultColors() { return default_colors; }
+ws_color_t ws_getDefaultColors() { return ws_internal_session()->default_colors; }
 
 /**
  * @brief Set the background and foreground colors to the provided ones.
@@ -468,8 +818,7 @@ ws_color_t ws_getDefaultColors() { return default_colors; }
 ws_error_t ws_setConsoleColors(ws_color_t colors) {
 	COLOR_MUTEX_CHECK;
 	LOCK_COLOR_MUTEX;
-	current_colors.foreground = colors.foreground;
-	current_colors.background = colors.background;
+	ws_internal_session()->current_colors = colors;
 	UNLOCK_COLOR_MUTEX;
 	return ws_internal_updateColors();
 }
@@ -482,7 +831,7 @@ ws_error_t ws_setConsoleColors(ws_color_t colors) {
 ws_error_t ws_setForegroundColor(ws_fg_color_t color) {
 	COLOR_MUTEX_CHECK;
 	LOCK_COLOR_MUTEX;
-	current_colors.foreground = color;
+	ws_internal_session()->current_colors.foreground = color;
 	UNLOCK_COLOR_MUTEX;
 	return ws_internal_updateColors();
 }
@@ -495,7 +844,7 @@ ws_error_t ws_setForegroundColor(ws_fg_color_t color) {
 ws_error_t ws_setBackgroundColor(ws_bg_color_t color) {
 	COLOR_MUTEX_CHECK;
 	LOCK_COLOR_MUTEX;
-	current_colors.background = color;
+	ws_internal_session()->current_colors.background = color;
 	UNLOCK_COLOR_MUTEX;
 	return ws_internal_updateColors();
 }
@@ -507,6 +856,11 @@ ws_error_t ws_setBackgroundColor(ws_bg_color_t color) {
 // ------------------------------------------------------------------------------------------------
 #ifdef THREADED_SUPPORT
 #ifndef CUSTOM_THREADS
+/* What a new thread should run. Allocated by ws_createThread, freed by the thread once it starts. */
+typedef struct {
+	ws_thread_func_t func;
+	void* arg;
+} ws_thread_start_t;
 
 #ifdef _WIN32
 /**
@@ -548,14 +902,6 @@ void ws_destroyMutex(ws_mutex_t* mut) {
  */
 ws_thread_id_t ws_getThreadID() { return GetCurrentThreadId(); }
 
-/**
- * @internal
- * @brief Prints the threadID related to the calling thread.
- *
- * @param stream Output stream for fprintf.
- */
-void ws_internal_printThreadID(FILE* stream) { fprintf(stream, "%lu", ws_getThreadID()); }
-
 /**
  * @brief Sleep function wrapper.
  * @param ms Sleep time in milliseconds.
@@ -563,7 +909,101 @@ void ws_internal_printThreadID(FILE* stream) { fprintf(stream, "%lu", ws_getThre
 void ws_sleep(size_t ms) {
 	Sleep(ms);
 }
+
+/**
+ * @brief Create a condition variable.
+ * @return Pointer to a condition variable if successful, NULL otherwise.
+ */
+ws_cond_t* ws_createCond() {
+	ws_cond_t* cond = (ws_cond_t*) malloc(sizeof(ws_cond_t));
+	if (cond == NULL) return NULL;
+	InitializeConditionVariable(cond);
+	return cond;
+}
+
+/**
+ * @brief Destroys the provided condition variable. Nothing can be waiting on it.
+ * @param cond Condition variable to be destroyed.
+ */
+void ws_destroyCond(ws_cond_t* cond) { free(cond); }
+
+/**
+ * @brief Unlocks the mutex and waits for the condition variable to be signaled, then locks the mutex again.
+ * @param cond Condition variable to wait on.
+ * @param mut Mutex guarding the condition. Must be locked by the caller.
+ * @param timeout_ms How long to wait, or WS_WAIT_FOREVER.
+ * @return false if it timed out. Like any condition variable, it can wake up without being signaled.
+ */
+bool ws_waitCond(ws_cond_t* cond, ws_mutex_t* mut, size_t timeout_ms) {
+	if (SleepConditionVariableCS(cond, mut, timeout_ms == WS_WAIT_FOREVER ? INFINITE : (DWORD) timeout_ms)) return true;
+	return GetLastError() != ERROR_TIMEOUT;
+}
+
+/**
+ * @brief Wakes one thread waiting on the condition variable.
+ * @param cond Condition variable to signal.
+ */
+void ws_signalCond(ws_cond_t* cond) { WakeConditionVariable(cond); }
+
+/**
+ * @brief Wakes every thread waiting on the condition variable.
+ * @param cond Condition variable to signal.
+ */
+void ws_broadcastCond(ws_cond_t* cond) { WakeAllConditionVariable(cond); }
+
+/**
+ * @internal
+ * @brief Entry point for threads made with ws_createThread.
+ */
+DWORD WINAPI ws_internal_threadStart(LPVOID param) {
+	ws_thread_start_t start = *(ws_thread_start_t*) param;
+	free(param);
+	start.func(start.arg);
+	return 0;
+}
+
+/**
+ * @brief Starts a new thread.
+ * @param thread Set to the new thread's handle. Must be passed to ws_joinThread.
+ * @param func Function the thread runs.
+ * @param arg Argument passed to func.
+ * @return true if the thread was started.
+ */
+bool ws_createThread(ws_thread_t* thread, ws_thread_func_t func, void* arg) {
+	ws_thread_start_t* start = (ws_thread_start_t*) malloc(sizeof(ws_thread_start_t));
+	if (!start) return false;
+	start->func = func;
+	start->arg = arg;
+	*thread = CreateThread(NULL, 0, ws_internal_threadStart, start, 0, NULL);
+	if (*thread == NULL) {
+		free(start);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Waits for a thread made with ws_createThread to finish, then releases it.
+ * @param thread Thread to wait for.
+ */
+void ws_joinThread(ws_thread_t thread) {
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+/**
+ * @brief Gets the number of logical cores.
+ * @return Number of cores, at least 1.
+ */
+size_t ws_getCoreCount() {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (size_t) info.dwNumberOfProcessors : 1;
+}
 #else
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
 
 /**
  * @brief Locks the provided mutex.
@@ -602,13 +1042,6 @@ void ws_destroyMutex(ws_mutex_t* mut) {
  * @return ws_thread_id_t relating to the calling thread.
  */
 ws_thread_id_t ws_getThreadID() { return pthread_self(); }
-/**
- * @internal
- * @brief Prints the threadID related to the calling thread.
- *
- * @param stream Output stream for fprintf.
- */
-void ws_internal_printThreadID(FILE* stream) { fprintf(stream, "%zu", ws_getThreadID()); }
 
 /**
  * @brief Sleep function wrapper.
@@ -621,613 +1054,5115 @@ void ws_sleep(size_t ms) {
 
 	nanosleep(&ts, NULL);
 }
-#endif // _WIN32
-#endif // CUSTOM_THREADS
 
 /**
- * @brief Gets the value stored by the atomic bool.
- * @param ab Atomic bool object pointer.
- * @return False if bool does not exist, otherwise the value contained by the bool.
+ * @brief Create a condition variable.
+ * @return Pointer to a condition variable if successful, NULL otherwise.
  */
-bool ws_getAtomicBool(ws_atomic_bool_t* ab) {
-	if (!ab) return false;
-	bool ret;
-	ws_lockMutex(ab->mut);
-	ret = ab->b;
-	ws_unlockMutex(ab->mut);
-	return ret;
+ws_cond_t* ws_createCond() {
+	ws_cond_t* cond = (ws_cond_t*) malloc(sizeof(ws_cond_t));
+	if (cond == NULL) return NULL;
+	int result;
+#ifdef __APPLE__
+	result = pthread_cond_init(cond, NULL);
+#else
+	// Timed waits use the monotonic clock, so changing the system time doesn't stretch or cut them short.
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	result = pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+#endif // __APPLE__
+	if (result != 0) {
+		free(cond);
+		return NULL;
+	}
+	return cond;
 }
 
 /**
- * @brief Sets the value of the provided atomic bool.
- * @param ab Atomic bool object.
- * @param b Value to set the bool to.
+ * @brief Destroys the provided condition variable. Nothing can be waiting on it.
+ * @param cond Condition variable to be destroyed.
  */
-void ws_setAtomicBool(ws_atomic_bool_t* ab, bool b) {
-	if (!ab) return;
-	ws_lockMutex(ab->mut);
-	ab->b = b;
-	ws_unlockMutex(ab->mut);
+void ws_destroyCond(ws_cond_t* cond) {
+	if (!cond) return;
+	pthread_cond_destroy(cond);
+	free(cond);
 }
 
 /**
- * @brief Creates an atomic bool.
- * @param b Initial value held by the bool.
- * @return NULL if it couldn't be created, pointer to the object otherwise.
+ * @brief Unlocks the mutex and waits for the condition variable to be signaled, then locks the mutex again.
+ * @param cond Condition variable to wait on.
+ * @param mut Mutex guarding the condition. Must be locked by the caller.
+ * @param timeout_ms How long to wait, or WS_WAIT_FOREVER.
+ * @return false if it timed out. Like any condition variable, it can wake up without being signaled.
  */
-ws_atomic_bool_t* ws_createAtomicBool(bool b) {
-	ws_atomic_bool_t* ab = (ws_atomic_bool_t*) malloc(sizeof(ws_atomic_bool_t));
-	if (ab == NULL) return NULL;
-	ab->b = b;
-	ab->mut = ws_createMutex();
-	return ab;
+bool ws_waitCond(ws_cond_t* cond, ws_mutex_t* mut, size_t timeout_ms) {
+	if (timeout_ms == WS_WAIT_FOREVER) return pthread_cond_wait(cond, mut) == 0;
+	struct timespec ts;
+#ifdef __APPLE__
+	clock_gettime(CLOCK_REALTIME, &ts);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif // __APPLE__
+	ts.tv_sec += (time_t) (timeout_ms / 1000);
+	ts.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	return pthread_cond_timedwait(cond, mut, &ts) != ETIMEDOUT;
 }
 
 /**
- * @brief Destroys the provided atomic bool.
- * @param ab Atomic bool to destroy.
+ * @brief Wakes one thread waiting on the condition variable.
+ * @param cond Condition variable to signal.
  */
-void ws_destroyAtomicBool(ws_atomic_bool_t* ab) {
-	ws_lockMutex(ab->mut);
-	ws_destroyMutex(ab->mut);
-	free(ab);
-}
-
-#endif // THREADED_SUPPORT
-
-// ------------------------------------------------------------------------------------------------
-// ------------------------------------------------------------------------------------------------
-// Logging Functions
-// ------------------------------------------------------------------------------------------------
-// ------------------------------------------------------------------------------------------------
-#ifndef NO_WS_LOGGING
-#ifdef THREADED_SUPPORT
-ws_mutex_t* logging_mutex = NULL;
-#define LOCK_LOGGING_MUTEX ws_lockMutex(logging_mutex)
-#define UNLOCK_LOGGING_MUTEX ws_unlockMutex(logging_mutex)
+void ws_signalCond(ws_cond_t* cond) { pthread_cond_signal(cond); }
 
-typedef struct {
-	char* name;
-	ws_thread_id_t id;
-} ws_thread_map_t;
+/**
+ * @brief Wakes every thread waiting on the condition variable.
+ * @param cond Condition variable to signal.
+ */
+void ws_broadcastCond(ws_cond_t* cond) { pthread_cond_broadcast(cond); }
 
-ws_thread_map_t* thread_map = NULL;
-size_t thread_map_size = 0;
-size_t thread_map_current = 0;
+/**
+ * @internal
+ * @brief Entry point for threads made with ws_createThread.
+ */
+void* ws_internal_threadStart(void* param) {
+	ws_thread_start_t start = *(ws_thread_start_t*) param;
+	free(param);
+	start.func(start.arg);
+	return NULL;
+}
 
-ws_mutex_t* thread_map_mut = NULL;
 /**
- * @brief Sets the name of the calling thread. This will only be printed if threadID is true.
- * @param name Name of the thread.
+ * @brief Starts a new thread.
+ * @param thread Set to the new thread's handle. Must be passed to ws_joinThread.
+ * @param func Function the thread runs.
+ * @param arg Argument passed to func.
+ * @return true if the thread was started.
  */
-void ws_setThreadName(char* name) {
-	if (!thread_map_mut) {
-		thread_map_mut = ws_createMutex();
-		if (!thread_map_mut) return;
-	}
-	ws_lockMutex(thread_map_mut);
-	if (!thread_map) {
-		thread_map = (ws_thread_map_t*) calloc(1, sizeof(ws_thread_map_t));
-		if (!thread_map) return;
-		thread_map_size++;
+bool ws_createThread(ws_thread_t* thread, ws_thread_func_t func, void* arg) {
+	ws_thread_start_t* start = (ws_thread_start_t*) malloc(sizeof(ws_thread_start_t));
+	if (!start) return false;
+	start->func = func;
+	start->arg = arg;
+	if (pthread_create(thread, NULL, ws_internal_threadStart, start) != 0) {
+		free(start);
+		return false;
 	}
-	if (thread_map_size - 1 < thread_map_current) {
-		ws_thread_map_t* temp = realloc(thread_map, (thread_map_size + 1) * sizeof(ws_thread_map_t));
-		if (!temp) return;
-		thread_map = temp;
-		thread_map_size++;
-	}
-	char* thread_name = calloc(strlen(name), sizeof(char));
-	if (!thread_name) return;
-	strcpy(thread_name, name);
-
-	thread_map[thread_map_current].name = thread_name;
-	thread_map[thread_map_current].id = ws_getThreadID();
-
-	thread_map_current++;
-	ws_unlockMutex(thread_map_mut);
+	return true;
 }
 
 /**
- * @brief Removes the name of the provided thread.
- * @param name Name of the thread.
+ * @brief Waits for a thread made with ws_createThread to finish, then releases it.
+ * @param thread Thread to wait for.
  */
-void ws_removeThreadName(const char* name) {
-	if (!thread_map_mut) {
-		thread_map_mut = ws_createMutex();
-		if (!thread_map_mut) return;
-	}
-	ws_lockMutex(thread_map_mut);
-
-	if (!thread_map) return;
-	if (thread_map_current == 0) return;
-	if (thread_map_size == 0) return; // This should be impossible.
-
-	for (int i = 0; i < thread_map_current; i++) {
-		if (strcmp(thread_map[thread_map_current].name, name) == 0) {
-			free(thread_map[thread_map_current].name);
-			for (int j = i; j < thread_map_current - 1; j++) {
-				thread_map[j].id = thread_map[j + 1].id;
-				thread_map[j].name = thread_map[j + 1].name;
-			}
-			ws_unlockMutex(thread_map_mut);
-			return;
-		}
-	}
+void ws_joinThread(ws_thread_t thread) { pthread_join(thread, NULL); }
 
-	ws_unlockMutex(thread_map_mut);
+/**
+ * @brief Gets the number of logical cores.
+ * @return Number of cores, at least 1.
+ */
+size_t ws_getCoreCount() {
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return cores > 0 ? (size_t) cores : 1;
 }
+#endif // _WIN32
+#endif // CUSTOM_THREADS
+
+// ------------------------------------------------------------------------------------------------
+// Events
+// ------------------------------------------------------------------------------------------------
+struct ws_event {
+	ws_mutex_t* mut;
+	ws_cond_t* cond;
+	bool set;
+	bool manual_reset; // Stays set until ws_resetEvent, instead of being reset by the first wait that sees it.
+};
 
 /**
- * @brief Prints the threadID of the calling thread.
+ * @brief Create an event.
+ * @param manual_reset If true, the event wakes every waiter and stays set until ws_resetEvent is called.
+ * Otherwise, it wakes a single waiter and resets itself.
+ * @return Pointer to an event if successful, NULL otherwise.
  */
-void ws_printThreadID() {
-	if (!thread_map_mut) {
-		thread_map_mut = ws_createMutex();
-		if (!thread_map_mut) return;
-	}
-	ws_lockMutex(thread_map_mut);
-	ws_thread_id_t cur = ws_getThreadID();
-	for (int i = 0; i < thread_map_current; i++) {
-		if (thread_map[i].id == cur) {
-			fprintf(ws_out_stream, "%s", thread_map[i].name);
-			goto exit;
-		}
+ws_event_t* ws_createEvent(bool manual_reset) {
+	ws_event_t* event = (ws_event_t*) malloc(sizeof(ws_event_t));
+	if (!event) return NULL;
+	event->mut = ws_createMutex();
+	event->cond = ws_createCond();
+	if (!event->mut || !event->cond) {
+		if (event->mut) ws_destroyMutex(event->mut);
+		if (event->cond) ws_destroyCond(event->cond);
+		free(event);
+		return NULL;
 	}
-	ws_internal_printThreadID(ws_out_stream);
-exit:
-	ws_unlockMutex(thread_map_mut);
+	event->set = false;
+	event->manual_reset = manual_reset;
+	return event;
 }
 
-bool printThreadID = true;
 /**
- * @brief Set print threadID, which prints the threadID of function calling `ws_logger`. Defaults to on.
- * @param b True to turn on, false to turn off.
+ * @brief Destroys the provided event. Nothing can be waiting on it.
+ * @param event Event to be destroyed.
  */
-void ws_doPrintThreadID(bool b) { printThreadID = b; }
-#else
-#define LOCK_LOGGING_MUTEX
-#define UNLOCK_LOGGING_MUTEX
-#endif
+void ws_destroyEvent(ws_event_t* event) {
+	if (!event) return;
+	ws_destroyCond(event->cond);
+	ws_destroyMutex(event->mut);
+	free(event);
+}
 
 /**
- * @internal
- * @brief Checks the logging mutex and makes sure the output stream is set.
+ * @brief Sets the event, waking whoever is waiting on it.
+ * @param event Event to set.
  */
-void ws_internal_logging_check() {
-#ifdef THREADED_SUPPORT
-	if (!logging_mutex) logging_mutex = ws_createMutex(); // We don't really care if it's NULL.
-#endif // THREADED_SUPPORT
-	// Make sure we have an out stream.
-	if (!ws_out_stream) ws_setStream(WS_OUTPUT, stdout);
+void ws_setEvent(ws_event_t* event) {
+	ws_lockMutex(event->mut);
+	event->set = true;
+	if (event->manual_reset) ws_broadcastCond(event->cond);
+	else ws_signalCond(event->cond);
+	ws_unlockMutex(event->mut);
 }
 
-#define LOGGING_CHECK ws_internal_logging_check()
-
-ws_color_t log_colors = { WS_FG_WHITE, WS_BG_DEFAULT };
-ws_color_t debug_colors = { WS_FG_BRIGHT_GREEN, WS_BG_DEFAULT };
-ws_color_t info_colors = { WS_FG_BRIGHT_CYAN, WS_BG_DEFAULT };
-ws_color_t warn_colors = { WS_FG_BRIGHT_YELLOW, WS_BG_DEFAULT };
-ws_color_t error_colors = { WS_FG_BRIGHT_RED, WS_BG_DEFAULT };
-ws_color_t fatal_colors = { WS_FG_RED, WS_BG_DEFAULT };
-
 /**
- * @internal
- * @brief Logger [LOG] function
- *
- * @param format printf format string
- * @param args vprintf va_list
+ * @brief Resets the event, so waits block again.
+ * @param event Event to reset.
  */
-void ws_vlogf(const char* format, va_list args) {
-	LOGGING_CHECK;
-	LOCK_LOGGING_MUTEX;
-	ws_color_t current = ws_getCurrentColors();
-	ws_setConsoleColors(log_colors);
-	fprintf(ws_out_stream, "[LOG]  ");
+void ws_resetEvent(ws_event_t* event) {
+	ws_lockMutex(event->mut);
+	event->set = false;
+	ws_unlockMutex(event->mut);
+}
 
-#ifdef THREADED_SUPPORT
-	if (printThreadID) {
-		fprintf(ws_out_stream, "[");
-		ws_printThreadID();
-		fprintf(ws_out_stream, "]");
+/**
+ * @brief Waits for the event to be set.
+ * @param event Event to wait on.
+ * @param timeout_ms How long to wait, or WS_WAIT_FOREVER. 0 just checks it.
+ * @return true if the event was set, false if it timed out.
+ */
+bool ws_waitEvent(ws_event_t* event, size_t timeout_ms) {
+	ws_lockMutex(event->mut);
+	// A spurious wakeup restarts the timeout. They're rare enough that tracking the time left isn't worth it.
+	while (!event->set && timeout_ms != 0) {
+		if (!ws_waitCond(event->cond, event->mut, timeout_ms)) break;
 	}
-#endif
-	fprintf(ws_out_stream, " ");
-	vfprintf(ws_out_stream, format, args);
-	fprintf(ws_out_stream, "\n");
-	ws_setConsoleColors(current);
-	UNLOCK_LOGGING_MUTEX;
+	bool set = event->set;
+	if (set && !event->manual_reset) event->set = false;
+	ws_unlockMutex(event->mut);
+	return set;
 }
 
 /**
  * @internal
- * @brief Logger [DEBUG] function
- *
- * @param format printf format string
- * @param args vprintf va_list
+ * @brief Gets the event stored in slot, creating it if it doesn't exist yet.
+ * @return The event, or NULL if it couldn't be created.
  */
-void ws_vdebugf(const char* format, va_list args) {
-	LOGGING_CHECK;
-	LOCK_LOGGING_MUTEX;
-	ws_color_t current = ws_getCurrentColors();
-	ws_setConsoleColors(debug_colors);
-	fprintf(ws_out_stream, "[DEBUG]");
-
-#ifdef THREADED_SUPPORT
-	if (printThreadID) {
-		fprintf(ws_out_stream, "[");
-		ws_printThreadID();
-		fprintf(ws_out_stream, "]");
-	}
-#endif
-	fprintf(ws_out_stream, " ");
-	vfprintf(ws_out_stream, format, args);
-	fprintf(ws_out_stream, "\n");
-	ws_setConsoleColors(current);
-	UNLOCK_LOGGING_MUTEX;
+ws_event_t* ws_internal_getEvent(ws_atomic_ptr_t* slot, bool manual_reset) {
+	ws_event_t* event = (ws_event_t*) ws_getAtomicPtr(slot);
+	if (event) return event;
+	ws_event_t* created = ws_createEvent(manual_reset);
+	if (!created) return NULL;
+	void* expected = NULL;
+	if (ws_compareExchangeAtomicPtr(slot, &expected, created)) return created;
+	// Another thread made one first.
+	ws_destroyEvent(created);
+	return (ws_event_t*) expected;
 }
 
 /**
  * @internal
- * @brief Logger [INFO] function
- *
- * @param format printf format string
- * @param args vprintf va_list
+ * @brief Wakes a session's terminal if it's waiting for input.
  */
-void ws_vinfof(const char* format, va_list args) {
-	LOGGING_CHECK;
-	LOCK_LOGGING_MUTEX;
-	ws_color_t current = ws_getCurrentColors();
-	ws_setConsoleColors(info_colors);
-	fprintf(ws_out_stream, "[INFO] ");
-
-#ifdef THREADED_SUPPORT
-	if (printThreadID) {
-		fprintf(ws_out_stream, "[");
-		ws_printThreadID();
-		fprintf(ws_out_stream, "]");
-	}
-#endif
-	fprintf(ws_out_stream, " ");
-	vfprintf(ws_out_stream, format, args);
-	fprintf(ws_out_stream, "\n");
-
-	ws_setConsoleColors(current);
-	UNLOCK_LOGGING_MUTEX;
+void ws_internal_wakeSession(ws_session_t* session) {
+	ws_event_t* wake = (ws_event_t*) ws_getAtomicPtr(&session->wake);
+	if (wake) ws_setEvent(wake);
 }
 
+// ------------------------------------------------------------------------------------------------
+// Atomics
+// ------------------------------------------------------------------------------------------------
+#if defined(WS_ATOMICS_MUTEX) || !(defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+/*
+ * Fallback for platforms without atomics. Every atomic shares one mutex.
+ * It's created by the first init call, so initialize an atomic before starting any threads.
+ */
+ws_mutex_t* atomics_mutex = NULL;
+
 /**
  * @internal
- * @brief Logger [WARN] function
- *
- * @param format printf format string
- * @param args vprintf va_list
+ * @brief Makes sure the shared atomics mutex exists, then locks it.
  */
-void ws_vwarnf(const char* format, va_list args) {
-	LOGGING_CHECK;
-	LOCK_LOGGING_MUTEX;
-	ws_color_t current = ws_getCurrentColors();
-	ws_setConsoleColors(warn_colors);
-	fprintf(ws_out_stream, "[WARN] ");
-
-#ifdef THREADED_SUPPORT
-	if (printThreadID) {
-		fprintf(ws_out_stream, "[");
-		ws_printThreadID();
-		fprintf(ws_out_stream, "]");
-	}
+void ws_internal_lockAtomics() {
+	if (!atomics_mutex) atomics_mutex = ws_createMutex();
+	ws_lockMutex(atomics_mutex);
+}
+#define LOCK_ATOMICS ws_internal_lockAtomics()
+#define UNLOCK_ATOMICS ws_unlockMutex(atomics_mutex)
 #endif
-	fprintf(ws_out_stream, " ");
-	vfprintf(ws_out_stream, format, args);
-	fprintf(ws_out_stream, "\n");
 
-	ws_setConsoleColors(current);
-	UNLOCK_LOGGING_MUTEX;
+/**
+ * @brief Initializes an atomic int. Static atomics can use WS_ATOMIC_INIT instead.
+ * @param a Atomic to initialize.
+ * @param v Initial value.
+ */
+void ws_initAtomicInt(ws_atomic_int_t* a, long v) {
+#if defined(WS_ATOMICS_C11)
+	atomic_init(&a->value, v);
+#elif defined(WS_ATOMICS_MUTEX)
+	LOCK_ATOMICS;
+	a->value = v;
+	UNLOCK_ATOMICS;
+#else
+	a->value = v;
+#endif
 }
 
 /**
- * @internal
- * @brief Logger [ERROR] function
- *
- * @param format printf format string
- * @param args vprintf va_list
+ * @brief Gets the value of an atomic int.
+ * @param a Atomic to read.
+ * @return The current value.
  */
-void ws_verrorf(const char* format, va_list args) {
-	LOGGING_CHECK;
-	LOCK_LOGGING_MUTEX;
-	ws_color_t current = ws_getCurrentColors();
-	ws_setConsoleColors(error_colors);
-	fprintf(ws_out_stream, "[ERROR]");
-
-#ifdef THREADED_SUPPORT
-	if (printThreadID) {
-		fprintf(ws_out_stream, "[");
-		ws_printThreadID();
-		fprintf(ws_out_stream, "]");
-	}
+long ws_getAtomicInt(ws_atomic_int_t* a) {
+#if defined(WS_ATOMICS_C11)
+	return atomic_load(&a->value);
+#elif defined(WS_ATOMICS_GNU)
+	return __atomic_load_n(&a->value, __ATOMIC_SEQ_CST);
+#elif defined(WS_ATOMICS_MSVC)
+	return InterlockedCompareExchange(&a->value, 0, 0);
+#else
+	LOCK_ATOMICS;
+	long v = a->value;
+	UNLOCK_ATOMICS;
+	return v;
 #endif
-	fprintf(ws_out_stream, " ");
-	vfprintf(ws_out_stream, format, args);
-	fprintf(ws_out_stream, "\n");
-
-	ws_setConsoleColors(current);
-	UNLOCK_LOGGING_MUTEX;
 }
 
 /**
- * @internal
- * @brief Logger [FATAL] function
- *
- * @param format printf format string
- * @param args vprintf va_list
+ * @brief Sets the value of an atomic int.
+ * @param a Atomic to set.
+ * @param v Value to set it to.
  */
-void ws_vfatalf(const char* format, va_list args) {
-	LOGGING_CHECK;
-	LOCK_LOGGING_MUTEX;
-	ws_color_t current = ws_getCurrentColors();
-	ws_setConsoleColors(fatal_colors);
-	fprintf(ws_out_stream, "[FATAL]");
-
-#ifdef THREADED_SUPPORT
-	if (printThreadID) {
-		fprintf(ws_out_stream, "[");
-		ws_printThreadID();
-		fprintf(ws_out_stream, "]");
-	}
+void ws_setAtomicInt(ws_atomic_int_t* a, long v) {
+#if defined(WS_ATOMICS_C11)
+	atomic_store(&a->value, v);
+#elif defined(WS_ATOMICS_GNU)
+	__atomic_store_n(&a->value, v, __ATOMIC_SEQ_CST);
+#elif defined(WS_ATOMICS_MSVC)
+	InterlockedExchange(&a->value, v);
+#else
+	LOCK_ATOMICS;
+	a->value = v;
+	UNLOCK_ATOMICS;
 #endif
-	fprintf(ws_out_stream, " ");
-	vfprintf(ws_out_stream, format, args);
-	fprintf(ws_out_stream, "\n");
-
-	ws_setConsoleColors(current);
-	UNLOCK_LOGGING_MUTEX;
 }
 
 /**
- * @brief Logger function for WallShell. vprintf like formatting, automatically adds a newline.
- * @param type Type of logging.
- * @param format printf style formatting string.
- * @param args va_list of arguments.
+ * @brief Adds to an atomic int.
+ * @param a Atomic to add to.
+ * @param v Amount to add. Can be negative.
+ * @return The value before the add.
  */
-void ws_vlogger(ws_logtype_t type, const char* format, va_list args) {
-	switch (type) {
-		case WS_LOG: {
-				ws_vlogf(format, args);
-				break;
-			}
-		case WS_DEBUG: {
-				ws_vdebugf(format, args);
-				break;
-			}
-		case WS_INFO: {
-				ws_vinfof(format, args);
-				break;
-			}
-		case WS_WARN: {
-				ws_vwarnf(format, args);
-				break;
-			}
-		case WS_ERROR: {
-				ws_verrorf(format, args);
-				break;
-			}
-		case WS_FATAL: {
-				ws_vfatalf(format, args);
-				break;
-			}
-		default: {
-				vfprintf(ws_out_stream, format, args);
-			}
-	}
+long ws_addAtomicInt(ws_atomic_int_t* a, long v) {
+#if defined(WS_ATOMICS_C11)
+	return atomic_fetch_add(&a->value, v);
+#elif defined(WS_ATOMICS_GNU)
+	return __atomic_fetch_add(&a->value, v, __ATOMIC_SEQ_CST);
+#elif defined(WS_ATOMICS_MSVC)
+	return InterlockedExchangeAdd(&a->value, v);
+#else
+	LOCK_ATOMICS;
+	long old = a->value;
+	a->value += v;
+	UNLOCK_ATOMICS;
+	return old;
+#endif
 }
 
 /**
- * @brief Logger function for WallShell. Printf like formatting, automatically adds a newline.
- * @param type Type of logging.
- * @param format Printf style formatting string.
- * @param ... Printf style formatting arguments.
+ * @brief Sets an atomic int, returning what it was before.
+ * @param a Atomic to set.
+ * @param v Value to set it to.
+ * @return The value before it was set.
  */
-void ws_logger(ws_logtype_t type, const char* format, ...) {
-	va_list args;
-	va_start(args, format);
-	ws_vlogger(type, format, args);
-	va_end(args);
+long ws_exchangeAtomicInt(ws_atomic_int_t* a, long v) {
+#if defined(WS_ATOMICS_C11)
+	return atomic_exchange(&a->value, v);
+#elif defined(WS_ATOMICS_GNU)
+	return __atomic_exchange_n(&a->value, v, __ATOMIC_SEQ_CST);
+#elif defined(WS_ATOMICS_MSVC)
+	return InterlockedExchange(&a->value, v);
+#else
+	LOCK_ATOMICS;
+	long old = a->value;
+	a->value = v;
+	UNLOCK_ATOMICS;
+	return old;
+#endif
 }
 
 /**
- * @brief Set the logger colors for the specified log type.
- * @param type Type of logging.
- * @param fg Foreground color.
- * @param bg Background color.
+ * @brief If the atomic int holds *expected, sets it to desired. Otherwise, *expected is set to what it holds.
+ * @param a Atomic to set.
+ * @param expected Value it's expected to hold.
+ * @param desired Value to set it to.
+ * @return True if it was set.
  */
-void ws_setLoggerColors(ws_logtype_t type, ws_fg_color_t fg, ws_bg_color_t bg) {
-	switch (type) {
-		case WS_LOG: {
-				log_colors.foreground = fg;
-				log_colors.background = bg;
-				break;
-			}
-		case WS_INFO: {
-				warn_colors.foreground = fg;
-				warn_colors.background = bg;
-				break;
-			}
-		case WS_DEBUG: {
-				debug_colors.foreground = fg;
-				debug_colors.background = bg;
-				break;
-			}
-		case WS_WARN: {
-				warn_colors.foreground = fg;
-				warn_colors.background = bg;
-				break;
-			}
-		case WS_ERROR: {
-				error_colors.foreground = fg;
-				error_colors.background = bg;
-				break;
-			}
-		case WS_FATAL: {
-				fatal_colors.foreground = fg;
-				fatal_colors.background = bg;
-				break;
-			}
-		default: break;
-	}
+bool ws_compareExchangeAtomicInt(ws_atomic_int_t* a, long* expected, long desired) {
+#if defined(WS_ATOMICS_C11)
+	return atomic_compare_exchange_strong(&a->value, expected, desired);
+#elif defined(WS_ATOMICS_GNU)
+	return __atomic_compare_exchange_n(&a->value, expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#elif defined(WS_ATOMICS_MSVC)
+	long old = InterlockedCompareExchange(&a->value, desired, *expected);
+	if (old == *expected) return true;
+	*expected = old;
+	return false;
+#else
+	LOCK_ATOMICS;
+	bool swapped = a->value == *expected;
+	if (swapped) a->value = desired;
+	else *expected = a->value;
+	UNLOCK_ATOMICS;
+	return swapped;
+#endif
 }
 
 /**
- * @internal
- * @brief Resets all logger variables. Resets color, mutex, etc.
+ * @brief Initializes an atomic pointer. Static atomics can use WS_ATOMIC_INIT instead.
+ * @param a Atomic to initialize.
+ * @param p Initial value.
  */
-void ws_internal_cleanLogger() {
-#ifdef THREADED_SUPPORT
-	if (logging_mutex) ws_destroyMutex(logging_mutex);
-	if (thread_map_mut) ws_destroyMutex(thread_map_mut);
-	logging_mutex = NULL;
-	printThreadID = true;
-	if (thread_map) {
-		for (int i = 0; i < thread_map_current; i++) {
-			free(thread_map[i].name);
-		}
-		free(thread_map);
-	}
-	thread_map_size = 0;
-	thread_map_current = 0;
-	thread_map = NULL;
+void ws_initAtomicPtr(ws_atomic_ptr_t* a, void* p) {
+#if defined(WS_ATOMICS_C11)
+	atomic_init(&a->value, p);
+#elif defined(WS_ATOMICS_MUTEX)
+	LOCK_ATOMICS;
+	a->value = p;
+	UNLOCK_ATOMICS;
+#else
+	a->value = p;
 #endif
-	log_colors = (ws_color_t){ WS_FG_WHITE, WS_BG_DEFAULT };
-	debug_colors = (ws_color_t){ WS_FG_BRIGHT_GREEN, WS_BG_DEFAULT };
-	info_colors = (ws_color_t){ WS_FG_BRIGHT_CYAN, WS_BG_DEFAULT };
-	warn_colors = (ws_color_t){ WS_FG_BRIGHT_YELLOW, WS_BG_DEFAULT };
-	error_colors = (ws_color_t){ WS_FG_BRIGHT_RED, WS_BG_DEFAULT };
-	fatal_colors = (ws_color_t){ WS_FG_RED, WS_BG_DEFAULT };
 }
 
-#endif // NO_WS_LOGGING
-
-// ------------------------------------------------------------------------------------------------
-// ------------------------------------------------------------------------------------------------
-// Register Command & Internal Commands
-// ------------------------------------------------------------------------------------------------
-// ------------------------------------------------------------------------------------------------
-
-#ifdef DISABLE_MALLOC
-command_t commands[COMMAND_LIMIT];
-size_t command_size = COMMAND_LIMIT;
+/**
+ * @brief Gets the value of an atomic pointer.
+ * @param a Atomic to read.
+ * @return The current value.
+ */
+void* ws_getAtomicPtr(ws_atomic_ptr_t* a) {
+#if defined(WS_ATOMICS_C11)
+	return atomic_load(&a->value);
+#elif defined(WS_ATOMICS_GNU)
+	return __atomic_load_n(&a->value, __ATOMIC_SEQ_CST);
+#elif defined(WS_ATOMICS_MSVC)
+	return InterlockedCompareExchangePointer(&a->value, NULL, NULL);
 #else
-ws_command_t* commands;
-size_t command_size = 0;
+	LOCK_ATOMICS;
+	void* p = a->value;
+	UNLOCK_ATOMICS;
+	return p;
 #endif
-
-size_t current_command_spot = 0;
-
-char previousCommands[PREVIOUS_BUF_SIZE][MAX_COMMAND_BUF];
-size_t previous_commands_size;
+}
 
 /**
- * @internal
- * @brief Resets all command variables. Resets command list, previousCommands, etc.
+ * @brief Sets the value of an atomic pointer.
+ * @param a Atomic to set.
+ * @param p Value to set it to.
  */
-void ws_internal_cleanCommands() {
-#ifndef DISABLE_MALLOC
-	free(commands);
-	commands = NULL;
-	command_size = 0;
-#else
-	for (int i = 0; i < current_command_spot; i++) {
-		commands[current_command_spot].commandName = NULL;
-		commands[current_command_spot].aliases = NULL;
-		commands[current_command_spot].aliases_count = 0;
-		commands[current_command_spot].helpCommand = NULL;
-		commands[current_command_spot].mainCommand = NULL;
-	}
-	command_size = COMMAND_LIMIT;
-#endif // DISABLE_MALLOC
-	current_command_spot = 0;
-
-	for (int i = 0; i < PREVIOUS_BUF_SIZE; i++) {
-		memset(previousCommands, 0, MAX_COMMAND_BUF);
-	}
-	previous_commands_size = 0;
+void ws_setAtomicPtr(ws_atomic_ptr_t* a, void* p) {
+#if defined(WS_ATOMICS_C11)
+	atomic_store(&a->value, p);
+#elif defined(WS_ATOMICS_GNU)
+	__atomic_store_n(&a->value, p, __ATOMIC_SEQ_CST);
+#elif defined(WS_ATOMICS_MSVC)
+	InterlockedExchangePointer(&a->value, p);
+#else
+	LOCK_ATOMICS;
+	a->value = p;
+	UNLOCK_ATOMICS;
+#endif
 }
 
 /**
- * @brief Register the command to the command handler.
- * @param c Command to be registered.
- * @return Can return WS_COMMAND_LIMIT_REACHED if DISABLE_MALLOC is defined, and WS_OUT_OF_MEMORY if not.
+ * @brief Sets an atomic pointer, returning what it was before.
+ * @param a Atomic to set.
+ * @param p Value to set it to.
+ * @return The value before it was set.
  */
-ws_error_t ws_registerCommand(const ws_command_t c) {
-#ifdef DISABLE_MALLOC
-	if (current_command_spot != COMMAND_LIMIT) {
-		commands[current_command_spot] = c;
-		current_command_spot++;
-	} else {
-		return WS_COMMAND_LIMIT_REACHED;
-	}
-#else
-	if (!commands) {
-		commands = malloc(sizeof(ws_command_t));
-		command_size = 1;
-	} else if (current_command_spot >= command_size) {
-		bool was_one = false;
-		if (command_size == 1) {
-			was_one = true;
-			command_size++;
-		}
-		// realloc invalidates the old pointer on call, but leaves it alone if it cant find the memory.
-		// If this function returns with an out of memory error, the shell is still usable.
-		ws_command_t* new_ptr = realloc(commands, (size_t) ((double) command_size * sizeof(ws_command_t) * 1.5));
-		if (!new_ptr) {
-			if (was_one)
-				command_size--;
-			return WS_OUT_OF_MEMORY;
-		} else {
-			commands = new_ptr;
-		}
-		command_size = (size_t) ((double) command_size * 1.5);
-	}
-	//memcpy(commands[current_command_spot], &c, sizeof(command_t));
-	commands[current_command_spot] = c;
-	current_command_spot++;
+void* ws_exchangeAtomicPtr(ws_atomic_ptr_t* a, void* p) {
+#if defined(WS_ATOMICS_C11)
+	return atomic_exchange(&a->value, p);
+#elif defined(WS_ATOMICS_GNU)
+	return __atomic_exchange_n(&a->value, p, __ATOMIC_SEQ_CST);
+#elif defined(WS_ATOMICS_MSVC)
+	return InterlockedExchangePointer(&a->value, p);
+#else
+	LOCK_ATOMICS;
+	void* old = a->value;
+	a->value = p;
+	UNLOCK_ATOMICS;
+	return old;
 #endif
-	return WS_NO_ERROR;
 }
 
 /**
- * @brief Deregister the provided command.
- * @param c Command to be deregistered. If it doesn't exist (not already registered), nothing happens.
+ * @brief If the atomic pointer holds *expected, sets it to desired. Otherwise, *expected is set to what it holds.
+ * @param a Atomic to set.
+ * @param expected Value it's expected to hold.
+ * @param desired Value to set it to.
+ * @return True if it was set.
  */
-void ws_deregisterCommand(const ws_command_t c) {
-	for (int i = 0; i < current_command_spot; i++) {
-		if (ws_compareCommands(commands[i], c)) {
-			for (int j = i; j < current_command_spot - 1; j++) {
-				// Nothing is allocated through malloc. If something is, it's on the user to free it either before/after calling this.
-				commands[j].commandName = commands[j + 1].commandName;
-				commands[j].aliases = commands[j + 1].aliases;
-				commands[j].aliases_count = commands[j + 1].aliases_count;
-				commands[j].helpCommand = commands[j + 1].helpCommand;
-				commands[j].mainCommand = commands[j + 1].mainCommand;
-			}
-			return;
-		}
-	}
+bool ws_compareExchangeAtomicPtr(ws_atomic_ptr_t* a, void** expected, void* desired) {
+#if defined(WS_ATOMICS_C11)
+	return atomic_compare_exchange_strong(&a->value, expected, desired);
+#elif defined(WS_ATOMICS_GNU)
+	return __atomic_compare_exchange_n(&a->value, expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#elif defined(WS_ATOMICS_MSVC)
+	void* old = InterlockedCompareExchangePointer(&a->value, desired, *expected);
+	if (old == *expected) return true;
+	*expected = old;
+	return false;
+#else
+	LOCK_ATOMICS;
+	bool swapped = a->value == *expected;
+	if (swapped) a->value = desired;
+	else *expected = a->value;
+	UNLOCK_ATOMICS;
+	return swapped;
+#endif
 }
 
-/* Internal clear command */
-const char* clear_aliases[] = { "clr", "cls" };
+#ifndef WS_ATOMICS_MUTEX
 /**
- * @internal
- * @brief Clear function help command
- */
-int clearHelp(int argc, char** argv) {
+ * @brief Gets the value stored by the atomic bool.
+ * @param ab Atomic bool object pointer.
+ * @return False if bool does not exist, otherwise the value contained by the bool.
+ */
+bool ws_getAtomicBool(ws_atomic_bool_t* ab) {
+	if (!ab) return false;
+	return ws_getAtomicInt(&ab->value) != 0;
+}
+
+/**
+ * @brief Sets the value of the provided atomic bool.
+ * @param ab Atomic bool object.
+ * @param b Value to set the bool to.
+ */
+void ws_setAtomicBool(ws_atomic_bool_t* ab, bool b) {
+	if (!ab) return;
+	ws_setAtomicInt(&ab->value, b);
+}
+
+/**
+ * @brief Creates an atomic bool.
+ * @param b Initial value held by the bool.
+ * @return NULL if it couldn't be created, pointer to the object otherwise.
+ */
+ws_atomic_bool_t* ws_createAtomicBool(bool b) {
+	ws_atomic_bool_t* ab = (ws_atomic_bool_t*) malloc(sizeof(ws_atomic_bool_t));
+	if (ab == NULL) return NULL;
+	ws_initAtomicInt(&ab->value, b);
+	return ab;
+}
+
+/**
+ * @brief Destroys the provided atomic bool.
+ * @param ab Atomic bool to destroy.
+ */
+void ws_destroyAtomicBool(ws_atomic_bool_t* ab) {
+	free(ab);
+}
+#else
+/**
+ * @brief Gets the value stored by the atomic bool.
+ * @param ab Atomic bool object pointer.
+ * @return False if bool does not exist, otherwise the value contained by the bool.
+ */
+bool ws_getAtomicBool(ws_atomic_bool_t* ab) {
+	if (!ab) return false;
+	bool ret;
+	ws_lockMutex(ab->mut);
+	ret = ab->b;
+	ws_unlockMutex(ab->mut);
+	return ret;
+}
+
+/**
+ * @brief Sets the value of the provided atomic bool.
+ * @param ab Atomic bool object.
+ * @param b Value to set the bool to.
+ */
+void ws_setAtomicBool(ws_atomic_bool_t* ab, bool b) {
+	if (!ab) return;
+	ws_lockMutex(ab->mut);
+	ab->b = b;
+	ws_unlockMutex(ab->mut);
+}
+
+/**
+ * @brief Creates an atomic bool.
+ * @param b Initial value held by the bool.
+ * @return NULL if it couldn't be created, pointer to the object otherwise.
+ */
+ws_atomic_bool_t* ws_createAtomicBool(bool b) {
+	ws_atomic_bool_t* ab = (ws_atomic_bool_t*) malloc(sizeof(ws_atomic_bool_t));
+	if (ab == NULL) return NULL;
+	ab->b = b;
+	ab->mut = ws_createMutex();
+	if (!ab->mut) {
+		free(ab);
+		return NULL;
+	}
+	return ab;
+}
+
+/**
+ * @brief Destroys the provided atomic bool.
+ * @param ab Atomic bool to destroy.
+ */
+void ws_destroyAtomicBool(ws_atomic_bool_t* ab) {
+	if (!ab) return;
+	// ws_destroyMutex locks it first, so anything still using the bool finishes.
+	ws_destroyMutex(ab->mut);
+	free(ab);
+}
+
+#endif // WS_ATOMICS_MUTEX
+
+#elif !defined(CUSTOM_WS_SETUP)
+#ifndef _WIN32
+#include <time.h>
+#endif // _WIN32
+/**
+ * @brief Sleep function wrapper.
+ * @param ms Sleep time in milliseconds.
+ */
+void ws_sleep(size_t ms) {
+#ifdef _WIN32
+	Sleep((DWORD) ms);
+#else
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000; // Convert remaining milliseconds to nanoseconds
+
+	nanosleep(&ts, NULL);
+#endif // _WIN32
+}
+#endif // THREADED_SUPPORT
+
+/*
+ * Internal atomics on unsigned long long, used for the library's own counters.
+ * Compilers without GCC style builtins or the Interlocked functions fall back to the shared atomics mutex.
+ */
+#if defined(THREADED_SUPPORT) && (defined(__GNUC__) || defined(__clang__))
+#define WS_ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define WS_ATOMIC_ADD(p, v) __atomic_fetch_add((p), (v), __ATOMIC_ACQ_REL)
+#define WS_ATOMIC_EXCHANGE(p, v) __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#define WS_ATOMIC_FENCE() __atomic_thread_fence(__ATOMIC_ACQ_REL)
+#elif defined(THREADED_SUPPORT) && defined(_MSC_VER)
+#define WS_ATOMIC_LOAD(p) ((unsigned long long) InterlockedOr64((volatile LONG64*) (p), 0))
+#define WS_ATOMIC_ADD(p, v) ((unsigned long long) InterlockedExchangeAdd64((volatile LONG64*) (p), (LONG64) (v)))
+#define WS_ATOMIC_EXCHANGE(p, v) ((unsigned long long) InterlockedExchange64((volatile LONG64*) (p), (LONG64) (v)))
+#define WS_ATOMIC_FENCE() MemoryBarrier()
+#else
+#ifdef THREADED_SUPPORT
+#define LOCK_INTERNAL_ATOMICS LOCK_ATOMICS
+#define UNLOCK_INTERNAL_ATOMICS UNLOCK_ATOMICS
+#else
+#define LOCK_INTERNAL_ATOMICS
+#define UNLOCK_INTERNAL_ATOMICS
+#endif // THREADED_SUPPORT
+#define WS_INTERNAL_ATOMICS_LOCKED
+#define WS_ATOMIC_LOAD(p) ws_internal_fetchAdd((p), 0)
+#define WS_ATOMIC_ADD(p, v) ws_internal_fetchAdd((p), (v))
+#define WS_ATOMIC_EXCHANGE(p, v) ws_internal_exchange((p), (v))
+#define WS_ATOMIC_FENCE()
+unsigned long long ws_internal_fetchAdd(volatile unsigned long long* p, unsigned long long v) {
+	LOCK_INTERNAL_ATOMICS;
+	unsigned long long old = *p;
+	*p += v;
+	UNLOCK_INTERNAL_ATOMICS;
+	return old;
+}
+
+unsigned long long ws_internal_exchange(volatile unsigned long long* p, unsigned long long v) {
+	LOCK_INTERNAL_ATOMICS;
+	unsigned long long old = *p;
+	*p = v;
+	UNLOCK_INTERNAL_ATOMICS;
+	return old;
+}
+#endif
+
+/**
+ * @internal
+ * @brief Atomic compare and swap. If *p is *expected, it's set to desired. Otherwise, *expected is set to *p.
+ * @return True if *p was set to desired.
+ */
+bool ws_internal_atomicCas(volatile unsigned long long* p, unsigned long long* expected, unsigned long long desired) {
+#if defined(WS_INTERNAL_ATOMICS_LOCKED)
+	LOCK_INTERNAL_ATOMICS;
+	bool swapped = *p == *expected;
+	if (swapped) *p = desired;
+	else *expected = *p;
+	UNLOCK_INTERNAL_ATOMICS;
+	return swapped;
+#elif defined(_MSC_VER)
+	LONG64 old = InterlockedCompareExchange64((volatile LONG64*) p, (LONG64) desired, (LONG64) *expected);
+	if ((unsigned long long) old == *expected) return true;
+	*expected = (unsigned long long) old;
+	return false;
+#else
+	return __atomic_compare_exchange_n(p, expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// Thread Pool
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+#if defined(THREADED_SUPPORT) && !defined(NO_WS_THREAD_POOL)
+// Tasks each worker can hold before new ones go to the shared queue. Must be a power of 2.
+#ifndef WS_THREAD_POOL_DEQUE_SIZE
+#define WS_THREAD_POOL_DEQUE_SIZE 1024
+#endif // WS_THREAD_POOL_DEQUE_SIZE
+
+// How many times an idle thread yields before it goes to sleep until there's more work.
+#ifndef WS_THREAD_POOL_SPIN
+#define WS_THREAD_POOL_SPIN 64
+#endif // WS_THREAD_POOL_SPIN
+
+typedef struct ws_task {
+	ws_task_func_t func;
+	void* arg;
+	struct ws_task* next; // Only used by the shared queue.
+} ws_task_t;
+
+/*
+ * Chase-Lev work-stealing deque. Only the owning worker pushes and pops, at the bottom.
+ * Any other thread can steal from the top. All of it is lock free.
+ */
+typedef struct {
+	ws_atomic_int_t top;
+	ws_atomic_int_t bottom;
+	ws_atomic_ptr_t tasks[WS_THREAD_POOL_DEQUE_SIZE];
+} ws_task_deque_t;
+
+typedef struct {
+	ws_threadpool_t* pool;
+	ws_thread_t thread;
+	size_t index;
+	ws_task_deque_t deque;
+} ws_pool_worker_t;
+
+struct ws_threadpool {
+	ws_pool_worker_t* workers;
+	size_t worker_count;
+	ws_mutex_t* queue_mutex; // Guards the shared queue, which takes tasks submitted from outside the pool.
+	ws_task_t* queue_head;
+	ws_task_t* queue_tail;
+	ws_cond_t* wake;          // Idle threads sleep on this, with queue_mutex.
+	ws_atomic_int_t sleepers; // Threads sleeping on wake, so nobody has to take the mutex when there are none.
+	ws_atomic_int_t queued;   // Tasks in the shared queue, so it can be checked without the mutex.
+	ws_atomic_int_t pending;  // Tasks submitted but not finished yet.
+	ws_atomic_int_t stopping;
+};
+
+ws_atomic_ptr_t default_pool = WS_ATOMIC_INIT(NULL);
+
+// The worker the calling thread is, if it belongs to a pool.
+WS_THREAD_LOCAL ws_pool_worker_t* pool_worker = NULL;
+WS_THREAD_LOCAL unsigned int steal_seed = 0;
+
+/**
+ * @internal
+ * @brief Pushes a task onto the bottom of a deque. Only the owning worker can call this.
+ * @return false if the deque is full.
+ */
+bool ws_internal_pushTask(ws_task_deque_t* deque, ws_task_t* task) {
+	long b = ws_getAtomicInt(&deque->bottom);
+	long t = ws_getAtomicInt(&deque->top);
+	if (b - t >= WS_THREAD_POOL_DEQUE_SIZE) return false;
+	ws_setAtomicPtr(&deque->tasks[b & (WS_THREAD_POOL_DEQUE_SIZE - 1)], task);
+	ws_setAtomicInt(&deque->bottom, b + 1);
+	return true;
+}
+
+/**
+ * @internal
+ * @brief Pops the newest task off the bottom of a deque. Only the owning worker can call this.
+ */
+ws_task_t* ws_internal_popTask(ws_task_deque_t* deque) {
+	long b = ws_getAtomicInt(&deque->bottom) - 1;
+	ws_setAtomicInt(&deque->bottom, b);
+	long t = ws_getAtomicInt(&deque->top);
+	if (t > b) {
+		// Empty.
+		ws_setAtomicInt(&deque->bottom, b + 1);
+		return NULL;
+	}
+	ws_task_t* task = ws_getAtomicPtr(&deque->tasks[b & (WS_THREAD_POOL_DEQUE_SIZE - 1)]);
+	if (t == b) {
+		// Last task, a thief might be taking it too. Whoever moves top gets it.
+		if (!ws_compareExchangeAtomicInt(&deque->top, &t, t + 1)) task = NULL;
+		ws_setAtomicInt(&deque->bottom, b + 1);
+	}
+	return task;
+}
+
+/**
+ * @internal
+ * @brief Steals the oldest task off the top of a deque. Any thread can call this.
+ */
+ws_task_t* ws_internal_stealTask(ws_task_deque_t* deque) {
+	long t = ws_getAtomicInt(&deque->top);
+	long b = ws_getAtomicInt(&deque->bottom);
+	if (t >= b) return NULL;
+	ws_task_t* task = ws_getAtomicPtr(&deque->tasks[t & (WS_THREAD_POOL_DEQUE_SIZE - 1)]);
+	// Lost the race to the owner or another thief.
+	if (!ws_compareExchangeAtomicInt(&deque->top, &t, t + 1)) return NULL;
+	return task;
+}
+
+/**
+ * @internal
+ * @brief Takes the oldest task out of the pool's shared queue.
+ */
+ws_task_t* ws_internal_takeQueuedTask(ws_threadpool_t* pool) {
+	if (ws_getAtomicInt(&pool->queued) == 0) return NULL;
+	ws_lockMutex(pool->queue_mutex);
+	ws_task_t* task = pool->queue_head;
+	if (task) {
+		pool->queue_head = task->next;
+		if (!pool->queue_head) pool->queue_tail = NULL;
+		ws_addAtomicInt(&pool->queued, -1);
+	}
+	ws_unlockMutex(pool->queue_mutex);
+	return task;
+}
+
+/**
+ * @internal
+ * @brief Finds something to run: the caller's own deque first, then the shared queue, then another worker's deque.
+ * @param self The calling worker, or NULL if the caller isn't one of the pool's workers.
+ */
+ws_task_t* ws_internal_findTask(ws_threadpool_t* pool, ws_pool_worker_t* self) {
+	ws_task_t* task = NULL;
+	if (self) task = ws_internal_popTask(&self->deque);
+	if (!task) task = ws_internal_takeQueuedTask(pool);
+	if (!task) {
+		// Start from a random worker, so thieves don't all pile onto the first one.
+		steal_seed = steal_seed * 1103515245u + 12345u;
+		size_t start = (steal_seed >> 16) % pool->worker_count;
+		for (size_t i = 0; i < pool->worker_count && !task; i++) {
+			ws_pool_worker_t* victim = &pool->workers[(start + i) % pool->worker_count];
+			if (victim != self) task = ws_internal_stealTask(&victim->deque);
+		}
+	}
+	return task;
+}
+
+/**
+ * @internal
+ * @brief Wakes every sleeping thread, so they can check for work or whatever they're waiting on.
+ */
+void ws_internal_wakePool(ws_threadpool_t* pool) {
+	if (ws_getAtomicInt(&pool->sleepers) == 0) return;
+	ws_lockMutex(pool->queue_mutex);
+	ws_broadcastCond(pool->wake);
+	ws_unlockMutex(pool->queue_mutex);
+}
+
+/**
+ * @internal
+ * @brief True if there's a task anywhere in the pool.
+ */
+bool ws_internal_poolHasWork(ws_threadpool_t* pool) {
+	if (ws_getAtomicInt(&pool->queued) != 0) return true;
+	for (size_t i = 0; i < pool->worker_count; i++) {
+		ws_task_deque_t* deque = &pool->workers[i].deque;
+		if (ws_getAtomicInt(&deque->bottom) > ws_getAtomicInt(&deque->top)) return true;
+	}
+	return false;
+}
+
+/**
+ * @internal
+ * @brief Runs a task, then frees it.
+ */
+void ws_internal_runTask(ws_threadpool_t* pool, ws_task_t* task) {
+	task->func(task->arg);
+	free(task);
+	// Last one out wakes anyone in ws_waitThreadPool.
+	if (ws_addAtomicInt(&pool->pending, -1) == 1) ws_internal_wakePool(pool);
+}
+
+/**
+ * @internal
+ * @brief Waits for something to show up. Yields for a while, then sleeps until it's woken.
+ * @param done Checked before sleeping, so a wake for it isn't missed. Can be NULL.
+ */
+void ws_internal_poolIdle(ws_threadpool_t* pool, unsigned int* idle, bool (*done)(void* arg), void* arg) {
+	if (*idle < WS_THREAD_POOL_SPIN) {
+		(*idle)++;
+		ws_sleep(0);
+		return;
+	}
+	ws_lockMutex(pool->queue_mutex);
+	ws_addAtomicInt(&pool->sleepers, 1);
+	// Checked again now that we're counted as a sleeper. Anything that changes from here on wakes us.
+	if (!ws_internal_poolHasWork(pool) && !ws_getAtomicInt(&pool->stopping) && !(done && done(arg))) {
+		ws_waitCond(pool->wake, pool->queue_mutex, WS_WAIT_FOREVER);
+	}
+	ws_addAtomicInt(&pool->sleepers, -1);
+	ws_unlockMutex(pool->queue_mutex);
+}
+
+/**
+ * @internal
+ * @brief Main loop for each of the pool's threads.
+ */
+void ws_internal_poolWorker(void* arg) {
+	ws_pool_worker_t* self = (ws_pool_worker_t*) arg;
+	ws_threadpool_t* pool = self->pool;
+	pool_worker = self;
+	steal_seed = (unsigned int) self->index + 1;
+	unsigned int idle = 0;
+	while (!ws_getAtomicInt(&pool->stopping)) {
+		ws_task_t* task = ws_internal_findTask(pool, self);
+		if (task) {
+			ws_internal_runTask(pool, task);
+			idle = 0;
+		} else {
+			ws_internal_poolIdle(pool, &idle, NULL, NULL);
+		}
+	}
+	pool_worker = NULL;
+}
+
+/**
+ * @brief Creates a thread pool.
+ * @param threads Number of threads to start. 0 starts one per core.
+ * @return The pool, or NULL if it couldn't be created.
+ */
+ws_threadpool_t* ws_createThreadPool(size_t threads) {
+	if (threads == 0) threads = ws_getCoreCount();
+	ws_threadpool_t* pool = (ws_threadpool_t*) calloc(1, sizeof(ws_threadpool_t));
+	if (!pool) return NULL;
+	pool->workers = (ws_pool_worker_t*) calloc(threads, sizeof(ws_pool_worker_t));
+	pool->queue_mutex = ws_createMutex();
+	pool->wake = ws_createCond();
+	if (!pool->workers || !pool->queue_mutex || !pool->wake) {
+		if (pool->queue_mutex) ws_destroyMutex(pool->queue_mutex);
+		if (pool->wake) ws_destroyCond(pool->wake);
+		free(pool->workers);
+		free(pool);
+		return NULL;
+	}
+	ws_initAtomicInt(&pool->sleepers, 0);
+	ws_initAtomicInt(&pool->queued, 0);
+	ws_initAtomicInt(&pool->pending, 0);
+	ws_initAtomicInt(&pool->stopping, 0);
+	pool->worker_count = threads;
+	for (size_t i = 0; i < threads; i++) {
+		ws_pool_worker_t* worker = &pool->workers[i];
+		worker->pool = pool;
+		worker->index = i;
+		ws_initAtomicInt(&worker->deque.top, 0);
+		ws_initAtomicInt(&worker->deque.bottom, 0);
+		for (size_t j = 0; j < WS_THREAD_POOL_DEQUE_SIZE; j++) ws_initAtomicPtr(&worker->deque.tasks[j], NULL);
+	}
+
+	for (size_t i = 0; i < threads; i++) {
+		if (!ws_createThread(&pool->workers[i].thread, ws_internal_poolWorker, &pool->workers[i])) {
+			// Stop the ones that did start. Their deques are all empty, so nothing is lost.
+			ws_setAtomicInt(&pool->stopping, 1);
+			ws_internal_wakePool(pool);
+			for (size_t j = 0; j < i; j++) ws_joinThread(pool->workers[j].thread);
+			ws_destroyCond(pool->wake);
+			ws_destroyMutex(pool->queue_mutex);
+			free(pool->workers);
+			free(pool);
+			return NULL;
+		}
+	}
+	return pool;
+}
+
+/**
+ * @brief Finishes every task in the pool, then stops its threads and frees it.
+ * @param pool Pool to destroy. Must not be called from one of its own tasks.
+ */
+void ws_destroyThreadPool(ws_threadpool_t* pool) {
+	if (!pool) return;
+	ws_waitThreadPool(pool);
+	ws_setAtomicInt(&pool->stopping, 1);
+	ws_internal_wakePool(pool);
+	for (size_t i = 0; i < pool->worker_count; i++) ws_joinThread(pool->workers[i].thread);
+	ws_destroyCond(pool->wake);
+	ws_destroyMutex(pool->queue_mutex);
+	free(pool->workers);
+	free(pool);
+}
+
+/**
+ * @brief Gets the shared pool, with one thread per core. It's created the first time this is called.
+ * @return The shared pool, or NULL if it couldn't be created.
+ */
+ws_threadpool_t* ws_getDefaultThreadPool() {
+	ws_threadpool_t* pool = (ws_threadpool_t*) ws_getAtomicPtr(&default_pool);
+	if (pool) return pool;
+	ws_threadpool_t* created = ws_createThreadPool(0);
+	if (!created) return NULL;
+	void* expected = NULL;
+	if (ws_compareExchangeAtomicPtr(&default_pool, &expected, created)) return created;
+	// Another thread made one first.
+	ws_destroyThreadPool(created);
+	return (ws_threadpool_t*) expected;
+}
+
+/**
+ * @brief Queues a task to run on the pool.
+ *
+ * Tasks submitted from one of the pool's own threads go on that thread's deque, where idle threads can steal them.
+ *
+ * @param pool Pool to run it on. NULL uses the shared pool.
+ * @param func Function to run.
+ * @param arg Argument passed to func.
+ * @return WS_OUT_OF_MEMORY if the task (or the shared pool) couldn't be allocated.
+ */
+ws_error_t ws_submitTask(ws_threadpool_t* pool, ws_task_func_t func, void* arg) {
+	if (!func) return WS_NO_ERROR;
+	if (!pool) pool = ws_getDefaultThreadPool();
+	if (!pool) return WS_OUT_OF_MEMORY;
+	ws_task_t* task = (ws_task_t*) malloc(sizeof(ws_task_t));
+	if (!task) return WS_OUT_OF_MEMORY;
+	task->func = func;
+	task->arg = arg;
+	task->next = NULL;
+	ws_addAtomicInt(&pool->pending, 1);
+
+	if (pool_worker && pool_worker->pool == pool && ws_internal_pushTask(&pool_worker->deque, task)) {
+		ws_internal_wakePool(pool);
+		return WS_NO_ERROR;
+	}
+
+	ws_lockMutex(pool->queue_mutex);
+	if (pool->queue_tail) pool->queue_tail->next = task;
+	else pool->queue_head = task;
+	pool->queue_tail = task;
+	ws_addAtomicInt(&pool->queued, 1);
+	if (ws_getAtomicInt(&pool->sleepers) != 0) ws_broadcastCond(pool->wake);
+	ws_unlockMutex(pool->queue_mutex);
+	return WS_NO_ERROR;
+}
+
+/**
+ * @internal
+ * @brief Runs the pool's tasks on the calling thread until done returns true.
+ */
+void ws_internal_helpPool(ws_threadpool_t* pool, bool (*done)(void* arg), void* arg) {
+	ws_pool_worker_t* self = pool_worker && pool_worker->pool == pool ? pool_worker : NULL;
+	unsigned int idle = 0;
+	while (!done(arg)) {
+		ws_task_t* task = ws_internal_findTask(pool, self);
+		if (task) {
+			ws_internal_runTask(pool, task);
+			idle = 0;
+		} else {
+			ws_internal_poolIdle(pool, &idle, done, arg);
+		}
+	}
+}
+
+/**
+ * @internal
+ * @brief True once a pool has nothing left to run.
+ */
+bool ws_internal_poolDone(void* arg) {
+	return ws_getAtomicInt(&((ws_threadpool_t*) arg)->pending) == 0;
+}
+
+/**
+ * @brief Waits until every task submitted to the pool has finished. The calling thread helps run them.
+ * @param pool Pool to wait on. NULL waits on the shared pool. Must not be called from one of the pool's own tasks.
+ */
+void ws_waitThreadPool(ws_threadpool_t* pool) {
+	if (!pool) pool = (ws_threadpool_t*) ws_getAtomicPtr(&default_pool);
+	if (!pool) return;
+	ws_internal_helpPool(pool, ws_internal_poolDone, pool);
+}
+
+/* Shared state for one ws_parallelFor call. Freed by whoever drops the last reference. */
+typedef struct {
+	ws_threadpool_t* pool;
+	ws_parallel_for_func_t func;
+	void* arg;
+	size_t count;
+	size_t grain;
+	long chunks;
+	ws_atomic_int_t next_chunk;
+	ws_atomic_int_t remaining; // Chunks that haven't finished yet.
+	ws_atomic_int_t refs;      // The caller, plus every helper task that hasn't finished.
+} ws_parallel_for_t;
+
+/**
+ * @internal
+ * @brief Claims and runs chunks until there are none left.
+ */
+void ws_internal_runChunks(ws_parallel_for_t* job) {
+	for (;;) {
+		long chunk = ws_addAtomicInt(&job->next_chunk, 1);
+		if (chunk >= job->chunks) return;
+		size_t begin = (size_t) chunk * job->grain;
+		size_t end = begin + job->grain < job->count ? begin + job->grain : job->count;
+		job->func(begin, end, job->arg);
+		// Last chunk wakes the caller, if it's asleep waiting for it.
+		if (ws_addAtomicInt(&job->remaining, -1) == 1) ws_internal_wakePool(job->pool);
+	}
+}
+
+/**
+ * @internal
+ * @brief Drops a reference to a parallel for, freeing it if it was the last one.
+ */
+void ws_internal_releaseParallelFor(ws_parallel_for_t* job) {
+	if (ws_addAtomicInt(&job->refs, -1) == 1) free(job);
+}
+
+/**
+ * @internal
+ * @brief Task run by the pool to help with a parallel for.
+ */
+void ws_internal_parallelForTask(void* arg) {
+	ws_parallel_for_t* job = (ws_parallel_for_t*) arg;
+	ws_internal_runChunks(job);
+	ws_internal_releaseParallelFor(job);
+}
+
+/**
+ * @internal
+ * @brief True once every chunk of a parallel for has finished.
+ */
+bool ws_internal_parallelForDone(void* arg) {
+	return ws_getAtomicInt(&((ws_parallel_for_t*) arg)->remaining) == 0;
+}
+
+/**
+ * @brief Splits [0, count) into chunks and runs them across the pool. Returns once every chunk has finished.
+ *
+ * The calling thread runs chunks too, so this is safe to call from inside a task, including nested calls.
+ *
+ * @param pool Pool to run on. NULL uses the shared pool.
+ * @param count Size of the range.
+ * @param grain Size of each chunk. 0 picks one that gives each thread a few chunks.
+ * @param func Called with each chunk, from any of the pool's threads or the calling thread.
+ * @param arg Argument passed to func.
+ * @return WS_OUT_OF_MEMORY if it couldn't be started. Nothing was run in that case.
+ */
+ws_error_t ws_parallelFor(ws_threadpool_t* pool, size_t count, size_t grain, ws_parallel_for_func_t func, void* arg) {
+	if (!func || count == 0) return WS_NO_ERROR;
+	if (!pool) pool = ws_getDefaultThreadPool();
+	if (!pool) return WS_OUT_OF_MEMORY;
+	if (grain == 0) {
+		// A few chunks per thread, so threads that finish early can take some of the slower ones.
+		grain = count / ((pool->worker_count + 1) * 4);
+		if (grain == 0) grain = 1;
+	}
+	size_t chunks = (count + grain - 1) / grain;
+	if (chunks == 1) {
+		func(0, count, arg);
+		return WS_NO_ERROR;
+	}
+
+	ws_parallel_for_t* job = (ws_parallel_for_t*) malloc(sizeof(ws_parallel_for_t));
+	if (!job) return WS_OUT_OF_MEMORY;
+	job->pool = pool;
+	job->func = func;
+	job->arg = arg;
+	job->count = count;
+	job->grain = grain;
+	job->chunks = (long) chunks;
+	ws_initAtomicInt(&job->next_chunk, 0);
+	ws_initAtomicInt(&job->remaining, (long) chunks);
+	ws_initAtomicInt(&job->refs, 1);
+
+	// One helper per thread at most. If some can't be submitted, the rest (and the caller) pick up the slack.
+	size_t helpers = chunks - 1 < pool->worker_count ? chunks - 1 : pool->worker_count;
+	for (size_t i = 0; i < helpers; i++) {
+		ws_addAtomicInt(&job->refs, 1);
+		if (ws_submitTask(pool, ws_internal_parallelForTask, job) != WS_NO_ERROR) {
+			ws_addAtomicInt(&job->refs, -1);
+			break;
+		}
+	}
+
+	ws_internal_runChunks(job);
+	// Chunks other threads claimed might still be running. Help with the pool's other work until they finish.
+	ws_internal_helpPool(pool, ws_internal_parallelForDone, job);
+	ws_internal_releaseParallelFor(job);
+	return WS_NO_ERROR;
+}
+
+/**
+ * @internal
+ * @brief Destroys the shared pool, if it was created.
+ */
+void ws_internal_cleanThreadPool() {
+	ws_destroyThreadPool((ws_threadpool_t*) ws_exchangeAtomicPtr(&default_pool, NULL));
+}
+#endif // THREADED_SUPPORT && !NO_WS_THREAD_POOL
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// Logging Functions
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+#ifndef NO_WS_LOGGING
+#ifndef WS_LOG_BUFFER_SIZE
+#define WS_LOG_BUFFER_SIZE 512
+#endif // WS_LOG_BUFFER_SIZE
+
+#ifndef WS_THREAD_NAME_SIZE
+#define WS_THREAD_NAME_SIZE 32
+#endif // WS_THREAD_NAME_SIZE
+
+/*
+ * Cheap monotonic clock in nanoseconds, for things like rate limiting that run on every log call.
+ * A coarse clock is preferred, it's read without a syscall and a few milliseconds of resolution is plenty.
+ * Define WS_LOG_CLOCK() in wallshell_config.h to provide your own.
+ */
+#ifndef WS_LOG_CLOCK
+#ifdef _WIN32
+#define WS_LOG_CLOCK() ((unsigned long long) GetTickCount64() * 1000000ULL)
+#else
+#include <time.h>
+#ifdef CLOCK_MONOTONIC_COARSE
+#define WS_LOG_CLOCK_ID CLOCK_MONOTONIC_COARSE
+#else
+#define WS_LOG_CLOCK_ID CLOCK_MONOTONIC
+#endif // CLOCK_MONOTONIC_COARSE
+#define WS_LOG_CLOCK() ws_internal_logClock()
+/**
+ * @internal
+ * @brief Reads the coarse monotonic clock.
+ * @return Time in nanoseconds.
+ */
+unsigned long long ws_internal_logClock() {
+	struct timespec ts;
+	clock_gettime(WS_LOG_CLOCK_ID, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec;
+}
+#endif // _WIN32
+#endif // WS_LOG_CLOCK
+
+/*
+ * Per thread logging state. Everything the logger needs to label and format a record lives here,
+ * so the hot path never has to take a global lock.
+ */
+typedef struct {
+#ifdef THREADED_SUPPORT
+	char tag[WS_THREAD_NAME_SIZE + 3]; // "[name]", ready to be copied into a record.
+	size_t tag_len;
+	unsigned long long generation;     // Value of thread_names_generation that tag was built from.
+	bool initialized;
+#endif // THREADED_SUPPORT
+	unsigned long long ts_second;      // Second that ts_text was built for.
+	char ts_text[16];                  // "HH:MM:SS.", ready to be copied into a record.
+	char buf[WS_LOG_BUFFER_SIZE];      // Records are formatted here, then written out.
+} ws_log_context_t;
+
+WS_THREAD_LOCAL ws_log_context_t log_context;
+
+#ifdef THREADED_SUPPORT
+// Created on first use, the same way as the color mutex.
+ws_atomic_ptr_t logging_mutex = WS_ATOMIC_INIT(NULL);
+#define LOCK_LOGGING_MUTEX ws_lockMutex((ws_mutex_t*) ws_getAtomicPtr(&logging_mutex))
+#define UNLOCK_LOGGING_MUTEX ws_unlockMutex((ws_mutex_t*) ws_getAtomicPtr(&logging_mutex))
+
+/*
+ * Thread names are still kept in a shared map, since ws_removeThreadName can be called from any thread.
+ * The map is only touched when a name changes. Every change bumps thread_names_generation,
+ * which tells each thread to rebuild its tag the next time it logs.
+ */
+typedef struct {
+	char name[WS_THREAD_NAME_SIZE];
+	ws_thread_id_t id;
+} ws_thread_map_t;
+
+ws_thread_map_t* thread_map = NULL;
+size_t thread_map_size = 0;
+size_t thread_map_current = 0;
+volatile unsigned long long thread_names_generation = 1;
+
+ws_mutex_t* thread_map_mut = NULL;
+
+/**
+ * @internal
+ * @brief Makes sure the thread map mutex exists.
+ * @return False if it couldn't be created.
+ */
+bool ws_internal_threadMapCheck() {
+	if (!thread_map_mut) thread_map_mut = ws_createMutex();
+	return thread_map_mut != NULL;
+}
+
+/**
+ * @brief Sets the name of the calling thread. This will only be printed if threadID is true.
+ *
+ * Names longer than WS_THREAD_NAME_SIZE - 1 characters are cut short.
+ * Calling this again from the same thread replaces its name.
+ *
+ * @param name Name of the thread.
+ */
+void ws_setThreadName(char* name) {
+	if (!name || !ws_internal_threadMapCheck()) return;
+	ws_lockMutex(thread_map_mut);
+	ws_thread_id_t id = ws_getThreadID();
+
+	size_t idx = thread_map_current;
+	for (size_t i = 0; i < thread_map_current; i++) {
+		if (thread_map[i].id == id) {
+			idx = i;
+			break;
+		}
+	}
+
+	if (idx == thread_map_current) {
+		if (thread_map_current >= thread_map_size) {
+			size_t new_size = thread_map_size ? thread_map_size * 2 : 4;
+			ws_thread_map_t* temp = realloc(thread_map, new_size * sizeof(ws_thread_map_t));
+			if (!temp) {
+				ws_unlockMutex(thread_map_mut);
+				return;
+			}
+			thread_map = temp;
+			thread_map_size = new_size;
+		}
+		thread_map_current++;
+	}
+	snprintf(thread_map[idx].name, WS_THREAD_NAME_SIZE, "%s", name);
+	thread_map[idx].id = id;
+	WS_ATOMIC_ADD(&thread_names_generation, 1);
+	ws_unlockMutex(thread_map_mut);
+}
+
+/**
+ * @brief Removes the name of the provided thread.
+ * @param name Name of the thread.
+ */
+void ws_removeThreadName(const char* name) {
+	if (!name || !ws_internal_threadMapCheck()) return;
+	ws_lockMutex(thread_map_mut);
+
+	for (size_t i = 0; i < thread_map_current; i++) {
+		if (strncmp(thread_map[i].name, name, WS_THREAD_NAME_SIZE - 1) == 0) {
+			for (size_t j = i; j + 1 < thread_map_current; j++) {
+				thread_map[j] = thread_map[j + 1];
+			}
+			thread_map_current--;
+			WS_ATOMIC_ADD(&thread_names_generation, 1);
+			break;
+		}
+	}
+
+	ws_unlockMutex(thread_map_mut);
+}
+
+/**
+ * @internal
+ * @brief Gets the tag ("[name]" or "[id]") of the calling thread, rebuilding it if any thread names changed.
+ *
+ * In the common case this is a single comparison against thread_names_generation.
+ *
+ * @return The context of the calling thread, with an up to date tag.
+ */
+ws_log_context_t* ws_internal_logContext() {
+	ws_log_context_t* ctx = &log_context;
+	unsigned long long generation = WS_ATOMIC_LOAD(&thread_names_generation);
+	if (ctx->initialized && ctx->generation == generation) return ctx;
+
+	ws_thread_id_t id = ws_getThreadID();
+	const char* name = NULL;
+	if (ws_internal_threadMapCheck()) {
+		ws_lockMutex(thread_map_mut);
+		generation = WS_ATOMIC_LOAD(&thread_names_generation);
+		for (size_t i = 0; i < thread_map_current; i++) {
+			if (thread_map[i].id == id) {
+				name = thread_map[i].name;
+				break;
+			}
+		}
+		if (name) snprintf(ctx->tag, sizeof(ctx->tag), "[%s]", name);
+		ws_unlockMutex(thread_map_mut);
+	}
+	if (!name) snprintf(ctx->tag, sizeof(ctx->tag), "[%llu]", (unsigned long long) id);
+	ctx->tag_len = strlen(ctx->tag);
+	ctx->generation = generation;
+	ctx->initialized = true;
+	return ctx;
+}
+
+/**
+ * @brief Prints the threadID of the calling thread.
+ */
+void ws_printThreadID() {
+	ws_log_context_t* ctx = ws_internal_logContext();
+	// The tag has brackets around it for the logger, they aren't wanted here.
+	fprintf(ws_out_stream, "%.*s", (int) ctx->tag_len - 2, ctx->tag + 1);
+}
+
+bool printThreadID = true;
+/**
+ * @brief Set print threadID, which prints the threadID of function calling `ws_logger`. Defaults to on.
+ * @param b True to turn on, false to turn off.
+ */
+void ws_doPrintThreadID(bool b) { printThreadID = b; }
+#else
+#define LOCK_LOGGING_MUTEX
+#define UNLOCK_LOGGING_MUTEX
+#endif
+
+/*
+ * Timestamps are wall clock time, but they're read from the cheap monotonic clock and offset by a wall clock
+ * base taken once, when timestamps are turned on. The "HH:MM:SS." part is cached per thread and only rebuilt
+ * when the second changes, so most records just add the milliseconds.
+ */
+#include <time.h>
+#ifndef WS_LOG_WALL_CLOCK
+#define WS_LOG_WALL_CLOCK() ws_internal_wallClock()
+/**
+ * @internal
+ * @brief Reads the wall clock. Only called when timestamps are turned on.
+ * @return Nanoseconds since the Unix epoch.
+ */
+unsigned long long ws_internal_wallClock() {
+#ifdef _WIN32
+	FILETIME ft;
+	GetSystemTimeAsFileTime(&ft);
+	unsigned long long t = ((unsigned long long) ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+	// FILETIME counts 100ns intervals since 1601.
+	return (t - 116444736000000000ULL) * 100ULL;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec;
+#endif // _WIN32
+}
+#endif // WS_LOG_WALL_CLOCK
+
+bool printTimestamp = false;
+unsigned long long log_wall_base = 0;
+unsigned long long log_clock_base = 0;
+
+/**
+ * @brief Set print timestamp, which prefixes each log record with the time it was logged (HH:MM:SS.mmm). Defaults to off.
+ * @param b True to turn on, false to turn off.
+ */
+void ws_doPrintTimestamp(bool b) {
+	if (b && !printTimestamp) {
+		log_clock_base = WS_LOG_CLOCK();
+		log_wall_base = WS_LOG_WALL_CLOCK();
+	}
+	printTimestamp = b;
+}
+
+/**
+ * @internal
+ * @brief Gets the timestamp for a new record.
+ * @return Nanoseconds since the Unix epoch, or 0 if timestamps are off.
+ */
+unsigned long long ws_internal_logTimestamp() {
+	if (!printTimestamp) return 0;
+	return log_wall_base + (WS_LOG_CLOCK() - log_clock_base);
+}
+
+/**
+ * @internal
+ * @brief Writes "HH:MM:SS.mmm " into the provided buffer.
+ * @param out Buffer of at least 13 bytes.
+ * @param timestamp Nanoseconds since the Unix epoch.
+ */
+void ws_internal_formatTimestamp(char* out, unsigned long long timestamp) {
+	ws_log_context_t* ctx = &log_context;
+	unsigned long long ms = timestamp / 1000000ULL;
+	unsigned long long second = ms / 1000ULL;
+	if (second != ctx->ts_second) {
+		time_t t = (time_t) second;
+		struct tm tm;
+#ifdef _WIN32
+		localtime_s(&tm, &t);
+#else
+		localtime_r(&t, &tm);
+#endif // _WIN32
+		snprintf(ctx->ts_text, sizeof(ctx->ts_text), "%02d:%02d:%02d.", tm.tm_hour, tm.tm_min, tm.tm_sec);
+		ctx->ts_second = second;
+	}
+	unsigned int millis = (unsigned int) (ms % 1000ULL);
+	memcpy(out, ctx->ts_text, 9);
+	out[9] = (char) ('0' + millis / 100);
+	out[10] = (char) ('0' + millis / 10 % 10);
+	out[11] = (char) ('0' + millis % 10);
+	out[12] = ' ';
+}
+
+/**
+ * @internal
+ * @brief Checks the logging mutex and makes sure the output stream is set.
+ */
+void ws_internal_logging_check() {
+#ifdef THREADED_SUPPORT
+	if (!ws_getAtomicPtr(&logging_mutex)) {
+		ws_mutex_t* created = ws_createMutex(); // We don't really care if it's NULL.
+		void* expected = NULL;
+		if (created && !ws_compareExchangeAtomicPtr(&logging_mutex, &expected, created)) ws_destroyMutex(created);
+	}
+#endif // THREADED_SUPPORT
+	// Make sure we have an out stream.
+	if (!ws_out_stream) ws_setStream(WS_OUTPUT, stdout);
+}
+
+#define LOGGING_CHECK ws_internal_logging_check()
+
+ws_color_t log_colors = { WS_FG_WHITE, WS_BG_DEFAULT };
+ws_color_t debug_colors = { WS_FG_BRIGHT_GREEN, WS_BG_DEFAULT };
+ws_color_t info_colors = { WS_FG_BRIGHT_CYAN, WS_BG_DEFAULT };
+ws_color_t warn_colors = { WS_FG_BRIGHT_YELLOW, WS_BG_DEFAULT };
+ws_color_t error_colors = { WS_FG_BRIGHT_RED, WS_BG_DEFAULT };
+ws_color_t fatal_colors = { WS_FG_RED, WS_BG_DEFAULT };
+
+// Tags are padded so that messages line up regardless of type.
+const char* log_tags[] = { "[LOG]  ", "[DEBUG]", "[INFO] ", "[WARN] ", "[ERROR]", "[FATAL]" };
+
+/**
+ * @internal
+ * @brief Gets the colors used for the provided log type.
+ *
+ * @param type Type of logging.
+ * @return Pointer to the colors for that type.
+ */
+ws_color_t* ws_internal_logColors(ws_logtype_t type) {
+	switch (type) {
+		case WS_DEBUG: return &debug_colors;
+		case WS_INFO: return &info_colors;
+		case WS_WARN: return &warn_colors;
+		case WS_ERROR: return &error_colors;
+		case WS_FATAL: return &fatal_colors;
+		case WS_LOG:
+		default: return &log_colors;
+	}
+}
+
+/*
+ * Log categories. Each category is one bit, and there's one mask per log type with the bits of every
+ * category that's enabled at that type. Checking a record is a single load and AND, before anything is formatted.
+ */
+#define WS_MAX_LOG_CATEGORIES 64
+
+#ifndef WS_LOG_CATEGORY_NAME_SIZE
+#define WS_LOG_CATEGORY_NAME_SIZE 16
+#endif // WS_LOG_CATEGORY_NAME_SIZE
+
+typedef struct {
+	char name[WS_LOG_CATEGORY_NAME_SIZE];
+	char tag[WS_LOG_CATEGORY_NAME_SIZE + 3]; // "[name]", ready to be copied into a record.
+	size_t tag_len;
+	ws_logtype_t level;
+	bool enabled;
+} ws_log_category_info_t;
+
+ws_log_category_info_t log_categories[WS_MAX_LOG_CATEGORIES];
+int log_category_count = 0;
+volatile unsigned long long log_category_masks[WS_FATAL + 1];
+
+/**
+ * @internal
+ * @brief Formats a log record (timestamp, tag, thread, category and message) into the provided buffer.
+ *
+ * @param buf Buffer to write into.
+ * @param size Size of the buffer.
+ * @param header_len Set to the length of everything before the message, which is where the message starts.
+ * @param type Type of logging.
+ * @param category Category of the record, or WS_NO_LOG_CATEGORY.
+ * @param timestamp Timestamp from ws_internal_logTimestamp(). 0 leaves it out.
+ * @param format printf style formatting string.
+ * @param args va_list of arguments. It's copied, so the caller can reuse it.
+ * @return Length of the full record, even if it didn't fit. Works the same as the return of vsnprintf.
+ */
+size_t ws_internal_formatRecord(char* buf, size_t size, size_t* header_len, ws_logtype_t type, ws_log_category_t category,
+								unsigned long long timestamp, const char* format, va_list args) {
+	// The header is built in one pass without printf. Only the message goes through vsnprintf.
+	char header[13 + 8 + WS_THREAD_NAME_SIZE + 4 + WS_LOG_CATEGORY_NAME_SIZE + 3];
+	size_t len = 0;
+	if (timestamp) {
+		ws_internal_formatTimestamp(header, timestamp);
+		len += 13;
+	}
+	memcpy(header + len, log_tags[type], 7);
+	len += 7;
+#ifdef THREADED_SUPPORT
+	if (printThreadID) {
+		ws_log_context_t* ctx = ws_internal_logContext();
+		memcpy(header + len, ctx->tag, ctx->tag_len);
+		len += ctx->tag_len;
+	}
+#endif // THREADED_SUPPORT
+	if (category != WS_NO_LOG_CATEGORY) {
+		header[len++] = ' ';
+		memcpy(header + len, log_categories[category].tag, log_categories[category].tag_len);
+		len += log_categories[category].tag_len;
+	}
+	header[len++] = ' ';
+	memcpy(buf, header, len < size ? len : size);
+	*header_len = len;
+
+	va_list copy;
+	va_copy(copy, args);
+	int written = vsnprintf(buf + (len < size ? len : size), len < size ? size - len : 0, format, copy);
+	va_end(copy);
+	if (written > 0) len += (size_t) written;
+	if (size > 0 && len < size) buf[len] = '\0';
+	return len;
+}
+
+/**
+ * @internal
+ * @brief Writes a formatted record to the output stream, using the colors for its type.
+ *
+ * @param type Type of logging.
+ * @param text Formatted record, without a trailing newline.
+ */
+void ws_internal_emitRecord(ws_logtype_t type, const char* text) {
+	ws_color_t current = ws_getCurrentColors();
+	ws_setConsoleColors(*ws_internal_logColors(type));
+	fprintf(ws_out_stream, "%s\n", text);
+	ws_setConsoleColors(current);
+}
+
+#ifdef THREADED_SUPPORT
+#ifndef WS_LOG_QUEUE_LIMIT
+#define WS_LOG_QUEUE_LIMIT 1024
+#endif // WS_LOG_QUEUE_LIMIT
+
+/*
+ * While the terminal is waiting for input, nothing can write to the output stream without breaking the prompt.
+ * Records are queued here instead, and the terminal prints them above the prompt the next time it polls.
+ * Only the default session's terminal queues records, since that's where threads without a session log to.
+ * Threads using any other session write their records straight to its output stream.
+ * Everything here is protected by the logging mutex.
+ */
+typedef struct ws_log_queue_entry {
+	struct ws_log_queue_entry* next;
+	ws_logtype_t type;
+	char text[];
+} ws_log_queue_entry_t;
+
+ws_log_queue_entry_t* log_queue_head = NULL;
+ws_log_queue_entry_t* log_queue_tail = NULL;
+size_t log_queue_size = 0;
+size_t log_queue_dropped = 0;
+bool prompt_active = false;
+
+/**
+ * @internal
+ * @brief Adds a record to the log queue. Must be called with the logging mutex held.
+ */
+void ws_internal_queueRecord(ws_logtype_t type, const char* text, size_t len) {
+	if (log_queue_size >= WS_LOG_QUEUE_LIMIT) {
+		log_queue_dropped++;
+		return;
+	}
+	ws_log_queue_entry_t* entry = malloc(sizeof(ws_log_queue_entry_t) + len + 1);
+	if (!entry) {
+		log_queue_dropped++;
+		return;
+	}
+	entry->next = NULL;
+	entry->type = type;
+	memcpy(entry->text, text, len + 1);
+	if (log_queue_tail) log_queue_tail->next = entry;
+	else log_queue_head = entry;
+	log_queue_tail = entry;
+	log_queue_size++;
+	// Only the first record needs to wake the terminal, it prints everything queued at once.
+	if (log_queue_size == 1) ws_internal_wakeSession(&default_session);
+}
+
+/**
+ * @internal
+ * @brief Prints everything in the log queue. Must be called with the logging mutex held.
+ *
+ * Consecutive records of the same type share one color change.
+ */
+void ws_internal_drainLogQueue() {
+	ws_log_queue_entry_t* entry = log_queue_head;
+	log_queue_head = NULL;
+	log_queue_tail = NULL;
+	log_queue_size = 0;
+
+	ws_color_t current = ws_getCurrentColors();
+	bool first = true;
+	ws_logtype_t last_type = WS_LOG;
+	while (entry) {
+		if (first || entry->type != last_type) {
+			ws_setConsoleColors(*ws_internal_logColors(entry->type));
+			last_type = entry->type;
+			first = false;
+		}
+		fprintf(ws_out_stream, "%s\n", entry->text);
+		ws_log_queue_entry_t* next = entry->next;
+		free(entry);
+		entry = next;
+	}
+	if (log_queue_dropped > 0) {
+		ws_setConsoleColors(warn_colors);
+		fprintf(ws_out_stream, "%s %zu log records were dropped while the prompt was busy.\n", log_tags[WS_WARN], log_queue_dropped);
+		log_queue_dropped = 0;
+	}
+	ws_setConsoleColors(current);
+}
+
+/**
+ * @internal
+ * @brief Marks whether the terminal is currently waiting for input.
+ *
+ * While it's active, records are queued rather than printed.
+ * Turning it off prints anything still in the queue.
+ *
+ * @param active True if the prompt is being displayed.
+ */
+void ws_internal_setPromptActive(bool active) {
+	if (ws_internal_session() != &default_session) return;
+	LOGGING_CHECK;
+	LOCK_LOGGING_MUTEX;
+	if (!active && log_queue_head) ws_internal_drainLogQueue();
+	prompt_active = active;
+	UNLOCK_LOGGING_MUTEX;
+}
+
+/**
+ * @internal
+ * @brief Prints queued records above the prompt, then redraws the prompt.
+ *
+ * All queued records are printed in a single pass, so a burst of logs only redraws the prompt once.
+ *
+ * @param prompt_prefix Console prefix.
+ * @param commandBuf Current contents of the command line.
+ * @param current_position Current cursor position in the command line (index + 1).
+ */
+void ws_internal_flushLogQueue(const char* prompt_prefix, const char* commandBuf, size_t current_position) {
+	if (ws_internal_session() != &default_session) return;
+	LOCK_LOGGING_MUTEX;
+	if (!log_queue_head && log_queue_dropped == 0) {
+		UNLOCK_LOGGING_MUTEX;
+		return;
+	}
+	fprintf(ws_out_stream, "\r");
+	CLEAR_ROW;
+	ws_internal_drainLogQueue();
+	fprintf(ws_out_stream, "%s%s", prompt_prefix, commandBuf);
+	size_t len = strlen(commandBuf);
+	if (current_position <= len) ws_moveCursor_n(WS_CURSOR_LEFT, len + 1 - current_position);
+#ifdef PRINTING_NEEDS_FLUSH
+	fflush(ws_out_stream);
+#endif
+	UNLOCK_LOGGING_MUTEX;
+}
+
+#define PROMPT_ACTIVE(b) ws_internal_setPromptActive(b)
+#define FLUSH_LOG_QUEUE(p, buf, pos) ws_internal_flushLogQueue(p, buf, pos)
+#else
+#define PROMPT_ACTIVE(b)
+#define FLUSH_LOG_QUEUE(p, buf, pos)
+#endif // THREADED_SUPPORT
+
+void ws_internal_updateMinLevel();
+
+// Records below this level aren't printed to the terminal.
+ws_logtype_t log_level = WS_LOG;
+// Lowest level anything (the terminal, a sink, or the flight recorder) wants. Records below it are dropped before any formatting happens.
+ws_logtype_t log_min_level = WS_LOG;
+
+/**
+ * @internal
+ * @brief Parses a log type from either its name ("warn", case insensitive) or its number ("3").
+ * @param str String to parse.
+ * @param type Set to the parsed type.
+ * @return False if the string isn't a log type.
+ */
+bool ws_internal_parseLogType(const char* str, ws_logtype_t* type) {
+	static const char* names[] = { "log", "debug", "info", "warn", "error", "fatal" };
+	if (str[0] >= '0' && str[0] <= '0' + WS_FATAL && str[1] == '\0') {
+		*type = (ws_logtype_t) (str[0] - '0');
+		return true;
+	}
+	for (int i = 0; i <= WS_FATAL; i++) {
+		const char* a = str;
+		const char* b = names[i];
+		while (*a && *b && (*a | 0x20) == *b) {
+			a++;
+			b++;
+		}
+		if (!*a && !*b) {
+			*type = (ws_logtype_t) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Flight Recorder
+// ------------------------------------------------------------------------------------------------
+#ifndef NO_WS_FLIGHT_RECORDER
+#ifndef WS_FLIGHT_RECORDER_SIZE
+#define WS_FLIGHT_RECORDER_SIZE 256
+#endif // WS_FLIGHT_RECORDER_SIZE
+
+#ifndef WS_FLIGHT_RECORD_SIZE
+#define WS_FLIGHT_RECORD_SIZE 160
+#endif // WS_FLIGHT_RECORD_SIZE
+
+/*
+ * The flight recorder keeps the most recent records, including ones the terminal filters out, in a fixed ring.
+ * Writers never take a lock: each one claims the next index with an atomic add, then writes the slot
+ * inside a sequence lock. A slot's seq is odd while it's being written, and (index + 1) * 2 once it's done,
+ * so readers can tell both torn slots and slots that have already been reused.
+ */
+typedef struct {
+	volatile unsigned long long seq;
+	ws_logtype_t type;
+	size_t len;
+	char text[WS_FLIGHT_RECORD_SIZE];
+} ws_flight_slot_t;
+
+ws_flight_slot_t flight_ring[WS_FLIGHT_RECORDER_SIZE];
+volatile unsigned long long flight_head = 0;
+ws_logtype_t flight_level = WS_LOG;
+
+/**
+ * @internal
+ * @brief Copies a record into the flight recorder. Lock free, safe to call from any thread.
+ */
+void ws_internal_recordFlight(ws_logtype_t type, const char* text, size_t len) {
+	unsigned long long idx = WS_ATOMIC_ADD(&flight_head, 1);
+	ws_flight_slot_t* slot = &flight_ring[idx % WS_FLIGHT_RECORDER_SIZE];
+	if (len >= WS_FLIGHT_RECORD_SIZE) len = WS_FLIGHT_RECORD_SIZE - 1;
+
+	WS_ATOMIC_EXCHANGE(&slot->seq, idx * 2 + 1);
+	slot->type = type;
+	slot->len = len;
+	memcpy(slot->text, text, len);
+	WS_ATOMIC_EXCHANGE(&slot->seq, idx * 2 + 2);
+}
+
+/**
+ * @internal
+ * @brief Reads the record with the given index out of the ring.
+ * @param idx Index of the record.
+ * @param type Set to the type of the record.
+ * @param out Buffer of at least WS_FLIGHT_RECORD_SIZE bytes to copy the text into, or NULL to only read the type.
+ * @param len Set to the length of the text.
+ * @return False if the record is being written or has been overwritten.
+ */
+bool ws_internal_readFlight(unsigned long long idx, ws_logtype_t* type, char* out, size_t* len) {
+	ws_flight_slot_t* slot = &flight_ring[idx % WS_FLIGHT_RECORDER_SIZE];
+	unsigned long long seq = WS_ATOMIC_LOAD(&slot->seq);
+	if (seq != idx * 2 + 2) return false;
+	*type = slot->type;
+	*len = slot->len;
+	if (*len >= WS_FLIGHT_RECORD_SIZE) return false;
+	if (out) memcpy(out, slot->text, *len);
+	WS_ATOMIC_FENCE();
+	return WS_ATOMIC_LOAD(&slot->seq) == seq;
+}
+
+/**
+ * @brief Writes the most recent records in the flight recorder to a stream, oldest first.
+ *
+ * The flight recorder keeps the last WS_FLIGHT_RECORDER_SIZE records at or above its level,
+ * whether or not they were printed to the terminal.
+ *
+ * @param stream Stream to write to.
+ * @param n Maximum amount of records to write. 0 writes everything.
+ * @param level Only records of this type or above are written.
+ * @return Amount of records written.
+ */
+size_t ws_dumpFlightRecorder(FILE* stream, size_t n, ws_logtype_t level) {
+	if (!stream) return 0;
+	unsigned long long head = WS_ATOMIC_LOAD(&flight_head);
+	unsigned long long start = head > WS_FLIGHT_RECORDER_SIZE ? head - WS_FLIGHT_RECORDER_SIZE : 0;
+	ws_logtype_t type;
+	size_t len;
+
+	// Count first, so only the newest n are printed.
+	size_t matching = 0;
+	for (unsigned long long i = start; i < head; i++) {
+		if (ws_internal_readFlight(i, &type, NULL, &len) && type >= level) matching++;
+	}
+	size_t skip = (n > 0 && matching > n) ? matching - n : 0;
+
+	char text[WS_FLIGHT_RECORD_SIZE];
+	size_t written = 0;
+	for (unsigned long long i = start; i < head; i++) {
+		if (!ws_internal_readFlight(i, &type, text, &len) || type < level) continue;
+		if (skip > 0) {
+			skip--;
+			continue;
+		}
+		fprintf(stream, "%.*s\n", (int) len, text);
+		written++;
+	}
+	return written;
+}
+
+/**
+ * @brief Sets the lowest log type the flight recorder keeps. Defaults to WS_LOG, which keeps everything.
+ *
+ * Anything the flight recorder keeps has to be formatted, even if it isn't printed.
+ * Raising this makes filtered records cheaper, at the cost of less history.
+ *
+ * @param type Lowest log type to keep.
+ */
+void ws_setFlightRecorderLevel(ws_logtype_t type) {
+	LOGGING_CHECK;
+	LOCK_LOGGING_MUTEX;
+	flight_level = type;
+	ws_internal_updateMinLevel();
+	UNLOCK_LOGGING_MUTEX;
+}
+
+/**
+ * @internal
+ * @brief Dumps the flight recorder to the error stream, called after a WS_FATAL record.
+ */
+void ws_internal_dumpFlightOnFatal() {
+	FILE* err = ws_getStream(WS_ERROR_S);
+	// The ring may not be full yet, so the count is only known once the records are written.
+	fprintf(err, "---- Recent log records ----\n");
+	size_t count = ws_dumpFlightRecorder(err, 0, WS_LOG);
+	fprintf(err, "---- End of %zu log record%s ----\n", count, count == 1 ? "" : "s");
+	fflush(err);
+}
+
+/**
+ * @internal
+ * @brief Empties the flight recorder.
+ */
+void ws_internal_cleanFlightRecorder() {
+	memset(flight_ring, 0, sizeof(flight_ring));
+	flight_head = 0;
+	flight_level = WS_LOG;
+}
+#endif // NO_WS_FLIGHT_RECORDER
+
+// ------------------------------------------------------------------------------------------------
+// Log Sinks
+// ------------------------------------------------------------------------------------------------
+#ifndef WS_MAX_LOG_SINKS
+#define WS_MAX_LOG_SINKS 8
+#endif // WS_MAX_LOG_SINKS
+
+#ifndef WS_SINK_PATH_SIZE
+#define WS_SINK_PATH_SIZE 256
+#endif // WS_SINK_PATH_SIZE
+
+#ifndef WS_SINK_BUFFER_SIZE
+#define WS_SINK_BUFFER_SIZE 16384
+#endif // WS_SINK_BUFFER_SIZE
+
+typedef enum {
+	WS_SINK_CUSTOM,
+	WS_SINK_FILE,
+	WS_SINK_JSON,
+	WS_SINK_MEMORY
+} ws_internal_sink_kind_t;
+
+struct ws_log_sink {
+	bool used;
+	ws_internal_sink_kind_t kind;
+	ws_logtype_t level;
+
+	/* Custom sinks */
+	ws_log_sink_write_t write;
+	ws_log_sink_close_t close;
+	void* data;
+
+	/* File and JSON sinks */
+	FILE* file;
+	char path[WS_SINK_PATH_SIZE];
+	size_t bytes;
+	size_t max_bytes;
+	size_t max_files;
+	bool open_failed; // Reopening after a rotation failed, and it has been reported.
+
+	/* Memory sinks */
+	char* ring;
+	size_t ring_size;
+	size_t ring_head;
+	bool ring_wrapped;
+};
+
+// Sinks are only added and removed with the logging mutex held, and records are written to them with it held.
+ws_log_sink_t log_sinks[WS_MAX_LOG_SINKS];
+size_t log_sink_count = 0;
+
+/**
+ * @internal
+ * @brief Recalculates the lowest level that anything wants. Must be called with the logging mutex held.
+ */
+void ws_internal_updateMinLevel() {
+	ws_logtype_t min = log_level;
+#ifndef NO_WS_FLIGHT_RECORDER
+	if (flight_level < min) min = flight_level;
+#endif // NO_WS_FLIGHT_RECORDER
+	for (size_t i = 0; i < WS_MAX_LOG_SINKS; i++) {
+		if (log_sinks[i].used && log_sinks[i].level < min) min = log_sinks[i].level;
+	}
+	log_min_level = min;
+}
+
+/**
+ * @internal
+ * @brief Finds an unused sink slot and resets it. Must be called with the logging mutex held.
+ * @return NULL if WS_MAX_LOG_SINKS sinks are already in use.
+ */
+ws_log_sink_t* ws_internal_allocSink(ws_internal_sink_kind_t kind, ws_logtype_t level) {
+	for (size_t i = 0; i < WS_MAX_LOG_SINKS; i++) {
+		if (!log_sinks[i].used) {
+			memset(&log_sinks[i], 0, sizeof(ws_log_sink_t));
+			log_sinks[i].used = true;
+			log_sinks[i].kind = kind;
+			log_sinks[i].level = level;
+			return &log_sinks[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @internal
+ * @brief Publishes a newly set up sink. Must be called with the logging mutex held.
+ */
+void ws_internal_publishSink(ws_log_sink_t* sink) {
+	log_sink_count++;
+	ws_internal_updateMinLevel();
+}
+
+/**
+ * @brief Adds a custom log sink. Every record at or above `level` is passed to `write`.
+ *
+ * Records are formatted once per log call, then handed to every sink that wants them.
+ * Sinks are called with the logging mutex held, so they don't need their own locking, but they must not log.
+ *
+ * @param write Function that receives each record.
+ * @param close Function called when the sink is removed. Can be NULL.
+ * @param data Pointer passed back to write and close.
+ * @param level Lowest log type this sink receives.
+ * @return The sink, or NULL if WS_MAX_LOG_SINKS sinks already exist.
+ */
+ws_log_sink_t* ws_addLogSink(ws_log_sink_write_t write, ws_log_sink_close_t close, void* data, ws_logtype_t level) {
+	if (!write) return NULL;
+	LOGGING_CHECK;
+	LOCK_LOGGING_MUTEX;
+	ws_log_sink_t* sink = ws_internal_allocSink(WS_SINK_CUSTOM, level);
+	if (sink) {
+		sink->write = write;
+		sink->close = close;
+		sink->data = data;
+		ws_internal_publishSink(sink);
+	}
+	UNLOCK_LOGGING_MUTEX;
+	return sink;
+}
+
+/**
+ * @brief Adds a log sink that keeps the most recent records in a caller provided buffer.
+ *
+ * Once the buffer is full, the oldest records are overwritten. Read it with @ref ws_dumpMemorySink().
+ *
+ * @param buffer Buffer to store records in. It must stay valid until the sink is removed.
+ * @param size Size of the buffer.
+ * @param level Lowest log type this sink receives.
+ * @return The sink, or NULL if WS_MAX_LOG_SINKS sinks already exist.
+ */
+ws_log_sink_t* ws_addMemorySink(char* buffer, size_t size, ws_logtype_t level) {
+	if (!buffer || size < 2) return NULL;
+	LOGGING_CHECK;
+	LOCK_LOGGING_MUTEX;
+	ws_log_sink_t* sink = ws_internal_allocSink(WS_SINK_MEMORY, level);
+	if (sink) {
+		sink->ring = buffer;
+		sink->ring_size = size;
+		ws_internal_publishSink(sink);
+	}
+	UNLOCK_LOGGING_MUTEX;
+	return sink;
+}
+
+/**
+ * @internal
+ * @brief Appends bytes to a memory sink, wrapping around once it reaches the end.
+ */
+void ws_internal_ringWrite(ws_log_sink_t* sink, const char* data, size_t len) {
+	// Only the tail of anything bigger than the ring would survive anyway.
+	if (len > sink->ring_size) {
+		data += len - sink->ring_size;
+		len = sink->ring_size;
+	}
+	size_t first = sink->ring_size - sink->ring_head;
+	if (first > len) first = len;
+	memcpy(sink->ring + sink->ring_head, data, first);
+	memcpy(sink->ring, data + first, len - first);
+	if (sink->ring_head + len >= sink->ring_size) sink->ring_wrapped = true;
+	sink->ring_head = (sink->ring_head + len) % sink->ring_size;
+}
+
+/**
+ * @brief Writes everything currently in a memory sink to the provided stream, oldest first.
+ *
+ * If the sink has wrapped around, the partially overwritten oldest record is skipped.
+ *
+ * @param sink Sink returned by @ref ws_addMemorySink().
+ * @param stream Stream to write to.
+ */
+void ws_dumpMemorySink(ws_log_sink_t* sink, FILE* stream) {
+	if (!sink || !stream) return;
+	LOGGING_CHECK;
+	LOCK_LOGGING_MUTEX;
+	if (sink->used && sink->kind == WS_SINK_MEMORY) {
+		if (sink->ring_wrapped) {
+			size_t start = sink->ring_head;
+			size_t count = sink->ring_size;
+			// Skip to the start of the first complete record.
+			while (count > 0 && sink->ring[start] != '\n') {
+				start = (start + 1) % sink->ring_size;
+				count--;
+			}
+			if (count > 0) {
+				start = (start + 1) % sink->ring_size;
+				count--;
+			}
+			size_t first = sink->ring_size - start;
+			if (first > count) first = count;
+			fwrite(sink->ring + start, 1, first, stream);
+			fwrite(sink->ring, 1, count - first, stream);
+		} else {
+			fwrite(sink->ring, 1, sink->ring_head, stream);
+		}
+	}
+	UNLOCK_LOGGING_MUTEX;
+}
+
+#ifndef NO_WS_FILE_SINKS
+/**
+ * @internal
+ * @brief Opens the file for a file or JSON sink, and works out how big it already is.
+ */
+bool ws_internal_openSinkFile(ws_log_sink_t* sink, const char* mode) {
+	sink->file = fopen(sink->path, mode);
+	if (!sink->file) return false;
+	// Records are buffered and written in large chunks, rather than one write per record.
+	setvbuf(sink->file, NULL, _IOFBF, WS_SINK_BUFFER_SIZE);
+	sink->bytes = 0;
+	if (mode[0] == 'a' && fseek(sink->file, 0, SEEK_END) == 0) {
+		long pos = ftell(sink->file);
+		if (pos > 0) sink->bytes = (size_t) pos;
+	}
+	return true;
+}
+
+/**
+ * @internal
+ * @brief Reopens the file of a sink that lost it, reporting the first failure to the error stream.
+ *
+ * A sink without a file tries again on every record, so logging picks up again once the path is writable.
+ */
+bool ws_internal_reopenSink(ws_log_sink_t* sink, const char* mode) {
+	if (ws_internal_openSinkFile(sink, mode)) {
+		sink->open_failed = false;
+		return true;
+	}
+	if (!sink->open_failed) {
+		sink->open_failed = true;
+		fprintf(ws_getStream(WS_ERROR_S), "Couldn't open log file %s, records are dropped until it can be opened again.\n",
+				sink->path);
+	}
+	return false;
+}
+
+/**
+ * @internal
+ * @brief Rotates a file sink: path -> path.1 -> path.2 ... -> path.<max_files>, and starts a new file.
+ */
+void ws_internal_rotateSink(ws_log_sink_t* sink) {
+	fclose(sink->file);
+	sink->file = NULL;
+
+	char from[WS_SINK_PATH_SIZE + 24];
+	char to[WS_SINK_PATH_SIZE + 24];
+	if (sink->max_files > 0) {
+		snprintf(to, sizeof(to), "%s.%zu", sink->path, sink->max_files);
+		remove(to);
+		for (size_t i = sink->max_files; i > 1; i--) {
+			snprintf(from, sizeof(from), "%s.%zu", sink->path, i - 1);
+			snprintf(to, sizeof(to), "%s.%zu", sink->path, i);
+			rename(from, to);
+		}
+		snprintf(to, sizeof(to), "%s.1", sink->path);
+		rename(sink->path, to);
+	}
+	ws_internal_reopenSink(sink, "w");
+}
+
+/**
+ * @internal
+ * @brief Shared setup for file and JSON sinks.
+ */
+ws_log_sink_t* ws_internal_addFileSink(ws_internal_sink_kind_t kind, const char* path, size_t max_bytes, size_t max_files,
+									   ws_logtype_t level) {
+	if (!path || strlen(path) >= WS_SINK_PATH_SIZE) return NULL;
+	LOGGING_CHECK;
+	LOCK_LOGGING_MUTEX;
+	ws_log_sink_t* sink = ws_internal_allocSink(kind, level);
+	if (sink) {
+		strcpy(sink->path, path);
+		sink->max_bytes = max_bytes;
+		sink->max_files = max_files;
+		if (ws_internal_openSinkFile(sink, "a")) {
+			ws_internal_publishSink(sink);
+		} else {
+			sink->used = false;
+			sink = NULL;
+		}
+	}
+	UNLOCK_LOGGING_MUTEX;
+	return sink;
+}
+
+/**
+ * @brief Adds a log sink that appends plain text records (no colors) to a file.
+ *
+ * Writes are buffered. The buffer is flushed for WS_ERROR and WS_FATAL records, when the sink is removed,
+ * and by @ref ws_flushLogSinks().
+ *
+ * @param path Path of the log file. Opened in append mode.
+ * @param max_bytes Size at which the file is rotated. 0 disables rotation.
+ * @param max_files How many rotated files (path.1, path.2, ...) to keep. 0 just truncates the file when it's full.
+ * @param level Lowest log type this sink receives.
+ * @return The sink, or NULL if the file couldn't be opened or WS_MAX_LOG_SINKS sinks already exist.
+ */
+ws_log_sink_t* ws_addFileSink(const char* path, size_t max_bytes, size_t max_files, ws_logtype_t level) {
+	return ws_internal_addFileSink(WS_SINK_FILE, path, max_bytes, max_files, level);
+}
+
+/**
+ * @brief Adds a log sink that appends records to a file as JSON lines.
+ *
+ * Each record is written as `{"level":"INFO","thread":"Main","message":"..."}` on its own line.
+ * Buffering and rotation work the same as @ref ws_addFileSink().
+ *
+ * @param path Path of the log file. Opened in append mode.
+ * @param max_bytes Size at which the file is rotated. 0 disables rotation.
+ * @param max_files How many rotated files (path.1, path.2, ...) to keep.
+ * @param level Lowest log type this sink receives.
+ * @return The sink, or NULL if the file couldn't be opened or WS_MAX_LOG_SINKS sinks already exist.
+ */
+ws_log_sink_t* ws_addJsonSink(const char* path, size_t max_bytes, size_t max_files, ws_logtype_t level) {
+	return ws_internal_addFileSink(WS_SINK_JSON, path, max_bytes, max_files, level);
+}
+
+/**
+ * @internal
+ * @brief Writes a JSON string (including the quotes), escaping it as needed.
+ *
+ * Runs of characters that don't need escaping are written with a single fwrite.
+ *
+ * @return Amount of bytes written.
+ */
+size_t ws_internal_writeJsonString(FILE* file, const char* str, size_t len) {
+	static const char hex[] = "0123456789abcdef";
+	size_t written = 2;
+	size_t run = 0;
+	fputc('"', file);
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = (unsigned char) str[i];
+		if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+		fwrite(str + run, 1, i - run, file);
+		written += i - run;
+		run = i + 1;
+		char esc[6] = { '\\', 0, 0, 0, 0, 0 };
+		size_t esc_len = 2;
+		switch (c) {
+			case '"': esc[1] = '"';
+				break;
+			case '\\': esc[1] = '\\';
+				break;
+			case '\n': esc[1] = 'n';
+				break;
+			case '\r': esc[1] = 'r';
+				break;
+			case '\t': esc[1] = 't';
+				break;
+			default: esc[1] = 'u';
+				esc[2] = '0';
+				esc[3] = '0';
+				esc[4] = hex[c >> 4];
+				esc[5] = hex[c & 0xf];
+				esc_len = 6;
+				break;
+		}
+		fwrite(esc, 1, esc_len, file);
+		written += esc_len;
+	}
+	fwrite(str + run, 1, len - run, file);
+	written += len - run;
+	fputc('"', file);
+	return written;
+}
+#endif // NO_WS_FILE_SINKS
+
+/**
+ * @brief Changes the lowest log type a sink receives.
+ * @param sink Sink to change.
+ * @param level Lowest log type the sink receives.
+ */
+void ws_setLogSinkLevel(ws_log_sink_t* sink, ws_logtype_t level) {
+	if (!sink) return;
+	LOGGING_CHECK;
+	LOCK_LOGGING_MUTEX;
+	sink->level = level;
+	ws_internal_updateMinLevel();
+	UNLOCK_LOGGING_MUTEX;
+}
+
+/**
+ * @internal
+ * @brief Closes a sink and frees its slot. Must be called with the logging mutex held.
+ */
+void ws_internal_closeSink(ws_log_sink_t* sink) {
+	if (!sink->used) return;
+	if (sink->kind == WS_SINK_CUSTOM && sink->close) sink->close(sink->data);
+	if (sink->file) fclose(sink->file);
+	sink->file = NULL;
+	sink->used = false;
+	log_sink_count--;
+	ws_internal_updateMinLevel();
+}
+
+/**
+ * @brief Removes a sink. File sinks are flushed and closed, custom sinks have their close function called.
+ * @param sink Sink to remove.
+ */
+void ws_removeLogSink(ws_log_sink_t* sink) {
+	if (!sink) return;
+	LOGGING_CHECK;
+	LOCK_LOGGING_MUTEX;
+	ws_internal_closeSink(sink);
+	UNLOCK_LOGGING_MUTEX;
+}
+
+/**
+ * @brief Flushes any buffered records in file and JSON sinks.
+ */
+void ws_flushLogSinks() {
+	LOGGING_CHECK;
+	LOCK_LOGGING_MUTEX;
+	for (size_t i = 0; i < WS_MAX_LOG_SINKS; i++) {
+		if (log_sinks[i].used && log_sinks[i].file) fflush(log_sinks[i].file);
+	}
+	UNLOCK_LOGGING_MUTEX;
+}
+
+/**
+ * @internal
+ * @brief Hands a record to every sink that wants it. Must be called with the logging mutex held.
+ */
+void ws_internal_writeSinks(const ws_log_record_t* record) {
+	for (size_t i = 0; i < WS_MAX_LOG_SINKS; i++) {
+		ws_log_sink_t* sink = &log_sinks[i];
+		if (!sink->used || record->type < sink->level) continue;
+
+		switch (sink->kind) {
+			case WS_SINK_CUSTOM: sink->write(sink->data, record);
+				break;
+			case WS_SINK_MEMORY: ws_internal_ringWrite(sink, record->text, record->text_len);
+				ws_internal_ringWrite(sink, "\n", 1);
+				break;
+#ifndef NO_WS_FILE_SINKS
+			case WS_SINK_FILE: {
+					if (!sink->file && !ws_internal_reopenSink(sink, "a")) break;
+					fwrite(record->text, 1, record->text_len, sink->file);
+					fputc('\n', sink->file);
+					sink->bytes += record->text_len + 1;
+					break;
+				}
+			case WS_SINK_JSON: {
+					if (!sink->file && !ws_internal_reopenSink(sink, "a")) break;
+					// The tags have padding for the terminal, JSON gets the bare level name.
+					const char* tag = log_tags[record->type] + 1;
+					size_t tag_len = strcspn(tag, "]");
+					if (record->timestamp) {
+						// Milliseconds since the Unix epoch, easy to line up with other telemetry.
+						int written = fprintf(sink->file, "{\"time\":%llu,\"level\":\"", record->timestamp / 1000000ULL);
+						if (written > 0) sink->bytes += (size_t) written;
+					} else {
+						fputs("{\"level\":\"", sink->file);
+						sink->bytes += 10;
+					}
+					fwrite(tag, 1, tag_len, sink->file);
+					fputc('"', sink->file);
+					sink->bytes += tag_len + 1;
+					if (record->category) {
+						fputs(",\"category\":", sink->file);
+						sink->bytes += ws_internal_writeJsonString(sink->file, record->category, record->category_len) + 12;
+					}
+					if (record->thread) {
+						fputs(",\"thread\":", sink->file);
+						sink->bytes += ws_internal_writeJsonString(sink->file, record->thread, record->thread_len) + 10;
+					}
+					fputs(",\"message\":", sink->file);
+					sink->bytes += ws_internal_writeJsonString(sink->file, record->message, record->message_len) + 13;
+					fputs("}\n", sink->file);
+					break;
+				}
+#endif // NO_WS_FILE_SINKS
+			default: break;
+		}
+
+#ifndef NO_WS_FILE_SINKS
+		if (sink->file) {
+			if (record->type >= WS_ERROR) fflush(sink->file);
+			if (sink->max_bytes > 0 && sink->bytes >= sink->max_bytes) ws_internal_rotateSink(sink);
+		}
+#endif // NO_WS_FILE_SINKS
+	}
+}
+
+/**
+ * @internal
+ * @brief Closes every sink.
+ */
+void ws_internal_cleanSinks() {
+	for (size_t i = 0; i < WS_MAX_LOG_SINKS; i++) ws_internal_closeSink(&log_sinks[i]);
+	log_sink_count = 0;
+}
+
+void ws_internal_dispatchRecord(ws_logtype_t type, ws_log_category_t category, const char* buf, size_t len, size_t header_len,
+								unsigned long long timestamp);
+
+/**
+ * @internal
+ * @brief Formats a single log record, then prints it and hands it to anything else that wants it.
+ *
+ * The record is formatted once, before the logging mutex is taken, so other threads only wait on the actual writes.
+ * Records in a category have already passed its level, so they skip the terminal's level.
+ *
+ * @param type Type of logging.
+ * @param category Category of the record, or WS_NO_LOG_CATEGORY.
+ * @param format printf style formatting string.
+ * @param args va_list of arguments.
+ */
+void ws_internal_vlog(ws_logtype_t type, ws_log_category_t category, const char* format, va_list args) {
+	LOGGING_CHECK;
+	// Each thread has its own format buffer, so nothing here needs the logging mutex.
+	char* stack_buf = log_context.buf;
+	char* buf = stack_buf;
+	size_t header_len;
+	// Taken once, so a record that has to be formatted again gets the same time.
+	unsigned long long timestamp = ws_internal_logTimestamp();
+	size_t len = ws_internal_formatRecord(buf, WS_LOG_BUFFER_SIZE, &header_len, type, category, timestamp, format, args);
+#ifndef DISABLE_MALLOC
+	if (len >= WS_LOG_BUFFER_SIZE) {
+		// Too big for the stack buffer, allocate one that fits. If that fails, the record is just truncated.
+		char* heap_buf = malloc(len + 1);
+		if (heap_buf) {
+			buf = heap_buf;
+			len = ws_internal_formatRecord(buf, len + 1, &header_len, type, category, timestamp, format, args);
+		} else {
+			len = WS_LOG_BUFFER_SIZE - 1;
+		}
+	}
+#else
+	if (len >= WS_LOG_BUFFER_SIZE) len = WS_LOG_BUFFER_SIZE - 1;
+#endif // DISABLE_MALLOC
+	if (header_len > len) header_len = len;
+
+	ws_internal_dispatchRecord(type, category, buf, len, header_len, timestamp);
+#ifndef DISABLE_MALLOC
+	if (buf != stack_buf) free(buf);
+#endif // DISABLE_MALLOC
+}
+
+/**
+ * @internal
+ * @brief Prints a formatted record, then hands it to the flight recorder and any sinks that want it.
+ *
+ * @param type Type of logging.
+ * @param category Category of the record, or WS_NO_LOG_CATEGORY.
+ * @param buf The formatted record, '\0' terminated.
+ * @param len Length of the record.
+ * @param header_len Length of everything before the message.
+ * @param timestamp Timestamp of the record, or 0.
+ */
+void ws_internal_dispatchRecord(ws_logtype_t type, ws_log_category_t category, const char* buf, size_t len, size_t header_len,
+								unsigned long long timestamp) {
+#ifndef NO_WS_FLIGHT_RECORDER
+	if (type >= flight_level) ws_internal_recordFlight(type, buf, len);
+#endif // NO_WS_FLIGHT_RECORDER
+
+	LOCK_LOGGING_MUTEX;
+	if (category != WS_NO_LOG_CATEGORY || type >= log_level) {
+#ifdef THREADED_SUPPORT
+		if (prompt_active && ws_internal_session() == &default_session && thread_stream_count[WS_OUTPUT] == 0) {
+			ws_internal_queueRecord(type, buf, len);
+		} else {
+			ws_internal_emitRecord(type, buf);
+		}
+#else
+		ws_internal_emitRecord(type, buf);
+#endif // THREADED_SUPPORT
+	}
+
+	if (log_sink_count > 0) {
+		ws_log_record_t record = { type, buf, len, buf + header_len, len - header_len, NULL, 0, timestamp, NULL, 0 };
+		if (category != WS_NO_LOG_CATEGORY) {
+			record.category = log_categories[category].name;
+			record.category_len = log_categories[category].tag_len - 2;
+		}
+#ifdef THREADED_SUPPORT
+		ws_log_context_t* ctx = ws_internal_logContext();
+		record.thread = ctx->tag + 1;
+		record.thread_len = ctx->tag_len - 2;
+#endif // THREADED_SUPPORT
+		ws_internal_writeSinks(&record);
+	}
+	UNLOCK_LOGGING_MUTEX;
+
+#ifndef NO_WS_FLIGHT_RECORDER
+	if (type == WS_FATAL) ws_internal_dumpFlightOnFatal();
+#endif // NO_WS_FLIGHT_RECORDER
+}
+
+/**
+ * @brief Set the minimum level the logger prints to the terminal. Anything below it is dropped before it's formatted,
+ * unless a log sink wants it.
+ *
+ * This is the runtime counterpart to WS_COMPILE_LOG_LEVEL. Defaults to WS_LOG, which prints everything.
+ *
+ * @param type Lowest log type that should be printed.
+ */
+void ws_setLogLevel(ws_logtype_t type) {
+	LOGGING_CHECK;
+	LOCK_LOGGING_MUTEX;
+	log_level = type;
+	ws_internal_updateMinLevel();
+	UNLOCK_LOGGING_MUTEX;
+}
+
+/**
+ * @brief Get the minimum level the logger prints.
+ * @return The current minimum log type.
+ */
+ws_logtype_t ws_getLogLevel() { return log_level; }
+
+/**
+ * @brief Logger function for WallShell. vprintf like formatting, automatically adds a newline.
+ * @param type Type of logging.
+ * @param format printf style formatting string.
+ * @param args va_list of arguments.
+ */
+void ws_vlogger(ws_logtype_t type, const char* format, va_list args) {
+	if (type < log_min_level) return;
+	if (type > WS_FATAL) {
+		vfprintf(ws_out_stream, format, args);
+		return;
+	}
+	ws_internal_vlog(type, WS_NO_LOG_CATEGORY, format, args);
+}
+
+/**
+ * @brief Logger function for WallShell. Printf like formatting, automatically adds a newline.
+ * @param type Type of logging.
+ * @param format Printf style formatting string.
+ * @param ... Printf style formatting arguments.
+ */
+void ws_logger(ws_logtype_t type, const char* format, ...) {
+	// Check the level before touching the va_list, filtered records should cost as little as possible.
+	if (type < log_min_level) return;
+	va_list args;
+	va_start(args, format);
+	ws_vlogger(type, format, args);
+	va_end(args);
+}
+
+/**
+ * @internal
+ * @brief Rebuilds the per type category masks. Must be called with the logging mutex held.
+ */
+void ws_internal_updateCategoryMasks() {
+	for (int type = 0; type <= WS_FATAL; type++) {
+		unsigned long long mask = 0;
+		for (int i = 0; i < log_category_count; i++) {
+			if (log_categories[i].enabled && (ws_logtype_t) type >= log_categories[i].level) mask |= 1ULL << i;
+		}
+		WS_ATOMIC_EXCHANGE(&log_category_masks[type], mask);
+	}
+}
+
+/**
+ * @brief Finds a registered log category by name.
+ * @param name Name of the category.
+ * @return The category, or WS_NO_LOG_CATEGORY if there isn't one with that name.
+ */
+ws_log_category_t ws_findLogCategory(const char* name) {
+	if (!name) return WS_NO_LOG_CATEGORY;
+	for (int i = 0; i < log_category_count; i++) {
+		if (strcmp(log_categories[i].name, name) == 0) return i;
+	}
+	return WS_NO_LOG_CATEGORY;
+}
+
+/**
+ * @brief Registers a named log category, for use with @ref ws_logc().
+ *
+ * Categories can be turned on, off, and have their level changed at runtime, either through the functions below
+ * or the `log` command. Up to 64 categories can exist. Registering a name that already exists returns the existing category.
+ *
+ * @param name Name of the category. Cut short to WS_LOG_CATEGORY_NAME_SIZE - 1 characters.
+ * @param level Lowest log type the category prints to begin with.
+ * @return The category, or WS_NO_LOG_CATEGORY if all 64 are in use.
+ */
+ws_log_category_t ws_registerLogCategory(const char* name, ws_logtype_t level) {
+	if (!name) return WS_NO_LOG_CATEGORY;
+	LOGGING_CHECK;
+	LOCK_LOGGING_MUTEX;
+	ws_log_category_t category = ws_findLogCategory(name);
+	if (category == WS_NO_LOG_CATEGORY && log_category_count < WS_MAX_LOG_CATEGORIES) {
+		category = log_category_count;
+		ws_log_category_info_t* info = &log_categories[category];
+		snprintf(info->name, sizeof(info->name), "%s", name);
+		size_t name_len = strlen(info->name);
+		info->tag[0] = '[';
+		memcpy(info->tag + 1, info->name, name_len);
+		info->tag[name_len + 1] = ']';
+		info->tag[name_len + 2] = '\0';
+		info->tag_len = name_len + 2;
+		info->level = level;
+		info->enabled = true;
+		log_category_count++;
+		ws_internal_updateCategoryMasks();
+	}
+	UNLOCK_LOGGING_MUTEX;
+	return category;
+}
+
+/**
+ * @brief Sets the lowest log type a category prints.
+ *
+ * This replaces the terminal's log level for records in the category,
+ * so a single category can be made more verbose than everything else.
+ *
+ * @param category Category to change.
+ * @param level Lowest log type to print.
+ */
+void ws_setLogCategoryLevel(ws_log_category_t category, ws_logtype_t level) {
+	if (category < 0 || category >= log_category_count) return;
+	LOGGING_CHECK;
+	LOCK_LOGGING_MUTEX;
+	log_categories[category].level = level;
+	ws_internal_updateCategoryMasks();
+	UNLOCK_LOGGING_MUTEX;
+}
+
+/**
+ * @brief Turns a category on or off. Nothing in a disabled category is logged anywhere.
+ * @param category Category to change.
+ * @param enabled True to turn on, false to turn off.
+ */
+void ws_enableLogCategory(ws_log_category_t category, bool enabled) {
+	if (category < 0 || category >= log_category_count) return;
+	LOGGING_CHECK;
+	LOCK_LOGGING_MUTEX;
+	log_categories[category].enabled = enabled;
+	ws_internal_updateCategoryMasks();
+	UNLOCK_LOGGING_MUTEX;
+}
+
+/**
+ * @brief Logger function for a category. vprintf like formatting, automatically adds a newline.
+ * @param category Category the record belongs to.
+ * @param type Type of logging.
+ * @param format vprintf style formatting string.
+ * @param args va_list of arguments.
+ */
+void ws_vlogc(ws_log_category_t category, ws_logtype_t type, const char* format, va_list args) {
+	if ((unsigned int) category >= WS_MAX_LOG_CATEGORIES || type > WS_FATAL) return;
+	if (!(WS_ATOMIC_LOAD(&log_category_masks[type]) & (1ULL << category))) return;
+	ws_internal_vlog(type, category, format, args);
+}
+
+/**
+ * @brief Logger function for a category. Printf like formatting, automatically adds a newline.
+ *
+ * The record is only formatted if the category is enabled at this type.
+ *
+ * @param category Category the record belongs to.
+ * @param type Type of logging.
+ * @param format Printf style formatting string.
+ * @param ... Printf style formatting arguments.
+ */
+void ws_logc(ws_log_category_t category, ws_logtype_t type, const char* format, ...) {
+	if ((unsigned int) category >= WS_MAX_LOG_CATEGORIES || type > WS_FATAL) return;
+	if (!(WS_ATOMIC_LOAD(&log_category_masks[type]) & (1ULL << category))) return;
+	va_list args;
+	va_start(args, format);
+	ws_internal_vlog(type, category, format, args);
+	va_end(args);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Hex Dumps
+// ------------------------------------------------------------------------------------------------
+#ifndef WS_HEX_DUMP_LIMIT
+#define WS_HEX_DUMP_LIMIT 4096
+#endif // WS_HEX_DUMP_LIMIT
+
+// "\n" + offset + 2 spaces + 16 "xx " + middle space + " |" + 16 ASCII + "|"
+#define WS_HEX_LINE_SIZE 79
+// Room for "\n... <n> more bytes"
+#define WS_HEX_MORE_SIZE 48
+
+// Every byte's two hex digits, so encoding a byte is a single 2 byte copy.
+#define WS_HEX_ROW(h) h "0" h "1" h "2" h "3" h "4" h "5" h "6" h "7" h "8" h "9" h "a" h "b" h "c" h "d" h "e" h "f"
+static const char hex_pairs[] = WS_HEX_ROW("0") WS_HEX_ROW("1") WS_HEX_ROW("2") WS_HEX_ROW("3")
+								WS_HEX_ROW("4") WS_HEX_ROW("5") WS_HEX_ROW("6") WS_HEX_ROW("7")
+								WS_HEX_ROW("8") WS_HEX_ROW("9") WS_HEX_ROW("a") WS_HEX_ROW("b")
+								WS_HEX_ROW("c") WS_HEX_ROW("d") WS_HEX_ROW("e") WS_HEX_ROW("f");
+
+/**
+ * @internal
+ * @brief Writes a classic offset/hex/ASCII dump, one line per 16 bytes. Each line starts with a newline.
+ *
+ * @param out Buffer to write into. Must have room for WS_HEX_LINE_SIZE bytes per line.
+ * @param data Bytes to dump.
+ * @param size Amount of bytes to dump.
+ * @return Amount of characters written. Not '\0' terminated.
+ */
+size_t ws_internal_hexDump(char* out, const unsigned char* data, size_t size) {
+	char* p = out;
+	for (size_t offset = 0; offset < size; offset += 16) {
+		size_t n = size - offset < 16 ? size - offset : 16;
+		*p++ = '\n';
+		for (int shift = 24; shift >= 0; shift -= 8) {
+			memcpy(p, &hex_pairs[((offset >> shift) & 0xff) * 2], 2);
+			p += 2;
+		}
+		*p++ = ' ';
+		*p++ = ' ';
+		for (size_t i = 0; i < 16; i++) {
+			if (i == 8) *p++ = ' ';
+			if (i < n) {
+				memcpy(p, &hex_pairs[data[offset + i] * 2], 2);
+			} else {
+				p[0] = ' ';
+				p[1] = ' ';
+			}
+			p[2] = ' ';
+			p += 3;
+		}
+		*p++ = ' ';
+		*p++ = '|';
+		for (size_t i = 0; i < n; i++) {
+			unsigned char c = data[offset + i];
+			*p++ = (c >= 0x20 && c < 0x7f) ? (char) c : '.';
+		}
+		*p++ = '|';
+	}
+	return (size_t) (p - out);
+}
+
+/**
+ * @brief Logs a message followed by a hex dump of a buffer.
+ *
+ * The dump is written straight into the record after the message, so it's a single record with the usual
+ * tag, thread, colors and sinks. At most WS_HEX_DUMP_LIMIT bytes are dumped.
+ *
+ * @code
+ * [DEBUG][Main] Received packet
+ * 00000000  48 65 6c 6c 6f 20 57 6f  72 6c 64 0a              |Hello World.|
+ * @endcode
+ *
+ * @param type Type of logging.
+ * @param data Bytes to dump.
+ * @param size Amount of bytes.
+ * @param format Printf style formatting string for the message. Can be NULL.
+ * @param ... Printf style formatting arguments.
+ */
+void ws_logHex(ws_logtype_t type, const void* data, size_t size, const char* format, ...) {
+	if (type < log_min_level || type > WS_FATAL) return;
+	if (!data) size = 0;
+	if (!format) format = "";
+	LOGGING_CHECK;
+	size_t dumped = size > WS_HEX_DUMP_LIMIT ? WS_HEX_DUMP_LIMIT : size;
+
+	char* stack_buf = log_context.buf;
+	char* buf = stack_buf;
+	size_t capacity = WS_LOG_BUFFER_SIZE;
+	size_t header_len;
+	unsigned long long timestamp = ws_internal_logTimestamp();
+	va_list args;
+	va_start(args, format);
+	size_t len = ws_internal_formatRecord(buf, capacity, &header_len, type, WS_NO_LOG_CATEGORY, timestamp, format, args);
+#ifndef DISABLE_MALLOC
+	size_t dump_len = (dumped + 15) / 16 * WS_HEX_LINE_SIZE + WS_HEX_MORE_SIZE;
+	if (len + dump_len >= capacity) {
+		// Doesn't fit in the stack buffer. If the allocation fails, the dump is cut short instead.
+		char* heap_buf = malloc(len + dump_len + 1);
+		if (heap_buf) {
+			buf = heap_buf;
+			capacity = len + dump_len + 1;
+			len = ws_internal_formatRecord(buf, capacity, &header_len, type, WS_NO_LOG_CATEGORY, timestamp, format, args);
+		}
+	}
+#endif // DISABLE_MALLOC
+	va_end(args);
+	if (len >= capacity) len = capacity - 1;
+	if (header_len > len) header_len = len;
+
+	// Only whole lines are written. Anything that doesn't fit is counted instead.
+	size_t room = capacity - 1 - len;
+	size_t max_lines = room > WS_HEX_MORE_SIZE ? (room - WS_HEX_MORE_SIZE) / WS_HEX_LINE_SIZE : 0;
+	if ((dumped + 15) / 16 > max_lines) dumped = max_lines * 16;
+	len += ws_internal_hexDump(buf + len, (const unsigned char*) data, dumped);
+	if (dumped < size) {
+		int written = snprintf(buf + len, capacity - len, "\n... %llu more bytes", (unsigned long long) (size - dumped));
+		if (written > 0) len += (size_t) written;
+		if (len >= capacity) len = capacity - 1;
+	}
+	buf[len] = '\0';
+
+	ws_internal_dispatchRecord(type, WS_NO_LOG_CATEGORY, buf, len, header_len, timestamp);
+#ifndef DISABLE_MALLOC
+	if (buf != stack_buf) free(buf);
+#endif // DISABLE_MALLOC
+}
+
+// ------------------------------------------------------------------------------------------------
+// Rate Limiting & Sampling
+// ------------------------------------------------------------------------------------------------
+#ifndef WS_LOG_SUMMARY_INTERVAL_MS
+#define WS_LOG_SUMMARY_INTERVAL_MS 5000
+#endif // WS_LOG_SUMMARY_INTERVAL_MS
+
+// Sites that have suppressed something at least once. Sites are only ever added, and are never freed since they're static.
+ws_log_site_t* log_sites = NULL;
+unsigned long long last_log_summary = 0;
+
+/**
+ * @internal
+ * @brief Decides whether sampling drops this record. A single atomic add.
+ */
+bool ws_internal_siteSampledOut(ws_log_site_t* site) {
+	return site->sample > 1 && WS_ATOMIC_ADD(&site->count, 1) % site->sample != 0;
+}
+
+/**
+ * @internal
+ * @brief Decides whether a call site's rate limit allows it to log right now.
+ *
+ * Rate limiting uses GCRA, a token bucket that only stores the time the bucket will next be empty
+ * (the theoretical arrival time), so it's a clock read and a compare and swap.
+ *
+ * @param site Call site to check.
+ * @return True if the record should be logged.
+ */
+bool ws_internal_siteAllows(ws_log_site_t* site) {
+	if (site->interval == 0) return true;
+
+	unsigned long long now = WS_LOG_CLOCK();
+	unsigned long long tat = WS_ATOMIC_LOAD(&site->tat);
+	for (;;) {
+		unsigned long long next = (tat > now ? tat : now) + site->interval;
+		// Spending a token would push the bucket past its burst size.
+		if (next - now > site->limit) return false;
+		if (ws_internal_atomicCas(&site->tat, &tat, next)) return true;
+	}
+}
+
+/**
+ * @internal
+ * @brief Counts a dropped record. The first time a site drops anything, it's added to the summary list.
+ * @param counter Either the site's suppressed or sampled count.
+ */
+void ws_internal_siteSuppress(ws_log_site_t* site, ws_logtype_t type, volatile unsigned long long* counter) {
+	WS_ATOMIC_ADD(counter, 1);
+	if (WS_ATOMIC_LOAD(&site->registered) || WS_ATOMIC_EXCHANGE(&site->registered, 1)) return;
+	LOGGING_CHECK;
+	LOCK_LOGGING_MUTEX;
+	site->type = type;
+	site->next = log_sites;
+	log_sites = site;
+	UNLOCK_LOGGING_MUTEX;
+}
+
+/**
+ * @internal
+ * @brief Logs how many records a site suppressed since it last reported, if any.
+ * @param sampled Also include records dropped by sampling. Those are expected, so they're left to the periodic summary.
+ */
+void ws_internal_siteReport(ws_log_site_t* site, ws_logtype_t type, bool sampled) {
+	unsigned long long suppressed = WS_ATOMIC_EXCHANGE(&site->suppressed, 0);
+	if (sampled) suppressed += WS_ATOMIC_EXCHANGE(&site->sampled, 0);
+	if (suppressed == 0) return;
+	ws_logger(type, "%s:%d: suppressed %llu message%s", site->file, site->line, suppressed, suppressed == 1 ? "" : "s");
+}
+
+/**
+ * @brief Logger for a rate limited or sampled call site. Use WS_LOG_RATELIMITED or WS_LOG_SAMPLED instead of calling this directly.
+ *
+ * Suppressed records cost a few atomic operations, and are never formatted. Records dropped by the rate limit are
+ * reported the next time the site logs. Both those and records dropped by sampling are reported by
+ * @ref ws_logSuppressedSummary().
+ *
+ * @param site Static state for the call site.
+ * @param type Type of logging.
+ * @param format Printf style formatting string.
+ * @param ... Printf style formatting arguments.
+ */
+void ws_siteLogger(ws_log_site_t* site, ws_logtype_t type, const char* format, ...) {
+	// Filtered records don't use up the site's budget.
+	if (type < log_min_level) return;
+	if (ws_internal_siteSampledOut(site)) {
+		ws_internal_siteSuppress(site, type, &site->sampled);
+		return;
+	}
+	if (!ws_internal_siteAllows(site)) {
+		ws_internal_siteSuppress(site, type, &site->suppressed);
+		return;
+	}
+	va_list args;
+	va_start(args, format);
+	ws_vlogger(type, format, args);
+	va_end(args);
+	ws_internal_siteReport(site, type, false);
+}
+
+/**
+ * @brief Logs a "suppressed N messages" line for every rate limited or sampled call site that has dropped records
+ * since it last reported.
+ *
+ * The terminal calls this every WS_LOG_SUMMARY_INTERVAL_MS. Call it yourself if you aren't using ws_terminalMain().
+ */
+void ws_logSuppressedSummary() {
+	LOGGING_CHECK;
+	LOCK_LOGGING_MUTEX;
+	ws_log_site_t* site = log_sites;
+	UNLOCK_LOGGING_MUTEX;
+	// Sites are pushed to the front and never removed, so the rest of the list can be walked without the lock.
+	for (; site; site = site->next) ws_internal_siteReport(site, site->type, true);
+}
+
+/**
+ * @internal
+ * @brief Runs ws_logSuppressedSummary() if WS_LOG_SUMMARY_INTERVAL_MS has passed since it last ran.
+ * Only the default session's terminal reports, so sessions running side by side don't race on the interval.
+ */
+void ws_internal_logSummaryTick() {
+	if (ws_internal_session() != &default_session) return;
+	unsigned long long now = WS_LOG_CLOCK();
+	if (now - last_log_summary < WS_LOG_SUMMARY_INTERVAL_MS * 1000000ULL) return;
+	last_log_summary = now;
+	ws_logSuppressedSummary();
+}
+#define LOG_SUMMARY_TICK ws_internal_logSummaryTick()
+
+/**
+ * @brief Set the logger colors for the specified log type.
+ * @param type Type of logging.
+ * @param fg Foreground color.
+ * @param bg Background color.
+ */
+void ws_setLoggerColors(ws_logtype_t type, ws_fg_color_t fg, ws_bg_color_t bg) {
+	if (type > WS_FATAL) return;
+	ws_color_t* colors = ws_internal_logColors(type);
+	colors->foreground = fg;
+	colors->background = bg;
+}
+
+/**
+ * @internal
+ * @brief Resets all logger variables. Resets color, mutex, etc.
+ */
+void ws_internal_cleanLogger() {
+#ifdef THREADED_SUPPORT
+	ws_mutex_t* mut = (ws_mutex_t*) ws_exchangeAtomicPtr(&logging_mutex, NULL);
+	if (mut) ws_destroyMutex(mut);
+	if (thread_map_mut) ws_destroyMutex(thread_map_mut);
+	printThreadID = true;
+	thread_map_mut = NULL;
+	free(thread_map);
+	thread_map_size = 0;
+	thread_map_current = 0;
+	thread_map = NULL;
+	WS_ATOMIC_ADD(&thread_names_generation, 1);
+
+	while (log_queue_head) {
+		ws_log_queue_entry_t* next = log_queue_head->next;
+		free(log_queue_head);
+		log_queue_head = next;
+	}
+	log_queue_tail = NULL;
+	log_queue_size = 0;
+	log_queue_dropped = 0;
+	prompt_active = false;
+#endif
+	log_colors = (ws_color_t){ WS_FG_WHITE, WS_BG_DEFAULT };
+	debug_colors = (ws_color_t){ WS_FG_BRIGHT_GREEN, WS_BG_DEFAULT };
+	info_colors = (ws_color_t){ WS_FG_BRIGHT_CYAN, WS_BG_DEFAULT };
+	warn_colors = (ws_color_t){ WS_FG_BRIGHT_YELLOW, WS_BG_DEFAULT };
+	error_colors = (ws_color_t){ WS_FG_BRIGHT_RED, WS_BG_DEFAULT };
+	fatal_colors = (ws_color_t){ WS_FG_RED, WS_BG_DEFAULT };
+	log_level = WS_LOG;
+	printTimestamp = false;
+	log_category_count = 0;
+	for (int i = 0; i <= WS_FATAL; i++) log_category_masks[i] = 0;
+	ws_internal_cleanSinks();
+#ifndef NO_WS_FLIGHT_RECORDER
+	ws_internal_cleanFlightRecorder();
+#endif // NO_WS_FLIGHT_RECORDER
+	log_min_level = WS_LOG;
+
+	while (log_sites) {
+		ws_log_site_t* next = log_sites->next;
+		log_sites->next = NULL;
+		log_sites->suppressed = 0;
+		log_sites->sampled = 0;
+		log_sites->registered = 0;
+		log_sites = next;
+	}
+	last_log_summary = 0;
+}
+
+#else
+#define PROMPT_ACTIVE(b)
+#define FLUSH_LOG_QUEUE(p, buf, pos)
+#define LOG_SUMMARY_TICK
+#endif // NO_WS_LOGGING
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// Binary Logging
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+#if defined(WS_BINARY_LOGGING) && !defined(NO_WS_LOGGING)
+#ifndef WS_BINARY_LOG_FORMATS
+#define WS_BINARY_LOG_FORMATS 256
+#endif // WS_BINARY_LOG_FORMATS
+
+#ifndef WS_BINARY_RECORD_SIZE
+#define WS_BINARY_RECORD_SIZE 512
+#endif // WS_BINARY_RECORD_SIZE
+
+#ifndef WS_BINARY_LOG_TIMESTAMP
+#ifdef _WIN32
+/**
+ * @internal
+ * @brief Monotonic timestamp in nanoseconds, used to stamp binary log records.
+ */
+uint64_t ws_internal_binaryTimestamp() {
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t) ((double) now.QuadPart * (1000000000.0 / (double) freq.QuadPart));
+}
+#else
+#include <time.h>
+/**
+ * @internal
+ * @brief Monotonic timestamp in nanoseconds, used to stamp binary log records.
+ */
+uint64_t ws_internal_binaryTimestamp() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+#endif // _WIN32
+#define WS_BINARY_LOG_TIMESTAMP() ws_internal_binaryTimestamp()
+#endif // WS_BINARY_LOG_TIMESTAMP
+
+#define WS_BINARY_MAGIC      "WSBL"
+#define WS_BINARY_VERSION    1
+#define WS_BINARY_BYTE_ORDER 0x01020304u
+#define WS_BINARY_FORMAT_DEF 'F'
+#define WS_BINARY_RECORD     'R'
+
+/* Argument kinds stored in a record. The value type is determined by the conversion and length modifier. */
+typedef enum {
+	WS_BINARY_ARG_NONE = 0,
+	WS_BINARY_ARG_INT,
+	WS_BINARY_ARG_UINT,
+	WS_BINARY_ARG_DOUBLE,
+	WS_BINARY_ARG_LONG_DOUBLE,
+	WS_BINARY_ARG_STRING,
+	WS_BINARY_ARG_POINTER,
+	WS_BINARY_ARG_COUNT
+} ws_internal_arg_kind_t;
+
+typedef struct {
+	ws_internal_arg_kind_t kind;
+	char length[3];        // Length modifier (hh, h, l, ll, j, z, t, L), '\0' terminated.
+	bool star_width;       // Width is passed as an int argument.
+	bool star_precision;   // Precision is passed as an int argument.
+	int precision;         // Precision if it's written in the format, -1 otherwise.
+	const char* start;     // Points at the '%'
+	size_t spec_len;       // Length of the whole specifier, including the '%'
+} ws_internal_conversion_t;
+
+/**
+ * @internal
+ * @brief Finds the next conversion specifier in a printf format string.
+ *
+ * Used by both the encoder and the decoder, so that they always agree on what arguments a format takes.
+ *
+ * @param format Format string, starting anywhere.
+ * @param conv Filled with the next conversion. Literal "%%" comes back as WS_BINARY_ARG_NONE.
+ * @return Pointer to the character after the conversion, or NULL if there are no more conversions.
+ */
+const char* ws_internal_nextConversion(const char* format, ws_internal_conversion_t* conv) {
+	const char* p = strchr(format, '%');
+	if (!p) return NULL;
+	memset(conv, 0, sizeof(ws_internal_conversion_t));
+	conv->start = p;
+	conv->precision = -1;
+	p++;
+
+	// Flags
+	while (*p && strchr("-+ #0", *p)) p++;
+	// Width
+	if (*p == '*') {
+		conv->star_width = true;
+		p++;
+	} else {
+		while (*p >= '0' && *p <= '9') p++;
+	}
+	// Precision
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			conv->star_precision = true;
+			p++;
+		} else {
+			conv->precision = 0;
+			while (*p >= '0' && *p <= '9') conv->precision = conv->precision * 10 + (*p++ - '0');
+		}
+	}
+	// Length modifier
+	size_t len = 0;
+	while (*p && len < 2 && strchr("hljztL", *p)) conv->length[len++] = *p++;
+	conv->length[len] = '\0';
+
+	switch (*p) {
+		case 'd':
+		case 'i': conv->kind = WS_BINARY_ARG_INT;
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'c': conv->kind = WS_BINARY_ARG_UINT;
+			break;
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A': conv->kind = (conv->length[0] == 'L') ? WS_BINARY_ARG_LONG_DOUBLE : WS_BINARY_ARG_DOUBLE;
+			break;
+		case 's': conv->kind = WS_BINARY_ARG_STRING;
+			break;
+		case 'p': conv->kind = WS_BINARY_ARG_POINTER;
+			break;
+		case 'n': conv->kind = WS_BINARY_ARG_COUNT;
+			break;
+		case '\0': return NULL; // Trailing '%', nothing to convert.
+		default: conv->kind = WS_BINARY_ARG_NONE; // "%%", or something we don't understand.
+			break;
+	}
+	p++;
+	conv->spec_len = (size_t) (p - conv->start);
+	return p;
+}
+
+/**
+ * @internal
+ * @brief Pulls a signed integer argument off the va_list using the right promoted type.
+ */
+int64_t ws_internal_vaSigned(const char* length, va_list* args) {
+	if (strcmp(length, "l") == 0) return va_arg(*args, long);
+	if (strcmp(length, "ll") == 0) return va_arg(*args, long long);
+	if (strcmp(length, "j") == 0) return va_arg(*args, intmax_t);
+	if (strcmp(length, "z") == 0) return (int64_t) va_arg(*args, size_t);
+	if (strcmp(length, "t") == 0) return va_arg(*args, ptrdiff_t);
+	return va_arg(*args, int);
+}
+
+/**
+ * @internal
+ * @brief Pulls an unsigned integer argument off the va_list using the right promoted type.
+ */
+uint64_t ws_internal_vaUnsigned(const char* length, va_list* args) {
+	if (strcmp(length, "l") == 0) return va_arg(*args, unsigned long);
+	if (strcmp(length, "ll") == 0) return va_arg(*args, unsigned long long);
+	if (strcmp(length, "j") == 0) return va_arg(*args, uintmax_t);
+	if (strcmp(length, "z") == 0) return va_arg(*args, size_t);
+	if (strcmp(length, "t") == 0) return (uint64_t) va_arg(*args, ptrdiff_t);
+	return va_arg(*args, unsigned int);
+}
+
+FILE* binary_log_stream = NULL;
+const char* binary_formats[WS_BINARY_LOG_FORMATS];
+uint32_t binary_format_ids[WS_BINARY_LOG_FORMATS];
+uint32_t binary_next_format_id = 0;
+#ifdef THREADED_SUPPORT
+ws_mutex_t* binary_log_mutex = NULL;
+#define LOCK_BINARY_LOG_MUTEX ws_lockMutex(binary_log_mutex)
+#define UNLOCK_BINARY_LOG_MUTEX ws_unlockMutex(binary_log_mutex)
+#else
+#define LOCK_BINARY_LOG_MUTEX
+#define UNLOCK_BINARY_LOG_MUTEX
+#endif // THREADED_SUPPORT
+
+/**
+ * @brief Starts writing binary log records to the provided stream.
+ *
+ * The stream should be opened in binary mode ("wb"). WallShell never closes it, that's left to the caller.
+ *
+ * @param stream Stream to write records to.
+ * @return WS_OUT_STREAM_NOT_SET if stream is NULL, WS_OUT_OF_MEMORY if the mutex couldn't be created. WS_NO_ERROR otherwise.
+ */
+ws_error_t ws_openBinaryLog(FILE* stream) {
+	if (!stream) return WS_OUT_STREAM_NOT_SET;
+#ifdef THREADED_SUPPORT
+	if (!binary_log_mutex) binary_log_mutex = ws_createMutex();
+	if (!binary_log_mutex) return WS_OUT_OF_MEMORY;
+#endif // THREADED_SUPPORT
+	LOCK_BINARY_LOG_MUTEX;
+	memset((void*) binary_formats, 0, sizeof(binary_formats));
+	binary_next_format_id = 0;
+	binary_log_stream = stream;
+
+	uint32_t byte_order = WS_BINARY_BYTE_ORDER;
+	uint8_t version = WS_BINARY_VERSION;
+	fwrite(WS_BINARY_MAGIC, 1, 4, stream);
+	fwrite(&version, 1, 1, stream);
+	fwrite(&byte_order, sizeof(byte_order), 1, stream);
+	UNLOCK_BINARY_LOG_MUTEX;
+	return WS_NO_ERROR;
+}
+
+/**
+ * @brief Stops writing binary log records, and flushes anything that's still buffered.
+ */
+void ws_closeBinaryLog() {
+#ifdef THREADED_SUPPORT
+	if (!binary_log_mutex) return;
+#endif // THREADED_SUPPORT
+	LOCK_BINARY_LOG_MUTEX;
+	if (binary_log_stream) fflush(binary_log_stream);
+	binary_log_stream = NULL;
+	UNLOCK_BINARY_LOG_MUTEX;
+}
+
+/**
+ * @internal
+ * @brief Finds the ID of a format string, writing its definition to the log the first time it's seen.
+ *
+ * Format strings are looked up by pointer, so string literals are only ever written once.
+ * Must be called with the binary log mutex held.
+ *
+ * @param format Format string of the record.
+ * @return The ID used to refer to this format in records.
+ */
+uint32_t ws_internal_binaryFormatID(const char* format) {
+	size_t slot = (size_t) (((uintptr_t) format >> 3) % WS_BINARY_LOG_FORMATS);
+	for (size_t i = 0; i < WS_BINARY_LOG_FORMATS; i++) {
+		size_t idx = (slot + i) % WS_BINARY_LOG_FORMATS;
+		if (binary_formats[idx] == format) return binary_format_ids[idx];
+		if (!binary_formats[idx]) {
+			binary_formats[idx] = format;
+			slot = idx;
+			break;
+		}
+	}
+	// If the table is full, the format just gets redefined with a new ID. It's bigger, but still correct.
+	uint32_t id = binary_next_format_id++;
+	if (binary_formats[slot] == format) binary_format_ids[slot] = id;
+
+	uint8_t tag = WS_BINARY_FORMAT_DEF;
+	uint32_t len = (uint32_t) strlen(format);
+	fwrite(&tag, 1, 1, binary_log_stream);
+	fwrite(&id, sizeof(id), 1, binary_log_stream);
+	fwrite(&len, sizeof(len), 1, binary_log_stream);
+	fwrite(format, 1, len, binary_log_stream);
+	return id;
+}
+
+/**
+ * @brief Binary logger. Records the raw arguments without formatting them.
+ *
+ * Use this for call sites where even formatting is too expensive.
+ * Records can be turned back into normal log lines later using @ref ws_decodeBinaryLog().
+ *
+ * @param type Type of logging.
+ * @param format printf style formatting string. Should be a string literal, it's identified by its address.
+ * @param args va_list of arguments.
+ */
+void ws_vbinaryLogger(ws_logtype_t type, const char* format, va_list args) {
+	if (type < log_level || !binary_log_stream) return;
+
+	// Record layout: tag, type, format id, timestamp, thread id, argument length, arguments.
+	uint8_t record[WS_BINARY_RECORD_SIZE];
+	size_t header = 1 + 1 + sizeof(uint32_t) + sizeof(uint64_t) * 2 + sizeof(uint32_t);
+	size_t pos = header;
+
+	va_list copy;
+	va_copy(copy, args);
+	ws_internal_conversion_t conv;
+	const char* next = format;
+	while ((next = ws_internal_nextConversion(next, &conv)) != NULL) {
+		if (conv.star_width) {
+			int32_t v = va_arg(copy, int);
+			if (pos + sizeof(v) > sizeof(record)) break;
+			memcpy(record + pos, &v, sizeof(v));
+			pos += sizeof(v);
+		}
+		if (conv.star_precision) {
+			int32_t v = va_arg(copy, int);
+			if (pos + sizeof(v) > sizeof(record)) break;
+			memcpy(record + pos, &v, sizeof(v));
+			pos += sizeof(v);
+			conv.precision = v;
+		}
+		switch (conv.kind) {
+			case WS_BINARY_ARG_INT: {
+					int64_t v = ws_internal_vaSigned(conv.length, &copy);
+					if (pos + sizeof(v) > sizeof(record)) goto full;
+					memcpy(record + pos, &v, sizeof(v));
+					pos += sizeof(v);
+					break;
+				}
+			case WS_BINARY_ARG_UINT: {
+					uint64_t v = ws_internal_vaUnsigned(conv.length, &copy);
+					if (pos + sizeof(v) > sizeof(record)) goto full;
+					memcpy(record + pos, &v, sizeof(v));
+					pos += sizeof(v);
+					break;
+				}
+			case WS_BINARY_ARG_DOUBLE: {
+					double v = va_arg(copy, double);
+					if (pos + sizeof(v) > sizeof(record)) goto full;
+					memcpy(record + pos, &v, sizeof(v));
+					pos += sizeof(v);
+					break;
+				}
+			case WS_BINARY_ARG_LONG_DOUBLE: {
+					long double v = va_arg(copy, long double);
+					if (pos + sizeof(v) > sizeof(record)) goto full;
+					memcpy(record + pos, &v, sizeof(v));
+					pos += sizeof(v);
+					break;
+				}
+			case WS_BINARY_ARG_POINTER: {
+					uint64_t v = (uint64_t) (uintptr_t) va_arg(copy, void*);
+					if (pos + sizeof(v) > sizeof(record)) goto full;
+					memcpy(record + pos, &v, sizeof(v));
+					pos += sizeof(v);
+					break;
+				}
+			case WS_BINARY_ARG_STRING: {
+					// Strings are the only thing copied by value, the pointer won't mean anything later.
+					size_t max = (conv.precision >= 0) ? (size_t) conv.precision : SIZE_MAX;
+					uint32_t len = 0;
+					if (pos + sizeof(len) > sizeof(record)) goto full;
+					size_t room = sizeof(record) - pos - sizeof(len);
+					uint8_t* dst = record + pos + sizeof(len);
+					if (conv.length[0] == 'l') {
+						// Wide strings are stored narrowed, anything outside ASCII becomes '?'.
+						const wchar_t* str = va_arg(copy, const wchar_t*);
+						if (!str) str = L"(null)";
+						for (; len < max && len < room && str[len]; len++) {
+							dst[len] = (str[len] > 0 && str[len] < 0x80) ? (uint8_t) str[len] : '?';
+						}
+					} else {
+						const char* str = va_arg(copy, const char*);
+						if (!str) str = "(null)";
+						while (len < max && str[len]) len++;
+						// Strings that don't fit are cut short rather than dropping the whole record.
+						if (len > room) len = (uint32_t) room;
+						memcpy(dst, str, len);
+					}
+					memcpy(record + pos, &len, sizeof(len));
+					pos += sizeof(len) + len;
+					break;
+				}
+			case WS_BINARY_ARG_COUNT: (void) va_arg(copy, void*);
+				break;
+			default: break;
+		}
+	}
+full:
+	va_end(copy);
+
+	uint64_t timestamp = WS_BINARY_LOG_TIMESTAMP();
+#ifdef THREADED_SUPPORT
+	uint64_t thread = (uint64_t) ws_getThreadID();
+#else
+	uint64_t thread = 0;
+#endif // THREADED_SUPPORT
+	uint32_t args_len = (uint32_t) (pos - header);
+
+	LOCK_BINARY_LOG_MUTEX;
+	if (!binary_log_stream) {
+		UNLOCK_BINARY_LOG_MUTEX;
+		return;
+	}
+	uint32_t id = ws_internal_binaryFormatID(format);
+	size_t off = 0;
+	record[off++] = WS_BINARY_RECORD;
+	record[off++] = (uint8_t) type;
+	memcpy(record + off, &id, sizeof(id));
+	off += sizeof(id);
+	memcpy(record + off, &timestamp, sizeof(timestamp));
+	off += sizeof(timestamp);
+	memcpy(record + off, &thread, sizeof(thread));
+	off += sizeof(thread);
+	memcpy(record + off, &args_len, sizeof(args_len));
+	fwrite(record, 1, pos, binary_log_stream);
+	UNLOCK_BINARY_LOG_MUTEX;
+}
+
+/**
+ * @brief Binary logger. Records the raw arguments without formatting them.
+ * @param type Type of logging.
+ * @param format printf style formatting string. Should be a string literal, it's identified by its address.
+ * @param ... printf style formatting arguments.
+ */
+void ws_binaryLogger(ws_logtype_t type, const char* format, ...) {
+	if (type < log_level || !binary_log_stream) return;
+	va_list args;
+	va_start(args, format);
+	ws_vbinaryLogger(type, format, args);
+	va_end(args);
+}
+
+/**
+ * @internal
+ * @brief Reads exactly `size` bytes from the record buffer, failing if the record is too short.
+ */
+bool ws_internal_readArg(const uint8_t* buf, size_t len, size_t* pos, void* out, size_t size) {
+	if (*pos + size > len) return false;
+	memcpy(out, buf + *pos, size);
+	*pos += size;
+	return true;
+}
+
+/**
+ * @internal
+ * @brief Formats a single decoded record, walking the format string the same way the encoder did.
+ */
+void ws_internal_decodeRecord(FILE* out, const char* format, const uint8_t* args, size_t len) {
+	ws_internal_conversion_t conv;
+	const char* literal = format;
+	const char* next = format;
+	size_t pos = 0;
+	char spec[64];
+
+	while ((next = ws_internal_nextConversion(next, &conv)) != NULL) {
+		fwrite(literal, 1, (size_t) (conv.start - literal), out);
+		literal = next;
+		if (conv.kind == WS_BINARY_ARG_NONE) {
+			if (conv.start[conv.spec_len - 1] == '%') fputc('%', out);
+			continue;
+		}
+		if (conv.kind == WS_BINARY_ARG_COUNT) continue;
+
+		// Rebuild the specifier with any '*' replaced by the recorded value.
+		int32_t width = 0, precision = 0;
+		if (conv.star_width && !ws_internal_readArg(args, len, &pos, &width, sizeof(width))) return;
+		if (conv.star_precision && !ws_internal_readArg(args, len, &pos, &precision, sizeof(precision))) return;
+		size_t s = 0;
+		for (size_t i = 0; i < conv.spec_len && s < sizeof(spec) - 24; i++) {
+			if (conv.start[i] == '*') {
+				int32_t v = (conv.star_width && (i == 0 || conv.start[i - 1] != '.')) ? width : precision;
+				s += (size_t) sprintf(spec + s, "%d", (int) v);
+			} else {
+				spec[s++] = conv.start[i];
+			}
+		}
+		spec[s] = '\0';
+
+		switch (conv.kind) {
+			case WS_BINARY_ARG_INT: {
+					int64_t v;
+					if (!ws_internal_readArg(args, len, &pos, &v, sizeof(v))) return;
+					if (strcmp(conv.length, "l") == 0) fprintf(out, spec, (long) v);
+					else if (strcmp(conv.length, "ll") == 0) fprintf(out, spec, (long long) v);
+					else if (strcmp(conv.length, "j") == 0) fprintf(out, spec, (intmax_t) v);
+					else if (strcmp(conv.length, "z") == 0) fprintf(out, spec, (size_t) v);
+					else if (strcmp(conv.length, "t") == 0) fprintf(out, spec, (ptrdiff_t) v);
+					else fprintf(out, spec, (int) v);
+					break;
+				}
+			case WS_BINARY_ARG_UINT: {
+					uint64_t v;
+					if (!ws_internal_readArg(args, len, &pos, &v, sizeof(v))) return;
+					if (strcmp(conv.length, "l") == 0) fprintf(out, spec, (unsigned long) v);
+					else if (strcmp(conv.length, "ll") == 0) fprintf(out, spec, (unsigned long long) v);
+					else if (strcmp(conv.length, "j") == 0) fprintf(out, spec, (uintmax_t) v);
+					else if (strcmp(conv.length, "z") == 0) fprintf(out, spec, (size_t) v);
+					else if (strcmp(conv.length, "t") == 0) fprintf(out, spec, (ptrdiff_t) v);
+					else fprintf(out, spec, (unsigned int) v);
+					break;
+				}
+			case WS_BINARY_ARG_DOUBLE: {
+					double v;
+					if (!ws_internal_readArg(args, len, &pos, &v, sizeof(v))) return;
+					fprintf(out, spec, v);
+					break;
+				}
+			case WS_BINARY_ARG_LONG_DOUBLE: {
+					long double v;
+					if (!ws_internal_readArg(args, len, &pos, &v, sizeof(v))) return;
+					fprintf(out, spec, v);
+					break;
+				}
+			case WS_BINARY_ARG_POINTER: {
+					uint64_t v;
+					if (!ws_internal_readArg(args, len, &pos, &v, sizeof(v))) return;
+					fprintf(out, spec, (void*) (uintptr_t) v);
+					break;
+				}
+			case WS_BINARY_ARG_STRING: {
+					uint32_t slen;
+					if (!ws_internal_readArg(args, len, &pos, &slen, sizeof(slen))) return;
+					if (pos + slen > len) return;
+					// The string isn't terminated in the record, so it's always printed with an explicit precision.
+					// Keep the flags and width, drop the original precision and length modifier.
+					size_t w = 0;
+					while (w < s && spec[w] != '.' && !strchr("hljztLs", spec[w])) w++;
+					spec[w] = '\0';
+					strcat(spec, ".*s");
+					int32_t limit = conv.star_precision ? precision : conv.precision;
+					uint32_t shown = (limit >= 0 && (uint32_t) limit < slen) ? (uint32_t) limit : slen;
+					fprintf(out, spec, (int) shown, (const char*) (args + pos));
+					pos += slen;
+					break;
+				}
+			default: break;
+		}
+	}
+	fputs(literal, out);
+}
+
+/**
+ * @brief Turns a binary log back into normal log lines.
+ *
+ * Each record is printed the same way @ref ws_logger() would have, without colors.
+ *
+ * @param in Stream containing the binary log, opened in binary mode.
+ * @param out Stream to write the formatted lines to.
+ * @return WS_WS_SETUP_ERROR if the log is malformed or was written on a machine with a different byte order,
+ * WS_OUT_OF_MEMORY if the format table couldn't be allocated. WS_NO_ERROR otherwise.
+ */
+ws_error_t ws_decodeBinaryLog(FILE* in, FILE* out) {
+	char magic[4];
+	uint8_t version;
+	uint32_t byte_order;
+	if (fread(magic, 1, 4, in) != 4 || memcmp(magic, WS_BINARY_MAGIC, 4) != 0) return WS_WS_SETUP_ERROR;
+	if (fread(&version, 1, 1, in) != 1 || version != WS_BINARY_VERSION) return WS_WS_SETUP_ERROR;
+	if (fread(&byte_order, sizeof(byte_order), 1, in) != 1 || byte_order != WS_BINARY_BYTE_ORDER) return WS_WS_SETUP_ERROR;
+
+	static const char* tags[] = { "[LOG]  ", "[DEBUG]", "[INFO] ", "[WARN] ", "[ERROR]", "[FATAL]" };
+	char** formats = NULL;
+	size_t formats_size = 0;
+	ws_error_t ret = WS_NO_ERROR;
+	uint8_t args[WS_BINARY_RECORD_SIZE];
+
+	int tag;
+	while ((tag = fgetc(in)) != EOF) {
+		if (tag == WS_BINARY_FORMAT_DEF) {
+			uint32_t id, len;
+			if (fread(&id, sizeof(id), 1, in) != 1 || fread(&len, sizeof(len), 1, in) != 1) goto malformed;
+			if (id >= formats_size) {
+				size_t new_size = formats_size ? formats_size * 2 : 64;
+				while (new_size <= id) new_size *= 2;
+				char** new_ptr = realloc(formats, new_size * sizeof(char*));
+				if (!new_ptr) {
+					ret = WS_OUT_OF_MEMORY;
+					goto cleanup;
+				}
+				memset(new_ptr + formats_size, 0, (new_size - formats_size) * sizeof(char*));
+				formats = new_ptr;
+				formats_size = new_size;
+			}
+			char* str = malloc(len + 1);
+			if (!str) {
+				ret = WS_OUT_OF_MEMORY;
+				goto cleanup;
+			}
+			if (fread(str, 1, len, in) != len) {
+				free(str);
+				goto malformed;
+			}
+			str[len] = '\0';
+			free(formats[id]);
+			formats[id] = str;
+		} else if (tag == WS_BINARY_RECORD) {
+			uint8_t type;
+			uint32_t id, args_len;
+			uint64_t timestamp, thread;
+			if (fread(&type, 1, 1, in) != 1) goto malformed;
+			if (fread(&id, sizeof(id), 1, in) != 1) goto malformed;
+			if (fread(&timestamp, sizeof(timestamp), 1, in) != 1) goto malformed;
+			if (fread(&thread, sizeof(thread), 1, in) != 1) goto malformed;
+			if (fread(&args_len, sizeof(args_len), 1, in) != 1 || args_len > sizeof(args)) goto malformed;
+			if (fread(args, 1, args_len, in) != args_len) goto malformed;
+			if (id >= formats_size || !formats[id] || type > WS_FATAL) goto malformed;
+
+			fprintf(out, "%s", tags[type]);
+#ifdef THREADED_SUPPORT
+			fprintf(out, "[%llu]", (unsigned long long) thread);
+#endif // THREADED_SUPPORT
+			fprintf(out, " ");
+			ws_internal_decodeRecord(out, formats[id], args, args_len);
+			fprintf(out, "\n");
+		} else {
+			goto malformed;
+		}
+	}
+	goto cleanup;
+
+malformed:
+	ret = WS_WS_SETUP_ERROR;
+cleanup:
+	for (size_t i = 0; i < formats_size; i++) free(formats[i]);
+	free(formats);
+	return ret;
+}
+
+/**
+ * @internal
+ * @brief Resets all binary logging variables.
+ */
+void ws_internal_cleanBinaryLog() {
+	ws_closeBinaryLog();
+#ifdef THREADED_SUPPORT
+	if (binary_log_mutex) ws_destroyMutex(binary_log_mutex);
+	binary_log_mutex = NULL;
+#endif // THREADED_SUPPORT
+	memset((void*) binary_formats, 0, sizeof(binary_formats));
+	binary_next_format_id = 0;
+}
+#endif // WS_BINARY_LOGGING
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// Argument Schemas
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+#include <errno.h>
+
+/*
+ * Lookup tables for a schema. Built when its command is registered and kept next to the command in the registry,
+ * so schemas belong to the user and can be const.
+ */
+typedef struct ws_arg_index {
+	unsigned char short_lookup[128];                 // Option index + 1 by short name, so 0 can mean "none".
+	unsigned char long_order[WS_SCHEMA_MAX_OPTIONS]; // Option indexes, sorted by long name.
+	size_t long_count;
+} ws_arg_index_t;
+
+/**
+ * @internal
+ * @brief Compares the first len characters of key against a whole option name, the same way strcmp would.
+ */
+int ws_internal_compareOptionName(const char* key, size_t len, const char* name) {
+	int c = strncmp(key, name, len);
+	if (c != 0) return c;
+	return name[len] == '\0' ? 0 : -1;
+}
+
+/**
+ * @internal
+ * @brief Finds an option by its long name, with a binary search over the schema's sorted names.
+ * @param name Name to look for, without the leading "--". Doesn't have to be null terminated.
+ * @param len Length of the name.
+ * @return Index of the option in the schema, or -1.
+ */
+int ws_internal_findLongOption(const ws_arg_schema_t* schema, const ws_arg_index_t* index, const char* name, size_t len) {
+	size_t low = 0;
+	size_t high = index->long_count;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		int c = ws_internal_compareOptionName(name, len, schema->options[index->long_order[mid]].name);
+		if (c == 0) return index->long_order[mid];
+		if (c < 0) high = mid;
+		else low = mid + 1;
+	}
+	return -1;
+}
+
+/**
+ * @internal
+ * @brief Checks a schema, and builds its lookup tables.
+ *
+ * Short names go in a table indexed by the character. Long names are sorted, so they can be binary searched.
+ * Both hold option indexes, with short_lookup offset by one so 0 can mean "none".
+ *
+ * @param index Filled with the lookup tables.
+ * @return WS_INVALID_SCHEMA if the schema breaks a rule, like duplicate names or a missing handler.
+ */
+ws_error_t ws_internal_compileSchema(const ws_arg_schema_t* schema, ws_arg_index_t* index) {
+	if (!schema->handler || schema->options_count > WS_SCHEMA_MAX_OPTIONS ||
+		schema->positionals_count > WS_SCHEMA_MAX_POSITIONALS) {
+		return WS_INVALID_SCHEMA;
+	}
+
+	memset(index->short_lookup, 0, sizeof(index->short_lookup));
+	size_t long_count = 0;
+	for (size_t i = 0; i < schema->options_count; i++) {
+		const ws_arg_option_t* option = &schema->options[i];
+		unsigned char c = (unsigned char) option->shortName;
+		if (!option->name && !c) return WS_INVALID_SCHEMA;
+		if (c) {
+			// '-' would make "--" ambiguous, and '=' separates values.
+			if (c >= 128 || c <= ' ' || c == '-' || c == '=' || index->short_lookup[c]) return WS_INVALID_SCHEMA;
+			index->short_lookup[c] = (unsigned char) (i + 1);
+		}
+		if (option->name) {
+			// Schemas are small, so an insertion sort is plenty.
+			size_t j = long_count++;
+			while (j > 0 && strcmp(schema->options[index->long_order[j - 1]].name, option->name) > 0) {
+				index->long_order[j] = index->long_order[j - 1];
+				j--;
+			}
+			if (j > 0 && strcmp(schema->options[index->long_order[j - 1]].name, option->name) == 0) return WS_INVALID_SCHEMA;
+			index->long_order[j] = (unsigned char) i;
+		}
+	}
+
+	bool optional_seen = false;
+	for (size_t i = 0; i < schema->positionals_count; i++) {
+		const ws_arg_positional_t* positional = &schema->positionals[i];
+		if (!positional->name || positional->type == WS_ARG_FLAG) return WS_INVALID_SCHEMA;
+		if (positional->required && optional_seen) return WS_INVALID_SCHEMA;
+		optional_seen = !positional->required;
+	}
+	index->long_count = long_count;
+	return WS_NO_ERROR;
+}
+
+/**
+ * @internal
+ * @brief Prints the usage line of a schema, e.g. `Usage: copy [options] <from> <to> [...]`.
+ */
+void ws_internal_printUsage(const char* commandName, const ws_arg_schema_t* schema) {
+	fprintf(ws_out_stream, "Usage: %s", commandName);
+	if (schema->options_count > 0) fprintf(ws_out_stream, " [options]");
+	for (size_t i = 0; i < schema->positionals_count; i++) {
+		const ws_arg_positional_t* positional = &schema->positionals[i];
+		fprintf(ws_out_stream, positional->required ? " <%s>" : " [%s]", positional->name);
+	}
+	if (schema->variadic) fprintf(ws_out_stream, " [...]");
+	fprintf(ws_out_stream, "\n");
+}
+
+/**
+ * @internal
+ * @brief Prints a problem with a command's arguments, followed by its usage.
+ * @return false, so parsing can return it directly.
+ */
+bool ws_internal_argError(const ws_args_t* args, const char* format, ...) {
+	ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
+	va_list list;
+	va_start(list, format);
+	vfprintf(ws_out_stream, format, list);
+	va_end(list);
+	fprintf(ws_out_stream, "\n");
+	ws_setConsoleColors(ws_getDefaultColors());
+	ws_internal_printUsage(args->command, args->schema);
+	return false;
+}
+
+/**
+ * @internal
+ * @brief Converts and stores the value of an option or positional.
+ * @param what How the argument is shown in errors, e.g. "--count".
+ * @return false if the value isn't valid for its type.
+ */
+bool ws_internal_setArgValue(const ws_args_t* args, ws_arg_value_t* out, ws_arg_type_t type, const char* value, const char* what) {
+	char* end = NULL;
+	errno = 0;
+	switch (type) {
+		case WS_ARG_INT:
+			out->integer = strtol(value, &end, 10);
+			if (end == value || *end != '\0' || errno == ERANGE) {
+				return ws_internal_argError(args, "%s expects a whole number, got \"%s\".", what, value);
+			}
+			break;
+		case WS_ARG_DOUBLE:
+			out->number = strtod(value, &end);
+			if (end == value || *end != '\0' || errno == ERANGE) {
+				return ws_internal_argError(args, "%s expects a number, got \"%s\".", what, value);
+			}
+			break;
+		default: break;
+	}
+	out->present = true;
+	out->count++;
+	out->string = value;
+	return true;
+}
+
+/**
+ * @internal
+ * @brief Parses a command's arguments with its schema. Anything wrong is printed.
+ *
+ * Options can be given as `--name value`, `--name=value`, `-c value`, or `-cvalue`, and flags can be bundled as `-abc`.
+ * Everything after `--` is positional. So is anything that looks like a negative number, unless it's a short option.
+ * With a variadic schema, extra positionals are moved to the front of argv, right after the command name.
+ *
+ * @return false if the arguments don't match the schema.
+ */
+bool ws_internal_parseArgs(const ws_arg_schema_t* schema, const ws_arg_index_t* index, int argc, char** argv, ws_args_t* args) {
+	memset(args, 0, sizeof(ws_args_t));
+	args->schema = schema;
+	args->index = index;
+	args->command = argv[0];
+	char what[64];
+	size_t positional = 0;
+	int rest_end = 1;
+	bool options_done = false;
+
+	for (int i = 1; i < argc; i++) {
+		char* arg = argv[i];
+		if (!options_done && arg[0] == '-' && arg[1] == '-') {
+			if (arg[2] == '\0') {
+				options_done = true;
+				continue;
+			}
+			const char* name = arg + 2;
+			const char* equals = strchr(name, '=');
+			size_t len = equals ? (size_t) (equals - name) : strlen(name);
+			snprintf(what, sizeof(what), "--%.*s", (int) len, name);
+			int found = ws_internal_findLongOption(schema, index, name, len);
+			if (found < 0) return ws_internal_argError(args, "Unknown option: %s", what);
+
+			const ws_arg_option_t* option = &schema->options[found];
+			const char* value = NULL;
+			if (option->type == WS_ARG_FLAG) {
+				if (equals) return ws_internal_argError(args, "%s doesn't take a value.", what);
+			} else {
+				value = equals ? equals + 1 : (i + 1 < argc ? argv[++i] : NULL);
+				if (!value) return ws_internal_argError(args, "%s needs a value.", what);
+			}
+			if (!ws_internal_setArgValue(args, &args->options[found], option->type, value, what)) return false;
+			continue;
+		}
+
+		unsigned char first = (unsigned char) arg[1];
+		bool negative_number = ((first >= '0' && first <= '9') || first == '.') && !index->short_lookup[first];
+		if (!options_done && arg[0] == '-' && first != '\0' && !negative_number) {
+			for (const char* c = arg + 1; *c; c++) {
+				unsigned char ch = (unsigned char) *c;
+				int found = ch < 128 ? index->short_lookup[ch] - 1 : -1;
+				snprintf(what, sizeof(what), "-%c", *c);
+				if (found < 0) return ws_internal_argError(args, "Unknown option: %s", what);
+
+				const ws_arg_option_t* option = &schema->options[found];
+				if (option->type == WS_ARG_FLAG) {
+					if (!ws_internal_setArgValue(args, &args->options[found], option->type, NULL, what)) return false;
+					continue;
+				}
+				// The rest of this argument is the value, or the next argument if there's nothing left.
+				const char* value = c[1] ? c + 1 : (i + 1 < argc ? argv[++i] : NULL);
+				if (!value) return ws_internal_argError(args, "%s needs a value.", what);
+				if (!ws_internal_setArgValue(args, &args->options[found], option->type, value, what)) return false;
+				break;
+			}
+			continue;
+		}
+
+		if (positional < schema->positionals_count) {
+			const ws_arg_positional_t* declared = &schema->positionals[positional];
+			snprintf(what, sizeof(what), "<%s>", declared->name);
+			if (!ws_internal_setArgValue(args, &args->positionals[positional], declared->type, arg, what)) return false;
+			positional++;
+		} else if (schema->variadic) {
+			// Swapped rather than overwritten, so argv still holds every string it started with and can be freed.
+			argv[i] = argv[rest_end];
+			argv[rest_end++] = arg;
+			args->rest_count++;
+		} else {
+			return ws_internal_argError(args, "Unexpected argument: \"%s\"", arg);
+		}
+	}
+
+	if (positional < schema->positionals_count && schema->positionals[positional].required) {
+		return ws_internal_argError(args, "Missing argument: <%s>", schema->positionals[positional].name);
+	}
+	if (args->rest_count > 0) args->rest = argv + 1;
+	return true;
+}
+
+/**
+ * @internal
+ * @brief Runs a command that has a schema, handing its handler the parsed arguments.
+ * @return What the handler returned, or 2 if the arguments didn't match the schema.
+ */
+int ws_internal_runSchema(const ws_arg_schema_t* schema, const ws_arg_index_t* index, int argc, char** argv) {
+	ws_args_t args;
+	if (!ws_internal_parseArgs(schema, index, argc, argv, &args)) return 2;
+	return schema->handler(&args);
+}
+
+/**
+ * @brief Gets the value of an option by its long name, from inside a schema's handler.
+ * @param args Arguments the handler was given.
+ * @param name Long name of the option, without the leading "--".
+ * @return The value, or NULL if the schema has no such option. Check `present` to see if it was given.
+ */
+const ws_arg_value_t* ws_getOption(const ws_args_t* args, const char* name) {
+	int index = ws_internal_findLongOption(args->schema, args->index, name, strlen(name));
+	return index < 0 ? NULL : &args->options[index];
+}
+
+/**
+ * @internal
+ * @brief Formats how an option is shown in help, e.g. `-c, --count <n>`. Options without a short name are indented to match.
+ * @return Length of the text, which may have been truncated.
+ */
+int ws_internal_formatOption(char* buf, size_t size, const ws_arg_option_t* option) {
+	char names[64];
+	if (option->shortName && option->name) snprintf(names, sizeof(names), "-%c, --%s", option->shortName, option->name);
+	else if (option->shortName) snprintf(names, sizeof(names), "-%c", option->shortName);
+	else snprintf(names, sizeof(names), "    --%s", option->name);
+	if (option->type == WS_ARG_FLAG) return snprintf(buf, size, "%s", names);
+	return snprintf(buf, size, "%s <%s>", names, option->valueName ? option->valueName : "value");
+}
+
+/**
+ * @brief Prints help generated from a schema: its description, usage, arguments and options.
+ *
+ * `help <command>` uses this for commands that have a schema, but no help function.
+ *
+ * @param commandName Name to show in the help.
+ * @param schema Schema to describe.
+ */
+void ws_printSchemaHelp(const char* commandName, const ws_arg_schema_t* schema) {
+	ws_setConsoleColors((ws_color_t) { WS_FG_RED, WS_BG_DEFAULT });
+	fprintf(ws_out_stream, "\n%s\n", commandName);
+	ws_setConsoleColors((ws_color_t) { WS_FG_CYAN, WS_BG_DEFAULT });
+	if (schema->description) fprintf(ws_out_stream, "%s\n", schema->description);
+	ws_setConsoleColors((ws_color_t) { WS_FG_DEFAULT, WS_BG_DEFAULT });
+	ws_internal_printUsage(commandName, schema);
+
+	// Everything is lined up on the longest argument.
+	char left[96];
+	int width = 0;
+	for (size_t i = 0; i < schema->positionals_count; i++) {
+		int len = snprintf(left, sizeof(left), "<%s>", schema->positionals[i].name);
+		if (len > width) width = len;
+	}
+	for (size_t i = 0; i < schema->options_count; i++) {
+		int len = ws_internal_formatOption(left, sizeof(left), &schema->options[i]);
+		if (len > width) width = len;
+	}
+	if (width > (int) sizeof(left) - 1) width = (int) sizeof(left) - 1;
+
+	if (schema->positionals_count > 0) {
+		ws_setConsoleColors((ws_color_t) { WS_FG_YELLOW, WS_BG_DEFAULT });
+		fprintf(ws_out_stream, "\nArguments:\n");
+		ws_setConsoleColors((ws_color_t) { WS_FG_GREEN, WS_BG_DEFAULT });
+		for (size_t i = 0; i < schema->positionals_count; i++) {
+			const ws_arg_positional_t* positional = &schema->positionals[i];
+			snprintf(left, sizeof(left), "<%s>", positional->name);
+			fprintf(ws_out_stream, "  %-*s  %s%s\n", width, left, positional->required ? "" : "(Optional) ",
+					positional->description ? positional->description : "");
+		}
+	}
+
+	if (schema->options_count > 0) {
+		ws_setConsoleColors((ws_color_t) { WS_FG_YELLOW, WS_BG_DEFAULT });
+		fprintf(ws_out_stream, "\nOptions:\n");
+		ws_setConsoleColors((ws_color_t) { WS_FG_GREEN, WS_BG_DEFAULT });
+		for (size_t i = 0; i < schema->options_count; i++) {
+			const ws_arg_option_t* option = &schema->options[i];
+			ws_internal_formatOption(left, sizeof(left), option);
+			fprintf(ws_out_stream, "  %-*s  %s\n", width, left, option->description ? option->description : "");
+		}
+	}
+	ws_setConsoleColors((ws_color_t) { WS_FG_DEFAULT, WS_BG_DEFAULT });
+	fprintf(ws_out_stream, "\n");
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// Register Command & Internal Commands
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+
+/*
+ * The registry is a snapshot that's never changed once published. Registering or deregistering builds a
+ * new snapshot, publishes it, and frees the old one after every reader that could still see it is done.
+ * Lookups never lock, so commands can be (de)registered from any thread while the terminal is running.
+ *
+ * Subcommands live in the same list as every other command, and point back at the command they belong to.
+ * That makes the commands a tree, with the top level commands as its roots.
+ */
+
+// Parent of a top level command.
+#define WS_NO_PARENT ((size_t) -1)
+
+#ifdef DISABLE_MALLOC
+typedef struct {
+	size_t count;
+	ws_command_t commands[COMMAND_LIMIT];
+	// Lookup tables of each command's schema. Only set for commands that have one.
+	ws_arg_index_t indexes[COMMAND_LIMIT];
+	// Index of each command's parent, or WS_NO_PARENT. A parent always comes before its subcommands.
+	size_t parents[COMMAND_LIMIT];
+} ws_command_snapshot_t;
+
+ws_command_snapshot_t command_registry;
+// Where each command moves to while deregistering. Nothing here is threaded, so one is enough.
+size_t registry_remap[COMMAND_LIMIT];
+#else
+/*
+ * One for every name and alias, sorted by parent, then name, then the command's index.
+ * The subcommands of a command are next to each other, so a name is found with a binary search on every level.
+ */
+typedef struct {
+	size_t parent;
+	const char* name;
+	size_t command;
+} ws_command_key_t;
+
+typedef struct {
+	size_t count;
+	// Lookup tables of each command's schema. Only set for commands that have one.
+	ws_arg_index_t* indexes;
+	// Index of each command's parent, or WS_NO_PARENT. A parent always comes before its subcommands.
+	size_t* parents;
+	size_t key_count;
+	ws_command_key_t* keys;
+	// indexes, parents and keys are part of the same allocation, right after the commands.
+	ws_command_t commands[];
+} ws_command_snapshot_t;
+
+// Published while nothing is registered, so readers never see NULL. It's never freed.
+ws_command_snapshot_t empty_registry = { 0 };
+
+#ifdef THREADED_SUPPORT
+ws_atomic_ptr_t command_registry = WS_ATOMIC_INIT(&empty_registry);
+ws_atomic_int_t registry_epoch = WS_ATOMIC_INIT(0);
+ws_atomic_int_t registry_readers[2] = { WS_ATOMIC_INIT(0), WS_ATOMIC_INIT(0) };
+#else
+ws_command_snapshot_t* command_registry = &empty_registry;
+#endif // THREADED_SUPPORT
+#endif // DISABLE_MALLOC
+
+#ifdef THREADED_SUPPORT
+// Serializes writers only. Readers go through the epoch counters instead.
+// Created on first use, the same way as the color mutex, since the first registrations can race each other.
+ws_atomic_ptr_t registry_mutex = WS_ATOMIC_INIT(NULL);
+void ws_internal_registry_mutex_check() {
+	if (ws_getAtomicPtr(&registry_mutex)) return;
+	ws_mutex_t* created = ws_createMutex();
+	if (!created) return;
+	void* expected = NULL;
+	if (!ws_compareExchangeAtomicPtr(&registry_mutex, &expected, created)) ws_destroyMutex(created);
+}
+#define REGISTRY_MUTEX_CHECK ws_internal_registry_mutex_check()
+#define LOCK_REGISTRY_MUTEX ws_lockMutex((ws_mutex_t*) ws_getAtomicPtr(&registry_mutex))
+#define UNLOCK_REGISTRY_MUTEX ws_unlockMutex((ws_mutex_t*) ws_getAtomicPtr(&registry_mutex))
+#else
+#define REGISTRY_MUTEX_CHECK
+#define LOCK_REGISTRY_MUTEX
+#define UNLOCK_REGISTRY_MUTEX
+#endif // THREADED_SUPPORT
+
+// Sessions share the basic commands, so only the first terminal to start registers them.
+#ifdef THREADED_SUPPORT
+ws_atomic_int_t basic_commands_registered = WS_ATOMIC_INIT(0);
+#else
+bool basic_commands_registered = false;
+#endif // THREADED_SUPPORT
+
+/**
+ * @internal
+ * @brief Enters a read section and returns the current registry snapshot.
+ * @param epoch Set to the epoch that has to be passed to ws_internal_releaseCommands.
+ * @return The snapshot. It stays valid until ws_internal_releaseCommands is called, so don't run commands while holding it.
+ */
+ws_command_snapshot_t* ws_internal_acquireCommands(int* epoch) {
+	*epoch = 0;
+#ifdef DISABLE_MALLOC
+	return &command_registry;
+#elif defined(THREADED_SUPPORT)
+	for (;;) {
+		int e = (int) ws_getAtomicInt(&registry_epoch);
+		ws_addAtomicInt(&registry_readers[e], 1);
+		// If a writer flipped the epoch in between, it might not wait for this counter, so try again.
+		if (ws_getAtomicInt(&registry_epoch) == e) {
+			*epoch = e;
+			return (ws_command_snapshot_t*) ws_getAtomicPtr(&command_registry);
+		}
+		ws_addAtomicInt(&registry_readers[e], -1);
+	}
+#else
+	return command_registry;
+#endif
+}
+
+/**
+ * @internal
+ * @brief Leaves a read section entered with ws_internal_acquireCommands.
+ */
+void ws_internal_releaseCommands(int epoch) {
+#if defined(THREADED_SUPPORT) && !defined(DISABLE_MALLOC)
+	ws_addAtomicInt(&registry_readers[epoch], -1);
+#else
+	(void) epoch;
+#endif
+}
+
+#ifndef DISABLE_MALLOC
+/**
+ * @internal
+ * @brief Publishes a new snapshot, waits until no reader can still see the old one, then frees it.
+ * Must be called with the registry mutex held.
+ */
+void ws_internal_publishCommands(ws_command_snapshot_t* snapshot) {
+#ifdef THREADED_SUPPORT
+	ws_command_snapshot_t* old = ws_exchangeAtomicPtr(&command_registry, snapshot);
+	// Readers that enter from now on use the new epoch and see the new snapshot.
+	// Anyone still counted in the old epoch may hold the old snapshot, so wait for them.
+	long e = ws_getAtomicInt(&registry_epoch);
+	ws_setAtomicInt(&registry_epoch, !e);
+	while (ws_getAtomicInt(&registry_readers[e]) != 0) ws_sleep(0);
+#else
+	ws_command_snapshot_t* old = command_registry;
+	command_registry = snapshot;
+#endif // THREADED_SUPPORT
+	if (old != &empty_registry) free(old);
+}
+
+/**
+ * @internal
+ * @brief Allocates a snapshot with room for count commands and key_count keys. Only the counts and pointers are set.
+ * @return The snapshot, or NULL if malloc did.
+ */
+ws_command_snapshot_t* ws_internal_allocateCommands(size_t count, size_t key_count) {
+	ws_command_snapshot_t* snapshot = malloc(sizeof(ws_command_snapshot_t) + count * sizeof(ws_command_t)
+											 + count * sizeof(ws_arg_index_t) + count * sizeof(size_t)
+											 + key_count * sizeof(ws_command_key_t));
+	if (!snapshot) return NULL;
+	snapshot->count = count;
+	snapshot->indexes = (ws_arg_index_t*) &snapshot->commands[count];
+	snapshot->parents = (size_t*) &snapshot->indexes[count];
+	snapshot->key_count = key_count;
+	snapshot->keys = (ws_command_key_t*) &snapshot->parents[count];
+	return snapshot;
+}
+
+/**
+ * @internal
+ * @brief Orders a parent and name against a key, ignoring the key's command.
+ */
+int ws_internal_compareKey(size_t parent, const char* name, const ws_command_key_t* key) {
+	if (parent != key->parent) return parent < key->parent ? -1 : 1;
+	return strcmp(name, key->name);
+}
+
+/**
+ * @internal
+ * @brief Finds the first key that isn't ordered before parent and name.
+ */
+size_t ws_internal_lowerKey(const ws_command_snapshot_t* snapshot, size_t parent, const char* name) {
+	size_t low = 0;
+	size_t high = snapshot->key_count;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		if (ws_internal_compareKey(parent, name, &snapshot->keys[mid]) > 0) low = mid + 1;
+		else high = mid;
+	}
+	return low;
+}
+
+/**
+ * @internal
+ * @brief Inserts a key for the newest command, after any equal ones, so the earliest registered command still wins.
+ * @param count How many keys are in the array. Incremented.
+ */
+void ws_internal_insertKey(ws_command_key_t* keys, size_t* count, ws_command_key_t key) {
+	size_t low = 0;
+	size_t high = *count;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		if (ws_internal_compareKey(key.parent, key.name, &keys[mid]) >= 0) low = mid + 1;
+		else high = mid;
+	}
+	memmove(&keys[low + 1], &keys[low], (*count - low) * sizeof(ws_command_key_t));
+	keys[low] = key;
+	(*count)++;
+}
+#else
+/**
+ * @internal
+ * @brief Checks if a command goes by a name, either its own or one of its aliases.
+ */
+bool ws_internal_hasName(const ws_command_t* c, const char* name) {
+	if (c->commandName && strcmp(c->commandName, name) == 0) return true;
+	for (size_t alias_idx = 0; alias_idx < c->aliases_count; alias_idx++) {
+		if (c->aliases[alias_idx] && strcmp(c->aliases[alias_idx], name) == 0) return true;
+	}
+	return false;
+}
+#endif // DISABLE_MALLOC
+
+/**
+ * @internal
+ * @brief Finds a subcommand of a command by name or alias.
+ * @param parent Index of the command, or WS_NO_PARENT to look through the top level commands.
+ * @param index Set to the subcommand's index if it was found.
+ * @return true if it was found. If several match, it's the one registered first.
+ */
+bool ws_internal_findChild(const ws_command_snapshot_t* snapshot, size_t parent, const char* name, size_t* index) {
+#ifdef DISABLE_MALLOC
+	// Small enough that a plain scan beats keeping an index.
+	for (size_t i = 0; i < snapshot->count; i++) {
+		if (snapshot->parents[i] == parent && ws_internal_hasName(&snapshot->commands[i], name)) {
+			*index = i;
+			return true;
+		}
+	}
+	return false;
+#else
+	size_t i = ws_internal_lowerKey(snapshot, parent, name);
+	if (i == snapshot->key_count || ws_internal_compareKey(parent, name, &snapshot->keys[i]) != 0) return false;
+	*index = snapshot->keys[i].command;
+	return true;
+#endif // DISABLE_MALLOC
+}
+
+/**
+ * @internal
+ * @brief Checks if a command has any subcommands.
+ */
+bool ws_internal_hasChildren(const ws_command_snapshot_t* snapshot, size_t node) {
+#ifdef DISABLE_MALLOC
+	for (size_t i = node + 1; i < snapshot->count; i++) {
+		if (snapshot->parents[i] == node) return true;
+	}
+	return false;
+#else
+	size_t i = ws_internal_lowerKey(snapshot, node, "");
+	return i < snapshot->key_count && snapshot->keys[i].parent == node;
+#endif // DISABLE_MALLOC
+}
+
+/**
+ * @internal
+ * @brief Lists the names of a command's subcommands that start with prefix.
+ * @param parent Index of the command, or WS_NO_PARENT for the top level commands.
+ * @param aliases Whether to list aliases too. An alias is left out if its command's own name is listed.
+ * @return How many were put in list. The names belong to the commands, so they outlive the snapshot.
+ */
+int ws_internal_listChildren(const ws_command_snapshot_t* snapshot, size_t parent, const char* prefix, bool aliases,
+							 const char** list, int list_limit) {
+	size_t prefix_len = strlen(prefix);
+	int list_size = 0;
+#ifdef DISABLE_MALLOC
+	for (size_t i = 0; i < snapshot->count && list_size < list_limit; i++) {
+		const ws_command_t* c = &snapshot->commands[i];
+		if (snapshot->parents[i] != parent) continue;
+		bool name_matches = c->commandName && strncmp(c->commandName, prefix, prefix_len) == 0;
+		if (name_matches) list[list_size++] = c->commandName;
+		for (size_t alias_idx = 0; aliases && !name_matches && alias_idx < c->aliases_count && list_size < list_limit; alias_idx++) {
+			if (c->aliases[alias_idx] && strncmp(c->aliases[alias_idx], prefix, prefix_len) == 0) {
+				list[list_size++] = c->aliases[alias_idx];
+			}
+		}
+	}
+#else
+	// Everything starting with prefix sorts right after it.
+	for (size_t i = ws_internal_lowerKey(snapshot, parent, prefix); i < snapshot->key_count && list_size < list_limit; i++) {
+		const ws_command_key_t* key = &snapshot->keys[i];
+		if (key->parent != parent || strncmp(key->name, prefix, prefix_len) != 0) break;
+		const char* commandName = snapshot->commands[key->command].commandName;
+		if (key->name == commandName) {
+			list[list_size++] = key->name;
+		} else if (aliases && !(commandName && strncmp(commandName, prefix, prefix_len) == 0)) {
+			list[list_size++] = key->name;
+		}
+	}
+#endif // DISABLE_MALLOC
+	return list_size;
+}
+
+/**
+ * @internal
+ * @brief Follows a line down the command tree, for as long as the arguments name subcommands.
+ * @param node Set to the index of the last command reached.
+ * @return How many arguments after the first one named subcommands, or -1 if the first one isn't a command.
+ */
+int ws_internal_walkCommands(const ws_command_snapshot_t* snapshot, int argc, char** argv, size_t* node) {
+	if (argc < 1 || !ws_internal_findChild(snapshot, WS_NO_PARENT, argv[0], node)) return -1;
+	int depth = 0;
+	size_t child;
+	while (depth + 1 < argc && ws_internal_findChild(snapshot, *node, argv[depth + 1], &child)) {
+		*node = child;
+		depth++;
+	}
+	return depth;
+}
+
+/**
+ * @internal
+ * @brief Finds the command at a space separated path, like "remote add".
+ * @param node Set to the command's index if it was found.
+ * @return true if every part of the path was found.
+ */
+bool ws_internal_findPath(const ws_command_snapshot_t* snapshot, const char* path, size_t* node) {
+	char buf[MAX_COMMAND_BUF];
+	size_t len = strlen(path);
+	if (len >= sizeof(buf)) return false;
+	memcpy(buf, path, len + 1);
+
+	char* rest = buf;
+	char* name;
+	bool found = false;
+	*node = WS_NO_PARENT;
+	while ((name = ws_internal_nextToken(&rest)) != NULL) {
+		if (!ws_internal_findChild(snapshot, *node, name, node)) return false;
+		found = true;
+	}
+	return found;
+}
+
+/**
+ * @internal
+ * @brief Works out where every command moves to once a command and all of its subcommands are removed.
+ * @param target Index of the command being removed.
+ * @param remap Set to each command's new index, or WS_NO_PARENT if it's being removed.
+ * @return How many commands are left.
+ */
+size_t ws_internal_remapCommands(const ws_command_snapshot_t* snapshot, size_t target, size_t* remap) {
+	size_t kept = 0;
+	// Parents come first, so whether a command's parent is going is already known.
+	for (size_t i = 0; i < snapshot->count; i++) {
+		size_t parent = snapshot->parents[i];
+		bool removed = i == target || (parent != WS_NO_PARENT && remap[parent] == WS_NO_PARENT);
+		remap[i] = removed ? WS_NO_PARENT : kept++;
+	}
+	return kept;
+}
+
+/**
+ * @internal
+ * @brief Finds a command by following a line down the command tree, and copies it out of the registry.
+ * @param depth Set to how many arguments after the first one named subcommands. The command's own arguments start at argv[depth].
+ * @param has_subcommands Set to whether the command has subcommands. Can be NULL.
+ * @param index Set to the lookup tables of the command's schema, if it has one. Can be NULL.
+ * @return true if the first argument is a command.
+ */
+bool ws_internal_resolveCommand(int argc, char** argv, ws_command_t* out, int* depth, bool* has_subcommands,
+								ws_arg_index_t* index) {
+	int epoch;
+	ws_command_snapshot_t* snapshot = ws_internal_acquireCommands(&epoch);
+	size_t node;
+	int d = ws_internal_walkCommands(snapshot, argc, argv, &node);
+	if (d >= 0) {
+		*out = snapshot->commands[node];
+		if (index && out->schema) *index = snapshot->indexes[node];
+		*depth = d;
+		if (has_subcommands) *has_subcommands = ws_internal_hasChildren(snapshot, node);
+	}
+	ws_internal_releaseCommands(epoch);
+	return d >= 0;
+}
+
+/**
+ * @internal
+ * @brief Lists the subcommands of the command at a path.
+ * @param path_len How many words the path has. 0 lists the top level commands.
+ * @param path The command's name, followed by the names of the subcommands leading to it.
+ * @return How many were put in list. 0 if the path doesn't lead to a command.
+ */
+int ws_internal_listSubcommands(int path_len, char** path, const char* prefix, bool aliases, const char** list, int list_limit) {
+	int epoch;
+	ws_command_snapshot_t* snapshot = ws_internal_acquireCommands(&epoch);
+	size_t node = WS_NO_PARENT;
+	int list_size = 0;
+	if (path_len == 0 || ws_internal_walkCommands(snapshot, path_len, path, &node) == path_len - 1) {
+		list_size = ws_internal_listChildren(snapshot, node, prefix, aliases, list, list_limit);
+	}
+	ws_internal_releaseCommands(epoch);
+	return list_size;
+}
+
+/**
+ * @internal
+ * @brief Prints the subcommands of the command at a path, as a section of its help.
+ */
+void ws_internal_printSubcommands(int path_len, char** path) {
+	const char* list[64];
+	int count = ws_internal_listSubcommands(path_len, path, "", false, list, (int) (sizeof(list) / sizeof(list[0])));
+	if (count == 0) return;
+	ws_setConsoleColors((ws_color_t) { WS_FG_YELLOW, WS_BG_DEFAULT });
+	fprintf(ws_out_stream, "Subcommands:\n");
+	ws_setConsoleColors((ws_color_t) { WS_FG_GREEN, WS_BG_DEFAULT });
+	for (int i = 0; i < count; i++) {
+		fprintf(ws_out_stream, "  %s\n", list[i]);
+	}
+	ws_setConsoleColors((ws_color_t) { WS_FG_DEFAULT, WS_BG_DEFAULT });
+	fprintf(ws_out_stream, "\n");
+}
+
+/**
+ * @internal
+ * @brief Runs in place of a command that only groups subcommands, when the line doesn't name one of them.
+ * @param depth How many arguments after the first one named subcommands.
+ * @return 2, the same as a command given bad arguments.
+ */
+int ws_internal_missingSubcommand(int argc, char** argv, int depth) {
+	ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
+	if (depth + 1 < argc) fprintf(ws_out_stream, "Unknown subcommand: \"%s\"\n", argv[depth + 1]);
+	else fprintf(ws_out_stream, "Missing subcommand.\n");
+	ws_setConsoleColors((ws_color_t) { WS_FG_YELLOW, WS_BG_DEFAULT });
+	fprintf(ws_out_stream, "Usage:");
+	for (int i = 0; i <= depth; i++) {
+		fprintf(ws_out_stream, " %s", argv[i]);
+	}
+	fprintf(ws_out_stream, " <subcommand> ...\n\n");
+	ws_internal_printSubcommands(depth + 1, argv);
+	return 2;
+}
+
+/**
+ * @internal
+ * @brief Resets all command variables. Resets the command list, etc.
+ */
+void ws_internal_cleanCommands() {
+#ifdef DISABLE_MALLOC
+	memset(&command_registry, 0, sizeof(command_registry));
+#else
+	REGISTRY_MUTEX_CHECK;
+	LOCK_REGISTRY_MUTEX;
+	ws_internal_publishCommands(&empty_registry);
+	UNLOCK_REGISTRY_MUTEX;
+#ifdef THREADED_SUPPORT
+	ws_mutex_t* mut = (ws_mutex_t*) ws_exchangeAtomicPtr(&registry_mutex, NULL);
+	if (mut) ws_destroyMutex(mut);
+#endif // THREADED_SUPPORT
+#endif // DISABLE_MALLOC
+
+#ifdef THREADED_SUPPORT
+	ws_setAtomicInt(&basic_commands_registered, 0);
+#else
+	basic_commands_registered = false;
+#endif // THREADED_SUPPORT
+}
+
+/**
+ * @internal
+ * @brief Registers a command under the command at parent_path, or at the top level if it's NULL.
+ */
+ws_error_t ws_internal_registerCommand(const char* parent_path, const ws_command_t c) {
+	size_t parent = WS_NO_PARENT;
+#ifdef DISABLE_MALLOC
+	if (command_registry.count == COMMAND_LIMIT) return WS_COMMAND_LIMIT_REACHED;
+	if (parent_path && !ws_internal_findPath(&command_registry, parent_path, &parent)) return WS_COMMAND_NOT_FOUND;
+	if (c.schema && ws_internal_compileSchema(c.schema, &command_registry.indexes[command_registry.count]) != WS_NO_ERROR) {
+		return WS_INVALID_SCHEMA;
+	}
+	command_registry.parents[command_registry.count] = parent;
+	command_registry.commands[command_registry.count++] = c;
+#else
+	REGISTRY_MUTEX_CHECK;
+	LOCK_REGISTRY_MUTEX;
+	int epoch;
+	// Writers hold the mutex, so the snapshot can't be freed under us.
+	ws_command_snapshot_t* current = ws_internal_acquireCommands(&epoch);
+	ws_internal_releaseCommands(epoch);
+
+	if (parent_path && !ws_internal_findPath(current, parent_path, &parent)) {
+		UNLOCK_REGISTRY_MUTEX;
+		return WS_COMMAND_NOT_FOUND;
+	}
+	// Published along with the command, so readers never see it half done.
+	ws_arg_index_t schema_index;
+	if (c.schema && ws_internal_compileSchema(c.schema, &schema_index) != WS_NO_ERROR) {
+		UNLOCK_REGISTRY_MUTEX;
+		return WS_INVALID_SCHEMA;
+	}
+
+	size_t new_keys = c.commandName ? 1 : 0;
+	for (size_t alias_idx = 0; alias_idx < c.aliases_count; alias_idx++) {
+		if (c.aliases[alias_idx]) new_keys++;
+	}
+	ws_command_snapshot_t* snapshot = ws_internal_allocateCommands(current->count + 1, current->key_count + new_keys);
+	if (!snapshot) {
+		// The current snapshot is left alone, so the shell is still usable.
+		UNLOCK_REGISTRY_MUTEX;
+		return WS_OUT_OF_MEMORY;
+	}
+	size_t index = current->count;
+	if (index > 0) {
+		memcpy(snapshot->commands, current->commands, index * sizeof(ws_command_t));
+		memcpy(snapshot->indexes, current->indexes, index * sizeof(ws_arg_index_t));
+		memcpy(snapshot->parents, current->parents, index * sizeof(size_t));
+		memcpy(snapshot->keys, current->keys, current->key_count * sizeof(ws_command_key_t));
+	}
+	snapshot->commands[index] = c;
+	if (c.schema) snapshot->indexes[index] = schema_index;
+	snapshot->parents[index] = parent;
+
+	size_t key_count = current->key_count;
+	if (c.commandName) ws_internal_insertKey(snapshot->keys, &key_count, (ws_command_key_t) { parent, c.commandName, index });
+	for (size_t alias_idx = 0; alias_idx < c.aliases_count; alias_idx++) {
+		if (c.aliases[alias_idx]) ws_internal_insertKey(snapshot->keys, &key_count, (ws_command_key_t) { parent, c.aliases[alias_idx], index });
+	}
+	ws_internal_publishCommands(snapshot);
+	UNLOCK_REGISTRY_MUTEX;
+#endif
+	return WS_NO_ERROR;
+}
+
+/**
+ * @brief Register the command to the command handler. Safe to call from any thread, even while the terminal is running.
+ *
+ * If the command has a schema, its lookup tables are built here, before anything can run the command.
+ *
+ * @param c Command to be registered.
+ * @return Can return WS_COMMAND_LIMIT_REACHED if DISABLE_MALLOC is defined, and WS_OUT_OF_MEMORY if not.
+ * WS_INVALID_SCHEMA if the command's schema is invalid.
+ */
+ws_error_t ws_registerCommand(const ws_command_t c) {
+	return ws_internal_registerCommand(NULL, c);
+}
+
+/**
+ * @brief Register a command as a subcommand of another one. Safe to call from any thread, even while the terminal is running.
+ *
+ * `parent child args...` runs the child with `child args...` as its arguments, as if it was a command of its own.
+ * Subcommands can have subcommands of their own, and a parent without a mainCommand or schema only groups them.
+ *
+ * @param parent The parent's name, followed by the names of the subcommands leading to it, separated by spaces.
+ * For example "remote" or "remote add". Aliases work too.
+ * @param c Command to be registered. Its name only has to be unique among its parent's subcommands.
+ * @return The same as ws_registerCommand(), and WS_COMMAND_NOT_FOUND if there's no command at parent.
+ */
+ws_error_t ws_registerSubcommand(const char* parent, const ws_command_t c) {
+	if (!parent) return WS_COMMAND_NOT_FOUND;
+	return ws_internal_registerCommand(parent, c);
+}
+
+/**
+ * @brief Deregister the provided command. Safe to call from any thread, even while the terminal is running.
+ *
+ * Its subcommands are deregistered along with it.
+ *
+ * @param c Command to be deregistered. If it doesn't exist (not already registered), nothing happens.
+ */
+void ws_deregisterCommand(const ws_command_t c) {
+#ifdef DISABLE_MALLOC
+	for (size_t i = 0; i < command_registry.count; i++) {
+		if (ws_compareCommands(command_registry.commands[i], c)) {
+			// Nothing is allocated through malloc. If something is, it's on the user to free it either before/after calling this.
+			size_t kept = ws_internal_remapCommands(&command_registry, i, registry_remap);
+			// Commands only move towards the front, so this can be done in place.
+			for (size_t j = 0; j < command_registry.count; j++) {
+				size_t to = registry_remap[j];
+				if (to == WS_NO_PARENT) continue;
+				size_t parent = command_registry.parents[j];
+				command_registry.commands[to] = command_registry.commands[j];
+				command_registry.indexes[to] = command_registry.indexes[j];
+				command_registry.parents[to] = parent == WS_NO_PARENT ? WS_NO_PARENT : registry_remap[parent];
+			}
+			command_registry.count = kept;
+			return;
+		}
+	}
+#else
+	REGISTRY_MUTEX_CHECK;
+	LOCK_REGISTRY_MUTEX;
+	int epoch;
+	ws_command_snapshot_t* current = ws_internal_acquireCommands(&epoch);
+	ws_internal_releaseCommands(epoch);
+
+	for (size_t i = 0; i < current->count; i++) {
+		if (ws_compareCommands(current->commands[i], c)) {
+			// Can't shrink without memory. Leave it registered rather than breaking readers.
+			size_t* remap = malloc(current->count * sizeof(size_t));
+			if (!remap) break;
+			size_t kept = ws_internal_remapCommands(current, i, remap);
+			size_t kept_keys = 0;
+			for (size_t k = 0; k < current->key_count; k++) {
+				if (remap[current->keys[k].command] != WS_NO_PARENT) kept_keys++;
+			}
+
+			ws_command_snapshot_t* snapshot = &empty_registry;
+			if (kept > 0) {
+				snapshot = ws_internal_allocateCommands(kept, kept_keys);
+				if (!snapshot) {
+					free(remap);
+					break;
+				}
+				for (size_t j = 0; j < current->count; j++) {
+					size_t to = remap[j];
+					if (to == WS_NO_PARENT) continue;
+					size_t parent = current->parents[j];
+					snapshot->commands[to] = current->commands[j];
+					snapshot->indexes[to] = current->indexes[j];
+					snapshot->parents[to] = parent == WS_NO_PARENT ? WS_NO_PARENT : remap[parent];
+				}
+				// Indexes only shift down, in the same order, so the keys stay sorted.
+				size_t key_count = 0;
+				for (size_t k = 0; k < current->key_count; k++) {
+					ws_command_key_t key = current->keys[k];
+					if (remap[key.command] == WS_NO_PARENT) continue;
+					key.command = remap[key.command];
+					if (key.parent != WS_NO_PARENT) key.parent = remap[key.parent];
+					snapshot->keys[key_count++] = key;
+				}
+			}
+			free(remap);
+			ws_internal_publishCommands(snapshot);
+			break;
+		}
+	}
+	UNLOCK_REGISTRY_MUTEX;
+#endif
+}
+
+#ifdef WS_PLUGIN_COMMANDS
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// Plugin Commands
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif // _WIN32
+
+/*
+ * A plugin command is registered with the stubs below as its functions. The first time one of them runs, the
+ * library is loaded, and the registry entry is replaced with one that calls the library directly.
+ */
+typedef struct {
+	ws_plugin_command_t plugin;
+	// Set once the library is loaded.
+	void* handle;
+	int (*mainCommand)(int argc, char** argv);
+	int (*helpCommand)(int argc, char** argv);
+} ws_plugin_entry_t;
+
+ws_plugin_entry_t* plugins = NULL;
+size_t plugins_count = 0;
+
+#ifdef THREADED_SUPPORT
+// Created on first use, the same way as the color mutex. Taken before the registry mutex, never after.
+ws_atomic_ptr_t plugin_mutex = WS_ATOMIC_INIT(NULL);
+void ws_internal_plugin_mutex_check() {
+	if (ws_getAtomicPtr(&plugin_mutex)) return;
+	ws_mutex_t* created = ws_createMutex();
+	if (!created) return;
+	void* expected = NULL;
+	if (!ws_compareExchangeAtomicPtr(&plugin_mutex, &expected, created)) ws_destroyMutex(created);
+}
+#define PLUGIN_MUTEX_CHECK ws_internal_plugin_mutex_check()
+#define LOCK_PLUGIN_MUTEX ws_lockMutex((ws_mutex_t*) ws_getAtomicPtr(&plugin_mutex))
+#define UNLOCK_PLUGIN_MUTEX ws_unlockMutex((ws_mutex_t*) ws_getAtomicPtr(&plugin_mutex))
+#else
+#define PLUGIN_MUTEX_CHECK
+#define LOCK_PLUGIN_MUTEX
+#define UNLOCK_PLUGIN_MUTEX
+#endif // THREADED_SUPPORT
+
+/**
+ * @internal
+ * @brief Loads a shared library, or gets the program itself if path is NULL.
+ * @return A handle for ws_internal_findSymbol, or NULL if it couldn't be loaded.
+ */
+void* ws_internal_openLibrary(const char* path) {
+#ifdef _WIN32
+	return path ? (void*) LoadLibraryA(path) : (void*) GetModuleHandleA(NULL);
+#else
+	return dlopen(path, RTLD_NOW | RTLD_LOCAL);
+#endif // _WIN32
+}
+
+/**
+ * @internal
+ * @brief Looks up a command function in a library opened with ws_internal_openLibrary.
+ */
+int (*ws_internal_findSymbol(void* handle, const char* name))(int, char**) {
+#ifdef _WIN32
+	return (int (*)(int, char**)) GetProcAddress((HMODULE) handle, name);
+#else
+	// ISO C has no cast from an object pointer to a function pointer. This is the way POSIX says to do it.
+	int (*function)(int, char**);
+	*(void**) (&function) = dlsym(handle, name);
+	return function;
+#endif // _WIN32
+}
+
+/**
+ * @internal
+ * @brief Closes a library opened with ws_internal_openLibrary.
+ */
+void ws_internal_closeLibrary(void* handle, const char* path) {
+#ifdef _WIN32
+	// The program's own handle isn't counted, so it mustn't be freed.
+	if (path) FreeLibrary((HMODULE) handle);
+#else
+	(void) path;
+	dlclose(handle);
+#endif // _WIN32
+}
+
+/**
+ * @internal
+ * @brief Prints why a plugin couldn't be loaded.
+ */
+void ws_internal_pluginError(const ws_plugin_command_t* plugin, const char* what) {
+	ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
+#ifdef _WIN32
+	fprintf(ws_out_stream, "Couldn't load \"%s\" from \"%s\": %s (error %lu)\n", plugin->commandName,
+			plugin->library ? plugin->library : "the program", what, (unsigned long) GetLastError());
+#else
+	const char* reason = dlerror();
+	fprintf(ws_out_stream, "Couldn't load \"%s\" from \"%s\": %s\n", plugin->commandName,
+			plugin->library ? plugin->library : "the program", reason ? reason : what);
+#endif // _WIN32
+	ws_setConsoleColors(ws_getDefaultColors());
+}
+
+int ws_internal_pluginMain(int argc, char** argv);
+
+/**
+ * @internal
+ * @brief Replaces a plugin's stubs in the registry with the functions loaded from its library.
+ * Must be called with the plugin mutex held.
+ */
+void ws_internal_patchPlugin(const ws_plugin_entry_t* entry) {
+	REGISTRY_MUTEX_CHECK;
+	LOCK_REGISTRY_MUTEX;
+	int epoch;
+	ws_command_snapshot_t* current = ws_internal_acquireCommands(&epoch);
+	ws_internal_releaseCommands(epoch);
+	// Names and aliases stay the same, so the keys can be copied as they are.
+	ws_command_snapshot_t* snapshot = current->count ? ws_internal_allocateCommands(current->count, current->key_count) : NULL;
+	// If this fails, the stubs stay, and keep calling the loaded functions through the plugin table.
+	if (!snapshot) {
+		UNLOCK_REGISTRY_MUTEX;
+		return;
+	}
+	memcpy(snapshot->commands, current->commands, current->count * sizeof(ws_command_t));
+	memcpy(snapshot->indexes, current->indexes, current->count * sizeof(ws_arg_index_t));
+	memcpy(snapshot->parents, current->parents, current->count * sizeof(size_t));
+	memcpy(snapshot->keys, current->keys, current->key_count * sizeof(ws_command_key_t));
+	for (size_t i = 0; i < snapshot->count; i++) {
+		ws_command_t* c = &snapshot->commands[i];
+		if (c->mainCommand == ws_internal_pluginMain && c->commandName == entry->plugin.commandName) {
+			c->mainCommand = entry->mainCommand;
+			c->helpCommand = entry->helpCommand;
+		}
+	}
+	ws_internal_publishCommands(snapshot);
+	UNLOCK_REGISTRY_MUTEX;
+}
+
+/**
+ * @internal
+ * @brief Finds the plugin a stub was called for, loading its library if that hasn't happened yet.
+ * @param name The name or alias the stub was called with.
+ * @param out Set to a copy of the plugin's entry, if it's loaded.
+ * @return false if it couldn't be loaded. Why has already been printed.
+ */
+bool ws_internal_loadPlugin(const char* name, ws_plugin_entry_t* out) {
+	PLUGIN_MUTEX_CHECK;
+	LOCK_PLUGIN_MUTEX;
+	ws_plugin_entry_t* entry = NULL;
+	for (size_t i = 0; i < plugins_count && !entry; i++) {
+		const ws_plugin_command_t* plugin = &plugins[i].plugin;
+		if (strcmp(plugin->commandName, name) == 0) entry = &plugins[i];
+		for (size_t alias_idx = 0; alias_idx < plugin->aliases_count && !entry; alias_idx++) {
+			if (plugin->aliases[alias_idx] && strcmp(plugin->aliases[alias_idx], name) == 0) entry = &plugins[i];
+		}
+	}
+	if (!entry) {
+		UNLOCK_PLUGIN_MUTEX;
+		return false;
+	}
+
+	if (!entry->handle) {
+		const ws_plugin_command_t* plugin = &entry->plugin;
+		void* handle = ws_internal_openLibrary(plugin->library);
+		if (!handle) {
+			ws_internal_pluginError(plugin, "the library couldn't be opened");
+			UNLOCK_PLUGIN_MUTEX;
+			return false;
+		}
+		int (*mainCommand)(int, char**) = plugin->mainSymbol ? ws_internal_findSymbol(handle, plugin->mainSymbol) : NULL;
+		int (*helpCommand)(int, char**) = plugin->helpSymbol ? ws_internal_findSymbol(handle, plugin->helpSymbol) : NULL;
+		if (!mainCommand || (plugin->helpSymbol && !helpCommand)) {
+			ws_internal_pluginError(plugin, "a symbol is missing");
+			ws_internal_closeLibrary(handle, plugin->library);
+			UNLOCK_PLUGIN_MUTEX;
+			return false;
+		}
+		entry->handle = handle;
+		entry->mainCommand = mainCommand;
+		entry->helpCommand = helpCommand;
+		ws_internal_patchPlugin(entry);
+	}
+	*out = *entry;
+	UNLOCK_PLUGIN_MUTEX;
+	return true;
+}
+
+/**
+ * @internal
+ * @brief Stands in for a plugin's mainCommand until its library is loaded.
+ */
+int ws_internal_pluginMain(int argc, char** argv) {
+	ws_plugin_entry_t entry;
+	if (!ws_internal_loadPlugin(argv[0], &entry)) return 1;
+	return entry.mainCommand(argc, argv);
+}
+
+/**
+ * @internal
+ * @brief Stands in for a plugin's helpCommand until its library is loaded.
+ */
+int ws_internal_pluginHelp(int argc, char** argv) {
+	ws_plugin_entry_t entry;
+	if (!ws_internal_loadPlugin(argv[0], &entry)) return 1;
+	return entry.helpCommand(argc, argv);
+}
+
+/**
+ * @brief Registers a command whose functions live in a shared library, without loading it.
+ *
+ * Only the name and aliases are registered, so they're listed, completed and found like any other command.
+ * The first time the command or its help runs, the library is loaded and the functions are looked up.
+ * From then on, the registered command calls them directly.
+ *
+ * @param plugin The command. Its strings have to outlive it, the same as a ws_command_t's.
+ * @return The same as ws_registerCommand(), and WS_OUT_OF_MEMORY if the plugin couldn't be stored.
+ * If the library or its functions can't be found, that's only reported when the command is run.
+ */
+ws_error_t ws_registerPluginCommand(const ws_plugin_command_t plugin) {
+	PLUGIN_MUTEX_CHECK;
+	LOCK_PLUGIN_MUTEX;
+	ws_plugin_entry_t* grown = realloc(plugins, (plugins_count + 1) * sizeof(ws_plugin_entry_t));
+	if (!grown) {
+		UNLOCK_PLUGIN_MUTEX;
+		return WS_OUT_OF_MEMORY;
+	}
+	plugins = grown;
+	plugins[plugins_count] = (ws_plugin_entry_t) { plugin, NULL, NULL, NULL };
+	ws_error_t err = ws_registerCommand((ws_command_t) {
+			ws_internal_pluginMain,
+			plugin.helpSymbol ? ws_internal_pluginHelp : NULL,
+			plugin.commandName,
+			plugin.aliases,
+			plugin.aliases_count
+	});
+	if (err == WS_NO_ERROR) plugins_count++;
+	UNLOCK_PLUGIN_MUTEX;
+	return err;
+}
+
+/**
+ * @brief Deregisters a command registered with ws_registerPluginCommand(), and closes its library if it was loaded.
+ *
+ * Its subcommands are deregistered along with it. The command mustn't be running while it's deregistered,
+ * since its functions go away with the library.
+ *
+ * @param name The plugin's commandName. If there's no plugin by that name, nothing happens.
+ */
+void ws_deregisterPluginCommand(const char* name) {
+	if (!name) return;
+	PLUGIN_MUTEX_CHECK;
+	LOCK_PLUGIN_MUTEX;
+	size_t found = plugins_count;
+	for (size_t i = 0; i < plugins_count && found == plugins_count; i++) {
+		if (strcmp(plugins[i].plugin.commandName, name) == 0) found = i;
+	}
+	if (found == plugins_count) {
+		UNLOCK_PLUGIN_MUTEX;
+		return;
+	}
+	ws_plugin_entry_t entry = plugins[found];
+
+	// The registered command points at the stubs, or at the loaded functions once it's been patched.
+	// Patching happens with the plugin mutex held, so it can't change while we look.
+	int epoch;
+	ws_command_snapshot_t* snapshot = ws_internal_acquireCommands(&epoch);
+	bool registered = false;
+	ws_command_t command;
+	for (size_t i = 0; i < snapshot->count && !registered; i++) {
+		const ws_command_t* c = &snapshot->commands[i];
+		if (snapshot->parents[i] != WS_NO_PARENT || c->commandName != entry.plugin.commandName) continue;
+		if (c->mainCommand == ws_internal_pluginMain || (entry.handle && c->mainCommand == entry.mainCommand)) {
+			command = *c;
+			registered = true;
+		}
+	}
+	ws_internal_releaseCommands(epoch);
+	if (registered) ws_deregisterCommand(command);
+
+	if (entry.handle) ws_internal_closeLibrary(entry.handle, entry.plugin.library);
+	memmove(&plugins[found], &plugins[found + 1], (plugins_count - found - 1) * sizeof(ws_plugin_entry_t));
+	plugins_count--;
+	UNLOCK_PLUGIN_MUTEX;
+}
+
+/**
+ * @internal
+ * @brief Forgets every plugin and closes their libraries. The commands must already be deregistered.
+ */
+void ws_internal_cleanPlugins() {
+	for (size_t i = 0; i < plugins_count; i++) {
+		if (plugins[i].handle) ws_internal_closeLibrary(plugins[i].handle, plugins[i].plugin.library);
+	}
+	free(plugins);
+	plugins = NULL;
+	plugins_count = 0;
+#ifdef THREADED_SUPPORT
+	ws_mutex_t* mut = (ws_mutex_t*) ws_exchangeAtomicPtr(&plugin_mutex, NULL);
+	if (mut) ws_destroyMutex(mut);
+#endif // THREADED_SUPPORT
+}
+#endif // WS_PLUGIN_COMMANDS
+
+/* Internal clear command */
+const char* clear_aliases[] = { "clr", "cls" };
+/**
+ * @internal
+ * @brief Clear function help command
+ */
+int clearHelp(int argc, char** argv) {
+	ws_help_entry_general_t entry = {
+			"Clear",
+			"Clears the screen",
+			NULL,
+			0,
+			clear_aliases,
+			2
+	};
+	ws_printGeneralHelp(&entry);
+	return 0;
+}
+
+/**
+ * @internal
+ * @brief Clear function main command
+ */
+int clearMain(int argc, char** argv) {
+#ifdef _WIN32
+	// Windows being windows, some escape characters don't work normally in like 2/3 of the terminals
+	// This is especially evident in things spawned by AllocConsole()
+	system("cls");
+#else
+	// Unix is much nicer
+	fprintf(ws_out_stream, "\033c");
+#endif
+	// Sometimes clearing the screen results in the colors getting reset.
+	ws_internal_invalidateColors();
+	ws_internal_updateColors();
+	return 0;
+}
+
+/* Internal help command */
+/**
+ * @internal
+ * @brief Help function search command
+ */
+void helpSearch(char* str) {
+	ws_setConsoleColors((ws_color_t) { WS_FG_YELLOW, WS_BG_DEFAULT });
+	fprintf(ws_out_stream, "List of commands starting with \"%s\": (A) indicates an alias.\n", str);
+	ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_GREEN, WS_BG_DEFAULT });
+	int epoch;
+	ws_command_snapshot_t* snapshot = ws_internal_acquireCommands(&epoch);
+	for (size_t i = 0; i < snapshot->count; i++) {
+		const ws_command_t* c = &snapshot->commands[i];
+		if (snapshot->parents[i] != WS_NO_PARENT) continue;
+		if (c->commandName && ws_internal_startsWith(c->commandName, str)) {
+			fprintf(ws_out_stream, "\t%s\n", c->commandName);
+		}
+
+		// Check aliases for a match
+		for (size_t alias_idx = 0; alias_idx < c->aliases_count; alias_idx++) {
+			if (c->aliases[alias_idx] && ws_internal_startsWith(c->aliases[alias_idx], str)) {
+				fprintf(ws_out_stream, "\t%s (A)\n", c->aliases[alias_idx]);
+			}
+		}
+	}
+	ws_internal_releaseCommands(epoch);
+	ws_setConsoleColors(ws_getDefaultColors());
+}
+
+/**
+ * @internal
+ * @brief Help function help command
+ */
+int helpHelp(int argc, char** argv) {
+	const char* optional[] = {
+			"-s <string> -> Lists all commands and aliases that start with <string>."
+	};
+	ws_help_entry_specific_t entry = {
+			"Help",
+			"The help menu.",
+			NULL,
+			0,
+			optional,
+			1
+	};
+	ws_printSpecificHelp(&entry);
+	return 0;
+}
+
+/**
+ * @internal
+ * @brief Help function main command
+ */
+int helpMain(int argc, char** argv) {
+	// Make sure there's more than one argument.
+	if (argc > 1) {
+		// remove help from argv
+		// Shift all pointers one position to the left
+		for (int i = 1; i < argc; i++) {
+			argv[i - 1] = argv[i];
+		}
+		argv[argc - 1] = NULL;
+
+		// Update the size of the array
+		argc--;
+		// Check for more args
+		if (argc >= 1) {
+			if ((strcmp(argv[0], "-s") == 0) || (strcmp(argv[0], "-search") == 0)) {
+				if (argc == 1) {
+					ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
+					fprintf(ws_out_stream, "Search flag must be followed by an argument.\n");
+				} else {
+					helpSearch(argv[1]);
+					return 0;
+				}
+			}
+		}
+
+		// Find the command, following subcommands the same way running it would.
+		// It's copied out of the registry, so it can be (de)registered while the help runs.
+		ws_command_t command;
+		int depth;
+		bool has_subcommands;
+		if (ws_internal_resolveCommand(argc, argv, &command, &depth, &has_subcommands, NULL)) {
+			char** path = argv;
+			// Like the command itself, a subcommand's help gets the arguments from its name on.
+			argc -= depth;
+			argv += depth;
+			// Commands with a schema can describe themselves.
+			if (!command.helpCommand && command.schema) {
+				ws_printSchemaHelp(command.commandName, command.schema);
+				ws_internal_printSubcommands(depth + 1, path);
+				return 0;
+			}
+			// So can commands that only group subcommands.
+			if (!command.helpCommand && has_subcommands) {
+				const char* subcommands[64];
+				ws_help_entry_general_t entry = {
+						command.commandName,
+						NULL,
+						subcommands,
+						ws_internal_listSubcommands(depth + 1, path, "", false, subcommands, 64),
+						command.aliases,
+						(int) command.aliases_count
+				};
+				ws_printGeneralHelp(&entry);
+				return 0;
+			}
+			// No help function for command.
+			if (!command.helpCommand) {
+				ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
+				fprintf(ws_out_stream, "Command \"%s\" does not have a help function.\n", argv[0]);
+				ws_setConsoleColors(ws_getDefaultColors());
+				return 0;
+			}
+
+			// Execute the help command associated with the matched command or alias
+			int result = command.helpCommand(argc, argv);
+			if (result != 0) {
+				// If the command function returns a non-zero value, it may indicate an error
+				ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
+				fprintf(ws_out_stream, "Command exited with code: %d\n", result);
+				ws_setConsoleColors(ws_getDefaultColors());
+			}
+			return 0;
+		}
+		// If the command is not found in the registered commands or their aliases
+		ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
+		fprintf(ws_out_stream, "Help command not found for: %s\n", argv[0]);
+	} else {
+		fprintf(ws_out_stream, "\n");
+		ws_setConsoleColors((ws_color_t) { WS_FG_CYAN, WS_BG_DEFAULT });
+		fprintf(ws_out_stream, "To get more info about a command, run `help <command_name>`\n");
+		ws_setConsoleColors((ws_color_t) { WS_FG_YELLOW, WS_BG_DEFAULT });
+		fprintf(ws_out_stream, "All commands:\n");
+
+		ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_GREEN, WS_BG_DEFAULT });
+		// List all available commands
+		int epoch;
+		ws_command_snapshot_t* snapshot = ws_internal_acquireCommands(&epoch);
+		for (size_t i = 0; i < snapshot->count; i++) {
+			if (snapshot->commands[i].commandName && snapshot->parents[i] == WS_NO_PARENT) {
+				fprintf(ws_out_stream, "  %s\n", snapshot->commands[i].commandName);
+			}
+		}
+		ws_internal_releaseCommands(epoch);
+		fprintf(ws_out_stream, "\n");
+	}
+	ws_setConsoleColors(ws_getDefaultColors());
+	return 0;
+}
+
+/* Internal history command */
+const char* history_aliases[] = { "hist" };
+/**
+ * @internal
+ * @brief History function help command
+ */
+int historyHelp(int argc, char** argv) {
 	ws_help_entry_general_t entry = {
-			"Clear",
-			"Clears the screen",
+			"History",
+			"Displays the terminal history. Limit of 32 previous commands.",
 			NULL,
 			0,
-			clear_aliases,
-			2
+			history_aliases,
+			1
 	};
 	ws_printGeneralHelp(&entry);
 	return 0;
@@ -1235,554 +6170,1404 @@ int clearHelp(int argc, char** argv) {
 
 /**
  * @internal
- * @brief Clear function main command
+ * @brief History function main command
+ */
+int historyMain(int argc, char** argv) {
+	ws_session_t* session = ws_internal_session();
+	ws_setConsoleColors((ws_color_t) { WS_FG_YELLOW, WS_BG_DEFAULT });
+	for (size_t i = 0; i < session->history_size; i++) {
+		fprintf(ws_out_stream, "%s\n", session->history[i]);
+	}
+	ws_setConsoleColors(ws_getDefaultColors());
+	return 0;
+}
+
+#ifndef NO_WS_LOGGING
+/* Internal log command */
+/**
+ * @internal
+ * @brief Log function help command
+ */
+int logHelp(int argc, char** argv) {
+	const char* optional[] = {
+			"list                       -> Lists all categories and their levels. Same as no arguments.",
+			"enable <category>          -> Turns a category on.",
+			"disable <category>         -> Turns a category off.",
+			"level <category> <level>   -> Sets the lowest level a category prints.",
+			"level <level>              -> Sets the lowest level printed by records without a category.",
+			"Levels: log, debug, info, warn, error, fatal"
+	};
+	ws_help_entry_specific_t entry = {
+			"Log",
+			"Controls log categories at runtime.",
+			NULL,
+			0,
+			optional,
+			6
+	};
+	ws_printSpecificHelp(&entry);
+	return 0;
+}
+
+/**
+ * @internal
+ * @brief Prints an error for the log command.
+ */
+void logError(const char* message, const char* arg) {
+	ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
+	fprintf(ws_out_stream, "%s%s\n", message, arg);
+	ws_setConsoleColors(ws_getDefaultColors());
+}
+
+/**
+ * @internal
+ * @brief Log function main command
+ */
+int logMain(int argc, char** argv) {
+	static const char* level_names[] = { "log", "debug", "info", "warn", "error", "fatal" };
+	if (argc < 2 || strcmp(argv[1], "list") == 0) {
+		ws_setConsoleColors((ws_color_t) { WS_FG_YELLOW, WS_BG_DEFAULT });
+		fprintf(ws_out_stream, "Default level: %s\n", level_names[log_level]);
+		ws_setConsoleColors(ws_getDefaultColors());
+		// Nothing may have logged yet, so the mutex might not exist.
+		LOGGING_CHECK;
+		LOCK_LOGGING_MUTEX;
+		for (int i = 0; i < log_category_count; i++) {
+			fprintf(ws_out_stream, "  %-*s %-6s %s\n", WS_LOG_CATEGORY_NAME_SIZE, log_categories[i].name,
+					level_names[log_categories[i].level], log_categories[i].enabled ? "" : "(disabled)");
+		}
+		UNLOCK_LOGGING_MUTEX;
+		if (log_category_count == 0) fprintf(ws_out_stream, "  No categories registered.\n");
+		return 0;
+	}
+
+	bool enable = strcmp(argv[1], "enable") == 0;
+	if (enable || strcmp(argv[1], "disable") == 0) {
+		if (argc < 3) {
+			logError("Missing category for ", argv[1]);
+			return 0;
+		}
+		ws_log_category_t category = ws_findLogCategory(argv[2]);
+		if (category == WS_NO_LOG_CATEGORY) {
+			logError("Unknown category: ", argv[2]);
+			return 0;
+		}
+		ws_enableLogCategory(category, enable);
+		return 0;
+	}
+
+	if (strcmp(argv[1], "level") == 0) {
+		ws_logtype_t level;
+		if (argc == 3) {
+			if (!ws_internal_parseLogType(argv[2], &level)) {
+				logError("Unknown log level: ", argv[2]);
+				return 0;
+			}
+			ws_setLogLevel(level);
+			return 0;
+		}
+		if (argc < 4) {
+			logError("Missing level for ", argv[1]);
+			return 0;
+		}
+		ws_log_category_t category = ws_findLogCategory(argv[2]);
+		if (category == WS_NO_LOG_CATEGORY) {
+			logError("Unknown category: ", argv[2]);
+			return 0;
+		}
+		if (!ws_internal_parseLogType(argv[3], &level)) {
+			logError("Unknown log level: ", argv[3]);
+			return 0;
+		}
+		ws_setLogCategoryLevel(category, level);
+		return 0;
+	}
+
+	logError("Unknown argument: ", argv[1]);
+	return 0;
+}
+#endif // NO_WS_LOGGING
+
+#if !defined(NO_WS_LOGGING) && !defined(NO_WS_FLIGHT_RECORDER)
+/* Internal logs command */
+/**
+ * @internal
+ * @brief Logs function help command
+ */
+int logsHelp(int argc, char** argv) {
+	const char* optional[] = {
+			"-n <count>     -> Only show the last <count> records. Defaults to 20, 0 shows everything.",
+			"-level <level> -> Only show records at or above <level> (log, debug, info, warn, error, fatal)."
+	};
+	ws_help_entry_specific_t entry = {
+			"Logs",
+			"Shows recent log records, including ones that weren't printed.",
+			NULL,
+			0,
+			optional,
+			2
+	};
+	ws_printSpecificHelp(&entry);
+	return 0;
+}
+
+/**
+ * @internal
+ * @brief Logs function main command
+ */
+int logsMain(int argc, char** argv) {
+	size_t n = 20;
+	ws_logtype_t level = WS_LOG;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			n = (size_t) strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "-level") == 0 && i + 1 < argc) {
+			if (!ws_internal_parseLogType(argv[++i], &level)) {
+				ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
+				fprintf(ws_out_stream, "Unknown log level: %s\n", argv[i]);
+				ws_setConsoleColors(ws_getDefaultColors());
+				return 0;
+			}
+		} else {
+			ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
+			fprintf(ws_out_stream, "Unknown argument: %s\n", argv[i]);
+			ws_setConsoleColors(ws_getDefaultColors());
+			return 0;
+		}
+	}
+	if (ws_dumpFlightRecorder(ws_out_stream, n, level) == 0) fprintf(ws_out_stream, "No log records.\n");
+	return 0;
+}
+#endif // NO_WS_LOGGING && NO_WS_FLIGHT_RECORDER
+
+// How long the terminal waits between checks for input.
+#ifndef WS_INPUT_POLL_MS
+#define WS_INPUT_POLL_MS 10
+#endif // WS_INPUT_POLL_MS
+
+#ifdef THREADED_SUPPORT
+#define GET_EXIT_BOOL(s) (ws_getAtomicInt(&(s)->exit_terminal) != 0)
+#define SET_EXIT_BOOL(s, b) ws_setAtomicInt(&(s)->exit_terminal, (b))
+
+/**
+ * @brief Stops a session's terminal. Only supported in threaded applications.
+ * @param session Session to stop.
+ */
+void ws_stopSession(ws_session_t* session) {
+	SET_EXIT_BOOL(session, true);
+	ws_internal_wakeSession(session);
+}
+
+/**
+ * @brief Stops the current session's terminal. Only supported in threaded applications.
+ */
+void ws_stopTerminal() { ws_stopSession(ws_internal_session()); }
+
+/**
+ * @brief Blocks until a session's terminal returns. If it's already returned, this returns immediately.
+ * If the terminal hasn't been started yet, this waits for it to start and then return.
+ * @param session Session to wait for.
+ */
+void ws_waitSessionStopped(ws_session_t* session) {
+	ws_event_t* stopped = ws_internal_getEvent(&session->stopped, true);
+	if (stopped) ws_waitEvent(stopped, WS_WAIT_FOREVER);
+}
+
+/**
+ * @brief Blocks until the current session's terminal returns. See ws_waitSessionStopped().
+ */
+void ws_waitTerminalStopped() { ws_waitSessionStopped(ws_internal_session()); }
+
+/**
+ * @internal
+ * @brief Waits for input, or for something else to need the terminal.
+ */
+void ws_internal_terminalIdle(ws_event_t* wake) {
+	if (wake) ws_waitEvent(wake, WS_INPUT_POLL_MS);
+	else ws_sleep(WS_INPUT_POLL_MS);
+}
+#else
+#define GET_EXIT_BOOL(s) (s)->exit_terminal
+#define SET_EXIT_BOOL(s, b) (s)->exit_terminal = (b)
+#endif // THREADED_SUPPORT
+
+/* Internal exit command */
+/**
+ * @internal
+ * @brief Exit function help command
+ */
+int exitHelp(int argc, char** argv) {
+	const char* optional[] = {
+			"--yes",
+			"-y   -> Exits the terminal without the prompt."
+	};
+	ws_help_entry_specific_t entry = {
+			"Exit",
+			"Exits the terminal.",
+			NULL,
+			0,
+			optional,
+			2
+	};
+	ws_printSpecificHelp(&entry);
+	return 0;
+}
+
+/**
+ * @internal
+ * @brief Exit function main command
+ */
+int exitMain(int argc, char** argv) {
+	if (argc > 1) {
+		if ((strcmp(argv[1], "-y") == 0 || strcmp(argv[1], "--yes") == 0)) {
+			SET_EXIT_BOOL(ws_internal_session(), true);
+		} else {
+			ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
+			fprintf(ws_out_stream, "Unknown argument: %s\n", argv[1]);
+			ws_setConsoleColors(ws_getDefaultColors());
+		}
+	} else {
+		SET_EXIT_BOOL(ws_internal_session(), ws_promptUser("Are you sure you want to exit?"));
+	}
+	fprintf(ws_out_stream, "\n");
+	return 0;
+}
+
+/**
+ * @internal
+ * @brief Registers all base commands.
+ */
+void ws_internal_registerBasicCommands() {
+#ifdef THREADED_SUPPORT
+	long expected = 0;
+	if (!ws_compareExchangeAtomicInt(&basic_commands_registered, &expected, 1)) return;
+#else
+	if (basic_commands_registered) return;
+	basic_commands_registered = true;
+#endif // THREADED_SUPPORT
+
+	// We static define the aliases for basic commands.
+	// We dont use malloc because we dont want to deal with having to free anything
+	// It also would be way messier for DISABLE_MALLOC if we did allocate things.
+	// WallShell wants just the pointers, cleaning it up is the user's responsibility
+
+	// a bare shell only has help, exit, clear, and history
+	// might come up with some more overtime, such as echo, but it's not a big priority.
+#ifndef NO_CLEAR_COMMAND
+	ws_registerCommand((ws_command_t) { clearMain, clearHelp, "clear", clear_aliases, 2 });
+#endif // NO_CLEAR_COMMAND
+
+#ifndef NO_HELP_COMMAND
+	ws_registerCommand((ws_command_t) { helpMain, helpHelp, "help", NULL, 0 });
+#endif // NO_HELP_COMMAND
+
+#ifndef NO_HISTORY_COMMAND
+	ws_registerCommand((ws_command_t) { historyMain, historyHelp, "history", history_aliases, 1 });
+#endif // NO_HISTORY_COMMAND
+
+#ifndef NO_EXIT_COMMAND
+	ws_registerCommand((ws_command_t) { exitMain, exitHelp, "exit", NULL, 0 });
+#endif // NO_EXIT_COMMAND
+
+#if !defined(NO_LOG_COMMAND) && !defined(NO_WS_LOGGING)
+	ws_registerCommand((ws_command_t) { logMain, logHelp, "log", NULL, 0 });
+#endif // NO_LOG_COMMAND
+
+#if !defined(NO_LOGS_COMMAND) && !defined(NO_WS_LOGGING) && !defined(NO_WS_FLIGHT_RECORDER)
+	ws_registerCommand((ws_command_t) { logsMain, logsHelp, "logs", NULL, 0 });
+#endif // NO_LOGS_COMMAND
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// Virtual Sequences and Cursor Control
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+#ifndef CUSTOM_CURSOR_CONTROL
+/**
+ * @brief Move the cursor n times in the provided direction.
+ * @param direction Direction to move the cursor, using ws_cursor_t.
+ * @param n Amount of times to move in that direction.
+ */
+void ws_moveCursor_n(ws_cursor_t direction, size_t n) {
+	switch (direction) {
+		case WS_CURSOR_LEFT: {
+				fprintf(ws_out_stream, "\033[%zuD", n);
+				break;
+			}
+		case WS_CURSOR_RIGHT: {
+				fprintf(ws_out_stream, "\033[%zuC", n);
+				break;
+			}
+		case WS_CURSOR_UP: {
+				fprintf(ws_out_stream, "\033[%zuA", n);
+				break;
+			}
+		case WS_CURSOR_DOWN: {
+				fprintf(ws_out_stream, "\033[%zuB", n);
+				break;
+			}
+		default: break;
+	}
+}
+
+/**
+ * @brief Moves the cursor once in the provided direction.
+ * @param direction Direction to move, using ws_cursor_t.
+ */
+void ws_moveCursor(ws_cursor_t direction) { ws_moveCursor_n(direction, 1); }
+#endif // CUSTOM_CURSOR_CONTROL
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// Execute command & Main
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+#ifndef DISABLE_MALLOC
+#ifndef WS_OUTPUT_CACHE_SIZE
+#define WS_OUTPUT_CACHE_SIZE 32
+#endif // WS_OUTPUT_CACHE_SIZE
+
+#ifdef _WIN32
+/**
+ * @internal
+ * @brief Reads a capture file back into a malloc'd, null terminated buffer, and closes it.
+ *
+ * Windows has no memory streams, so captures go to a temporary file instead.
  */
-int clearMain(int argc, char** argv) {
+bool ws_internal_readCapture(FILE* capture, char** output, size_t* length) {
+	long size = -1;
+	if (fflush(capture) == 0 && fseek(capture, 0, SEEK_END) == 0) size = ftell(capture);
+	if (size >= 0) *output = malloc((size_t) size + 1);
+	if (!*output) {
+		fclose(capture);
+		return false;
+	}
+	rewind(capture);
+	*length = fread(*output, 1, (size_t) size, capture);
+	(*output)[*length] = '\0';
+	fclose(capture);
+	return true;
+}
+#endif // _WIN32
+
+/*
+ * Output of a line run by a command with cache_ttl_ms set. key is the line's arguments, joined by single spaces.
+ * The command is kept so that every line of it can be invalidated at once.
+ * Output recorded with colors is only replayed to streams that show them, and the other way around.
+ */
+typedef struct {
+	ws_command_t command;
+	char* key;
+	bool colors;
+	char* output;
+	size_t length;
+	int exit_code;
+	unsigned long long expires;   // In milliseconds, see ws_internal_cacheClock.
+	unsigned long long last_used; // For replacing the least recently used one. 0 if it's empty.
+} ws_output_cache_entry_t;
+
+ws_output_cache_entry_t output_cache[WS_OUTPUT_CACHE_SIZE];
+unsigned long long output_cache_uses = 0;
+
+#ifdef THREADED_SUPPORT
+// Created on first use, the same way as the color mutex.
+ws_atomic_ptr_t output_cache_mutex = WS_ATOMIC_INIT(NULL);
+void ws_internal_output_cache_mutex_check() {
+	if (ws_getAtomicPtr(&output_cache_mutex)) return;
+	ws_mutex_t* created = ws_createMutex();
+	if (!created) return;
+	void* expected = NULL;
+	if (!ws_compareExchangeAtomicPtr(&output_cache_mutex, &expected, created)) ws_destroyMutex(created);
+}
+#define OUTPUT_CACHE_MUTEX_CHECK ws_internal_output_cache_mutex_check()
+#define LOCK_OUTPUT_CACHE_MUTEX ws_lockMutex((ws_mutex_t*) ws_getAtomicPtr(&output_cache_mutex))
+#define UNLOCK_OUTPUT_CACHE_MUTEX ws_unlockMutex((ws_mutex_t*) ws_getAtomicPtr(&output_cache_mutex))
+#else
+#define OUTPUT_CACHE_MUTEX_CHECK
+#define LOCK_OUTPUT_CACHE_MUTEX
+#define UNLOCK_OUTPUT_CACHE_MUTEX
+#endif // THREADED_SUPPORT
+
+/**
+ * @internal
+ * @brief Reads a monotonic clock, for expiring cached output.
+ * @return Time in milliseconds.
+ */
+unsigned long long ws_internal_cacheClock() {
 #ifdef _WIN32
-	// Windows being windows, some escape characters don't work normally in like 2/3 of the terminals
-	// This is especially evident in things spawned by AllocConsole()
-	system("cls");
+	return (unsigned long long) GetTickCount64();
 #else
-	// Unix is much nicer
-	fprintf(ws_out_stream, "\033c");
-#endif
-	// Sometimes clearing the screen results in the colors getting reset.
-	ws_internal_updateColors();
-	return 0;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000ULL + (unsigned long long) ts.tv_nsec / 1000000ULL;
+#endif // _WIN32
 }
 
-/* Internal help command */
 /**
  * @internal
- * @brief Help function search command
+ * @brief Frees a cached output and marks its entry as empty. Must be called with the output cache mutex held.
  */
-void helpSearch(char* str) {
-	ws_setConsoleColors((ws_color_t) { WS_FG_YELLOW, WS_BG_DEFAULT });
-	fprintf(ws_out_stream, "List of commands starting with \"%s\": (A) indicates an alias.\n", str);
-	ws_setConsoleColors(ws_getDefaultColors());
-	for (int i = 0; i < current_command_spot; i++) {
-		ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_GREEN, WS_BG_DEFAULT });
-		if (commands[i].commandName && ws_internal_startsWith(commands[i].commandName, str)) {
-			fprintf(ws_out_stream, "\t%s\n", commands[i].commandName);
+void ws_internal_dropCachedOutput(ws_output_cache_entry_t* entry) {
+	free(entry->key);
+	free(entry->output);
+	memset(entry, 0, sizeof(ws_output_cache_entry_t));
+}
+
+/**
+ * @internal
+ * @brief Looks up the output of a line, and copies it out if it hasn't expired.
+ * @param colors Whether the output is going to a stream that shows colors.
+ * @param output Set to a malloc'd copy of the output, which the caller has to free.
+ * @return true if it was found.
+ */
+bool ws_internal_findCachedOutput(const ws_command_t* command, const char* key, bool colors, char** output, size_t* length,
+								  int* exit_code) {
+	bool found = false;
+	unsigned long long now = ws_internal_cacheClock();
+	OUTPUT_CACHE_MUTEX_CHECK;
+	LOCK_OUTPUT_CACHE_MUTEX;
+	for (size_t i = 0; i < WS_OUTPUT_CACHE_SIZE; i++) {
+		ws_output_cache_entry_t* entry = &output_cache[i];
+		if (!entry->last_used || entry->colors != colors || strcmp(entry->key, key) != 0 ||
+			!ws_compareCommands(entry->command, *command)) {
+			continue;
+		}
+		if (now >= entry->expires) {
+			ws_internal_dropCachedOutput(entry);
+			break;
 		}
+		// Copied, since it could be invalidated by another thread while it's being printed.
+		*output = malloc(entry->length + 1);
+		if (!*output) break;
+		memcpy(*output, entry->output, entry->length + 1);
+		*length = entry->length;
+		*exit_code = entry->exit_code;
+		entry->last_used = ++output_cache_uses;
+		found = true;
+		break;
+	}
+	UNLOCK_OUTPUT_CACHE_MUTEX;
+	return found;
+}
 
-		// Check aliases for a match
-		for (size_t alias_idx = 0; alias_idx < commands[i].aliases_count; alias_idx++) {
-			if (commands[i].aliases[alias_idx] && ws_internal_startsWith(commands[i].aliases[alias_idx], str)) {
-				fprintf(ws_out_stream, "\t%s (A)\n", commands[i].aliases[alias_idx]);
-			}
+/**
+ * @internal
+ * @brief Caches the output of a line, replacing the least recently used entry if they're all taken.
+ * @param key Taken over by the cache.
+ * @param colors Whether colors were written into the output.
+ * @param output Taken over by the cache.
+ */
+void ws_internal_storeCachedOutput(const ws_command_t* command, char* key, bool colors, char* output, size_t length,
+								   int exit_code) {
+	unsigned long long expires = ws_internal_cacheClock() + command->cache_ttl_ms;
+	OUTPUT_CACHE_MUTEX_CHECK;
+	LOCK_OUTPUT_CACHE_MUTEX;
+	ws_output_cache_entry_t* slot = &output_cache[0];
+	for (size_t i = 0; i < WS_OUTPUT_CACHE_SIZE; i++) {
+		ws_output_cache_entry_t* entry = &output_cache[i];
+		// Another thread may have run the same line in the meantime.
+		if (entry->last_used && entry->colors == colors && strcmp(entry->key, key) == 0 &&
+			ws_compareCommands(entry->command, *command)) {
+			slot = entry;
+			break;
 		}
-		ws_setConsoleColors(ws_getDefaultColors());
+		if (entry->last_used < slot->last_used) slot = entry;
+	}
+	ws_internal_dropCachedOutput(slot);
+	slot->command = *command;
+	slot->key = key;
+	slot->colors = colors;
+	slot->output = output;
+	slot->length = length;
+	slot->exit_code = exit_code;
+	slot->expires = expires;
+	slot->last_used = ++output_cache_uses;
+	UNLOCK_OUTPUT_CACHE_MUTEX;
+}
+
+/**
+ * @brief Throws away cached output, so the next run of a line calls the command again. See ws_command_t::cache_ttl_ms.
+ * @param command Name of the command whose output should go, followed by the names of any subcommands leading to it,
+ * like "status" or "remote show". NULL throws away everything.
+ */
+void ws_invalidateCachedOutput(const char* command) {
+	ws_command_t target;
+	if (command) {
+		char buf[MAX_COMMAND_BUF];
+		size_t len = strlen(command);
+		if (len >= sizeof(buf)) return;
+		memcpy(buf, command, len + 1);
+		char* words[MAX_COMMAND_BUF / 2 + 1];
+		int count = 0;
+		char* rest = buf;
+		while ((words[count] = ws_internal_nextToken(&rest)) != NULL) count++;
+		int depth;
+		if (!ws_internal_resolveCommand(count, words, &target, &depth, NULL, NULL) || depth != count - 1) return;
 	}
+	OUTPUT_CACHE_MUTEX_CHECK;
+	LOCK_OUTPUT_CACHE_MUTEX;
+	for (size_t i = 0; i < WS_OUTPUT_CACHE_SIZE; i++) {
+		ws_output_cache_entry_t* entry = &output_cache[i];
+		if (entry->last_used && (!command || ws_compareCommands(entry->command, target))) ws_internal_dropCachedOutput(entry);
+	}
+	UNLOCK_OUTPUT_CACHE_MUTEX;
 }
 
 /**
  * @internal
- * @brief Help function help command
+ * @brief Throws away all cached output, and the mutex guarding it.
  */
-int helpHelp(int argc, char** argv) {
-	const char* optional[] = {
-			"-s <string> -> Lists all commands and aliases that start with <string>."
-	};
-	ws_help_entry_specific_t entry = {
-			"Help",
-			"The help menu.",
-			NULL,
-			0,
-			optional,
-			1
-	};
-	ws_printSpecificHelp(&entry);
-	return 0;
+void ws_internal_cleanOutputCache() {
+	ws_invalidateCachedOutput(NULL);
+#ifdef THREADED_SUPPORT
+	ws_mutex_t* mut = (ws_mutex_t*) ws_exchangeAtomicPtr(&output_cache_mutex, NULL);
+	if (mut) ws_destroyMutex(mut);
+#endif // THREADED_SUPPORT
 }
 
 /**
  * @internal
- * @brief Help function main command
+ * @brief Makes colors go to a capture the same way they'd go to the stream it's standing in for, so they're part of
+ * the output that's cached.
+ * @param capture The capture, or NULL once it's done, to forget about it before it's closed.
+ * @param colors Whether the stream it's standing in for shows colors.
  */
-int helpMain(int argc, char** argv) {
-	// Make sure there's more than one argument.
-	if (argc > 1) {
-		// remove help from argv
-		// Shift all pointers one position to the left
-		for (int i = 1; i < argc; i++) {
-			argv[i - 1] = argv[i];
-		}
-		argv[argc - 1] = NULL;
+void ws_internal_captureColors(ws_session_t* session, FILE* capture, bool colors) {
+	COLOR_MUTEX_CHECK;
+	LOCK_COLOR_MUTEX;
+	session->emitted_stream = capture;
+	session->emitted_valid = false;
+	session->stream_has_colors = capture && colors;
+	UNLOCK_COLOR_MUTEX;
+}
+#endif // DISABLE_MALLOC
 
-		// Update the size of the array
-		argc--;
-		// Check for more args
-		if (argc >= 1) {
-			if ((strcmp(argv[0], "-s") == 0) || (strcmp(argv[0], "-search") == 0)) {
-				if (argc == 1) {
-					ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
-					fprintf(ws_out_stream, "Search flag must be followed by an argument.\n");
-				} else {
-					helpSearch(argv[1]);
-					return 0;
-				}
-			}
-		}
+/**
+ * @internal
+ * @brief Calls a command that's been copied out of the registry.
+ * @param index Lookup tables of the command's schema, copied out along with it. Only used if it has a schema.
+ * @param depth How many arguments after the first one named subcommands, see ws_internal_resolveCommand.
+ * @return What the command returned.
+ */
+int ws_internal_invokeCommand(const ws_command_t* command, const ws_arg_index_t* index, int argc, char** argv, int depth) {
+	// A subcommand runs like a command of its own, with the arguments from its name on.
+	int sub_argc = argc - depth;
+	char** sub_argv = argv + depth;
+	if (command->schema) return ws_internal_runSchema(command->schema, index, sub_argc, sub_argv);
+	if (command->mainCommand) return command->mainCommand(sub_argc, sub_argv);
+	return ws_internal_missingSubcommand(argc, argv, depth);
+}
 
-		// Find the command
-		for (int i = 0; i < current_command_spot; i++) {
-			// Check the normal command name
-			if (commands[i].commandName && strcmp(commands[i].commandName, argv[0]) == 0) {
-				// No help function for command.
-				if (!commands[i].helpCommand) {
-					ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
-					fprintf(ws_out_stream, "Command \"%s\" does not have a help function.\n", argv[0]);
-					ws_setConsoleColors(ws_getDefaultColors());
-					return 0;
-				}
+#ifndef DISABLE_MALLOC
+/**
+ * @internal
+ * @brief Calls a command with cache_ttl_ms set. Prints the cached output of the line if there is one, and otherwise
+ * runs the command, capturing its output to print and cache it.
+ * @return What the command returned, now or when it was cached.
+ */
+int ws_internal_invokeCachedCommand(const ws_command_t* command, const ws_arg_index_t* index, int argc, char** argv,
+									 int depth) {
+	size_t key_len = 0;
+	for (int i = 0; i < argc; i++) key_len += strlen(argv[i]) + 1;
+	char* key = malloc(key_len);
+	if (!key) return ws_internal_invokeCommand(command, index, argc, argv, depth);
+	key[0] = '\0';
+	for (int i = 0; i < argc; i++) {
+		if (i > 0) strcat(key, " ");
+		strcat(key, argv[i]);
+	}
 
-				// Execute the help command associated with the matched command
-				int result = commands[i].helpCommand(argc, argv);
-				if (result != 0) {
-					// If the command function returns a non-zero value, it may indicate an error
-					ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
-					fprintf(ws_out_stream, "Command exited with code: %d\n", result);
-					ws_setConsoleColors(ws_getDefaultColors());
-				}
-				return 0;
-			}
+	ws_session_t* session = ws_internal_session();
+	FILE* out = ws_internal_stream(session, WS_OUTPUT);
+	// The same line can be run with and without colors, by sessions or captures, so they're cached separately.
+	bool colors = out && ws_internal_streamHasColors(session->color_mode, out);
+	char* output = NULL;
+	size_t length = 0;
+	int result;
+	if (ws_internal_findCachedOutput(command, key, colors, &output, &length, &result)) {
+		free(key);
+		fwrite(output, 1, length, ws_out_stream);
+		free(output);
+		// Whatever colors the output left the stream in aren't the ones we think it has.
+		ws_internal_invalidateColors();
+		return result;
+	}
 
-			// Check aliases for a match
-			for (size_t alias_idx = 0; alias_idx < commands[i].aliases_count; alias_idx++) {
-				if (commands[i].aliases[alias_idx] && strcmp(commands[i].aliases[alias_idx], argv[0]) == 0) {
-					// No help function for command.
-					if (!commands[i].helpCommand) {
-						ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
-						fprintf(ws_out_stream, "Command \"%s\" does not have a help function.\n", argv[0]);
-						ws_setConsoleColors(ws_getDefaultColors());
-						return 0;
-					}
+#ifdef _WIN32
+	FILE* capture = tmpfile();
+#else
+	FILE* capture = open_memstream(&output, &length);
+#endif // _WIN32
+	// Nothing to capture with, so it just isn't cached.
+	if (!capture || ws_pushThreadStream(WS_OUTPUT, capture) != WS_NO_ERROR) {
+		if (capture) fclose(capture);
+		free(output);
+		free(key);
+		return ws_internal_invokeCommand(command, index, argc, argv, depth);
+	}
+	size_t pushed_out = thread_stream_count[WS_OUTPUT] - 1;
+	ws_internal_captureColors(session, capture, colors);
+	result = ws_internal_invokeCommand(command, index, argc, argv, depth);
+	// Also drops anything the command pushed and didn't pop.
+	thread_stream_count[WS_OUTPUT] = pushed_out;
+	ws_internal_captureColors(session, NULL, false);
+
+	bool captured;
+#ifdef _WIN32
+	captured = ws_internal_readCapture(capture, &output, &length);
+#else
+	captured = fclose(capture) == 0 && output;
+#endif // _WIN32
+	if (!captured) {
+		// The output is lost, but the command did run.
+		free(output);
+		free(key);
+		return result;
+	}
+	fwrite(output, 1, length, ws_out_stream);
+	ws_internal_storeCachedOutput(command, key, colors, output, length, result);
+	return result;
+}
+#endif // DISABLE_MALLOC
 
-					// Execute the help command associated with the matched alias
-					int result = commands[i].helpCommand(argc, argv);
-					if (result != 0) {
-						// If the command function returns a non-zero value, it may indicate an error
-						ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
-						fprintf(ws_out_stream, "Command exited with code: %d\n", result);
-						ws_setConsoleColors(ws_getDefaultColors());
-					}
-					return 0;
-				}
-			}
-		}
-		// If the command is not found in the registered commands or their aliases
-		ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
-		fprintf(ws_out_stream, "Help command not found for: %s\n", argv[0]);
-	} else {
-		fprintf(ws_out_stream, "\n");
-		ws_setConsoleColors((ws_color_t) { WS_FG_CYAN, WS_BG_DEFAULT });
-		fprintf(ws_out_stream, "To get more info about a command, run `help <command_name>`\n");
-		ws_setConsoleColors((ws_color_t) { WS_FG_YELLOW, WS_BG_DEFAULT });
-		fprintf(ws_out_stream, "All commands:\n");
+/**
+ * @internal
+ * @brief Splits a command into arguments and runs it, without printing anything of its own.
+ * @param commandBuf Buffer containing the command to execute. It's split up in place.
+ * @param name Set to the command's name inside commandBuf, or NULL if the buffer was empty.
+ * @param found Set to whether a command by that name is registered.
+ * @param result Set to what the command's mainCommand returned, or 0 if it wasn't run.
+ * @return Can return WS_OUT_OF_MEMORY if malloc returns NULL when DISABLE_MALLOC is not defined.
+ */
+ws_error_t ws_internal_runCommand(char* commandBuf, const char** name, bool* found, int* result) {
+	*name = NULL;
+	*found = false;
+	*result = 0;
+#ifdef DISABLE_MALLOC
+	// Split the commandBuf into arguments based on spaces or other delimiters
+	int argc = 0;
+	char* argv[MAX_ARGS];
+	char* rest = commandBuf;
+	char* current = ws_internal_nextToken(&rest);
+	*name = current;
+	while (current != NULL) {
+		if (argc >= MAX_ARGS) break;
+		// allocates memory for the string and copies it
+		argv[argc] = current;
+		current = ws_internal_nextToken(&rest);
+		argc++;
+	}
+	if (argc == 0) return WS_NO_ERROR;
+#else
+	// We treat this like system execution does with int argc & char** argv.
+	// argv[0] is always the command name, argc always is at least 1 because of this
+	int argc = 0;
+	char** argv = NULL;
+	char* rest = commandBuf;
+	char* current = ws_internal_nextToken(&rest);
+	// Tokens point into commandBuf, so the name outlives the copies made below.
+	*name = current;
 
-		ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_GREEN, WS_BG_DEFAULT });
-		// List all available commands
-		for (int i = 0; i < current_command_spot; i++) {
-			if (commands[i].commandName) {
-				fprintf(ws_out_stream, "  %s\n", commands[i].commandName);
+	while (current != NULL) {
+		char** newptr = (char**) realloc(argv, sizeof(char*) * (argc + 1));
+		if (!newptr) {
+			if (argv) {
+				// free each string allocated by strdup
+				for (int i = 0; i < argc; i++) free(argv[i]);
+				free(argv);
 			}
+			return WS_OUT_OF_MEMORY;
+		} else {
+			argv = newptr;
 		}
-		fprintf(ws_out_stream, "\n");
+		// allocates memory for the string and copies it
+		char* str = malloc(strlen(current) + 1);
+		strcpy(str, current);
+		argv[argc] = str;
+		current = ws_internal_nextToken(&rest);
+		argc++;
+	}
+	if (argc == 0) {
+		// Somehow got an empty command.
+		if (argv) free(argv);
+		return WS_NO_ERROR;
+	}
+#endif // DISABLE_MALLOC
+	// Call Command (if it exists). It's copied out of the registry first, so it can (de)register commands itself.
+	ws_command_t command;
+	ws_arg_index_t index;
+	int depth;
+	if (ws_internal_resolveCommand(argc, argv, &command, &depth, NULL, &index)) {
+		*found = true;
+#ifndef DISABLE_MALLOC
+		if (command.cache_ttl_ms) *result = ws_internal_invokeCachedCommand(&command, &index, argc, argv, depth);
+		else
+#endif // DISABLE_MALLOC
+			*result = ws_internal_invokeCommand(&command, &index, argc, argv, depth);
+	}
+#ifndef DISABLE_MALLOC
+	for (int i = 0; i < argc; i++) free(argv[i]);
+	free(argv);
+#endif // DISABLE_MALLOC
+	return WS_NO_ERROR;
+}
+
+/**
+ * @brief Execute a command with the provided buffer.
+ * @param commandBuf Buffer containing the command to execute, including any flags, parameters, etc.
+ * @return Can return WS_OUT_OF_MEMORY if malloc returns NULL when DISABLE_MALLOC is not defined.
+ */
+ws_error_t ws_executeCommand(char* commandBuf) {
+	const char* name;
+	bool found;
+	int result;
+	ws_error_t error = ws_internal_runCommand(commandBuf, &name, &found, &result);
+	if (error != WS_NO_ERROR || !name) return error;
+	if (!found) {
+		ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
+		fprintf(ws_out_stream, "Command not found: \"%s\"\n", name);
+	} else if (result != 0) {
+		// If the command function returns a non-zero value, it may indicate an error
+		ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
+		fprintf(ws_out_stream, "Command exited with code: %d\n", result);
 	}
 	ws_setConsoleColors(ws_getDefaultColors());
-	return 0;
+	return WS_NO_ERROR;
 }
 
-/* Internal history command */
-const char* history_aliases[] = { "hist" };
 /**
- * @internal
- * @brief History function help command
+ * @brief Execute a command in a session, as if it was typed into the session's terminal.
+ * @param session Session to run the command in. Its output goes to the session's output stream.
+ * @param commandBuf Buffer containing the command to execute, including any flags, parameters, etc.
+ * @return Same as ws_executeCommand().
  */
-int historyHelp(int argc, char** argv) {
-	ws_help_entry_general_t entry = {
-			"History",
-			"Displays the terminal history. Limit of 32 previous commands.",
-			NULL,
-			0,
-			history_aliases,
-			1
-	};
-	ws_printGeneralHelp(&entry);
-	return 0;
+ws_error_t ws_sessionExecuteCommand(ws_session_t* session, char* commandBuf) {
+	ws_session_t* previous = ws_useSession(session);
+	ws_error_t err = ws_executeCommand(commandBuf);
+	// Nothing else flushes it when the session's terminal isn't running.
+	FILE* out = ws_internal_stream(session, WS_OUTPUT);
+	if (out) fflush(out);
+	ws_useSession(previous);
+	return err;
 }
 
+#ifndef DISABLE_MALLOC
 /**
- * @internal
- * @brief History function main command
+ * @brief Executes a command, capturing everything it and WallShell print while it runs.
+ *
+ * The command runs in a session of its own, so captures running on other threads, and whatever the calling thread's
+ * session is printing to, aren't affected. Colors are never written into the capture, and ws_promptUser() answers no.
+ * Unlike ws_executeCommand(), nothing is added about the command not being found or its exit code.
+ *
+ * @param commandBuf Buffer containing the command to execute, including any flags, parameters, etc.
+ * @param output Set to a null terminated buffer holding the output. It belongs to the caller, who has to free() it,
+ * even when an error is returned.
+ * @param length Set to the length of the output, not counting the terminator.
+ * @param exitCode Set to what the command's mainCommand returned, or 0 if it wasn't run. Can be NULL.
+ * @return WS_COMMAND_NOT_FOUND if there's no such command, or WS_OUT_OF_MEMORY if the output couldn't be stored.
  */
-int historyMain(int argc, char** argv) {
-	ws_setConsoleColors((ws_color_t) { WS_FG_YELLOW, WS_BG_DEFAULT });
-	for (size_t i = 0; i < previous_commands_size; i++) {
-		fprintf(ws_out_stream, "%s\n", previousCommands[i]);
+ws_error_t ws_executeCommandCapture(char* commandBuf, char** output, size_t* length, int* exitCode) {
+	*output = NULL;
+	*length = 0;
+	if (exitCode) *exitCode = 0;
+#ifdef _WIN32
+	FILE* capture = tmpfile();
+#else
+	// Grows as the command prints, and hands its buffer over as is once it's closed.
+	FILE* capture = open_memstream(output, length);
+#endif // _WIN32
+	if (!capture) return WS_OUT_OF_MEMORY;
+	ws_session_t* session = ws_createSession(NULL, capture, capture);
+	if (!session) {
+		fclose(capture);
+		return WS_OUT_OF_MEMORY;
 	}
-	ws_setConsoleColors(ws_getDefaultColors());
-	return 0;
+
+	// Pushed on top of any streams the caller pushed, which would take the output away from the capture otherwise.
+	size_t pushed_out = thread_stream_count[WS_OUTPUT];
+	size_t pushed_err = thread_stream_count[WS_ERROR_S];
+	if (ws_pushThreadStream(WS_OUTPUT, capture) != WS_NO_ERROR || ws_pushThreadStream(WS_ERROR_S, capture) != WS_NO_ERROR) {
+		thread_stream_count[WS_OUTPUT] = pushed_out;
+		ws_destroySession(session);
+		fclose(capture);
+		return WS_STREAM_LIMIT_REACHED;
+	}
+	ws_session_t* previous = ws_useSession(session);
+	ws_setColorMode(WS_COLOR_NEVER);
+	const char* name;
+	bool found;
+	int result;
+	ws_error_t error = ws_internal_runCommand(commandBuf, &name, &found, &result);
+	ws_useSession(previous);
+	// Also drops anything the command pushed and didn't pop.
+	thread_stream_count[WS_OUTPUT] = pushed_out;
+	thread_stream_count[WS_ERROR_S] = pushed_err;
+	ws_destroySession(session);
+
+	if (error == WS_NO_ERROR && name && !found) error = WS_COMMAND_NOT_FOUND;
+	if (exitCode) *exitCode = result;
+#ifdef _WIN32
+	if (!ws_internal_readCapture(capture, output, length)) return WS_OUT_OF_MEMORY;
+#else
+	if (fclose(capture) != 0 && error == WS_NO_ERROR) error = WS_OUT_OF_MEMORY;
+#endif // _WIN32
+	return error;
 }
+#endif // DISABLE_MALLOC
 
-#ifdef THREADED_SUPPORT
-ws_atomic_bool_t* exit_terminal = NULL;
+/**
+ * @brief Set the current session's prefix to the provided one.
+ *
+ * The prefix is what is displayed at the start of a command line.
+ * It is possible to use this function to imitate a bash like `user@name:path$`, or any other combination.
+ *
+ * @param newPrefix
+ */
+void ws_setConsolePrefix(const char* newPrefix) { ws_internal_session()->prefix = newPrefix; }
+
+#ifdef DISABLE_MALLOC
+#ifndef WS_SESSION_LIMIT
+#define WS_SESSION_LIMIT 4
+#endif // WS_SESSION_LIMIT
+ws_session_t session_pool[WS_SESSION_LIMIT];
+#endif // DISABLE_MALLOC
 
 /**
  * @internal
- * @brief Checks exit bool, makes sure it exists.
+ * @brief Destroys a session's events.
  */
-void ws_internal_checkExitBool() {
-	if (!exit_terminal) exit_terminal = ws_createAtomicBool(false);
+void ws_internal_cleanSessionEvents(ws_session_t* session) {
+#ifdef THREADED_SUPPORT
+	ws_destroyEvent((ws_event_t*) ws_exchangeAtomicPtr(&session->wake, NULL));
+	ws_destroyEvent((ws_event_t*) ws_exchangeAtomicPtr(&session->stopped, NULL));
+#else
+	(void) session;
+#endif // THREADED_SUPPORT
 }
-#define CHECK_EXIT_BOOL_EXISTS ws_internal_checkExitBool()
-#define GET_EXIT_BOOL ws_getAtomicBool(exit_terminal)
-#define SET_EXIT_BOOL(b) ws_setAtomicBool(exit_terminal, b)
 
 /**
- * @brief Stops the currently running terminal. Only supported in threaded applications.
+ * @brief Creates a session, with its own streams, history, prompt and colors.
+ *
+ * It starts out like the default session, except ASCII delete is read as backspace, since most remote clients send it.
+ * The streams aren't closed when the session is destroyed.
+ *
+ * @param in Input stream, or NULL for stdin.
+ * @param out Output stream, or NULL for stdout.
+ * @param err Error stream, or NULL for stderr.
+ * @return The session, or NULL if it couldn't be allocated. With DISABLE_MALLOC, NULL if WS_SESSION_LIMIT was reached.
  */
-void ws_stopTerminal() { SET_EXIT_BOOL(true); }
+ws_session_t* ws_createSession(FILE* in, FILE* out, FILE* err) {
+	ws_session_t* session = NULL;
+#ifdef DISABLE_MALLOC
+	for (size_t i = 0; i < WS_SESSION_LIMIT && !session; i++) {
+		if (!session_pool[i].in_use) session = &session_pool[i];
+	}
+	if (!session) return NULL;
+	ws_internal_initSession(session);
+	session->in_use = true;
 #else
-bool exit_terminal = false;
-#define CHECK_EXIT_BOOL_EXISTS
-#define GET_EXIT_BOOL exit_terminal
-#define SET_EXIT_BOOL(b) exit_terminal = b
-#endif
+	session = malloc(sizeof(ws_session_t));
+	if (!session) return NULL;
+	ws_internal_initSession(session);
+#endif // DISABLE_MALLOC
+	session->in_stream = in;
+	session->out_stream = out;
+	session->err_stream = err;
+	session->backspace_as_ascii_delete = true;
+#if !defined(CUSTOM_WS_SETUP) && !defined(_WIN32)
+	// The terminal checks the file descriptor for input, so nothing can be left sitting in a stdio buffer.
+	if (in && in != stdin) setvbuf(in, NULL, _IONBF, 0);
+#endif // !CUSTOM_WS_SETUP && !_WIN32
+	return session;
+}
 
-/* Internal exit command */
 /**
- * @internal
- * @brief Exit function help command
+ * @brief Destroys a session made with ws_createSession(). Its terminal must not be running.
+ * @param session Session to destroy. The default session can't be destroyed, so it's ignored.
  */
-int exitHelp(int argc, char** argv) {
-	const char* optional[] = {
-			"--yes",
-			"-y   -> Exits the terminal without the prompt."
-	};
-	ws_help_entry_specific_t entry = {
-			"Exit",
-			"Exits the terminal.",
-			NULL,
-			0,
-			optional,
-			2
-	};
-	ws_printSpecificHelp(&entry);
-	return 0;
+void ws_destroySession(ws_session_t* session) {
+	if (!session || session == &default_session) return;
+	if (current_session == session) current_session = NULL;
+	ws_internal_cleanSessionEvents(session);
+#ifdef DISABLE_MALLOC
+	session->in_use = false;
+#else
+	free(session);
+#endif // DISABLE_MALLOC
 }
 
 /**
  * @internal
- * @brief Exit function main command
+ * @brief Adds a command to the front of a session's history, unless it's the same as the last one.
  */
-int exitMain(int argc, char** argv) {
-	if (argc > 1) {
-		if ((strcmp(argv[1], "-y") == 0 || strcmp(argv[1], "--yes") == 0)) {
-			SET_EXIT_BOOL(true);
-		} else {
-			ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
-			fprintf(ws_out_stream, "Unknown argument: %s\n", argv[1]);
-			ws_setConsoleColors(ws_getDefaultColors());
-		}
-	} else {
-		SET_EXIT_BOOL(ws_promptUser("Are you sure you want to exit?"));
-	}
-	printf("\n");
-	return 0;
+void ws_internal_addHistory(ws_session_t* session, const char* command) {
+	if (session->history_size > 0 && strcmp(session->history[0], command) == 0) return;
+	// The oldest command falls off the end once the history is full.
+	size_t kept = session->history_size < PREVIOUS_BUF_SIZE ? session->history_size : PREVIOUS_BUF_SIZE - 1;
+	memmove(session->history[1], session->history[0], kept * MAX_COMMAND_BUF);
+	memset(session->history[0], 0, MAX_COMMAND_BUF);
+	memcpy(session->history[0], command, strlen(command));
+	if (session->history_size < PREVIOUS_BUF_SIZE) session->history_size++;
 }
 
 /**
- * @internal
- * @brief Registers all base commands.
+ * @brief Cleans everything.
+ *
+ * Resets everything to it's default state, frees all allocations, etc.
+ * Ideally you should call this before you exit, but the system garbage collector should clean it up.
+ * Don't rely on the system gc for critical applications.
  */
-void ws_internal_registerBasicCommands() {
-	// We static define the aliases for basic commands.
-	// We dont use malloc because we dont want to deal with having to free anything
-	// It also would be way messier for DISABLE_MALLOC if we did allocate things.
-	// WallShell wants just the pointers, cleaning it up is the user's responsibility
-
-	// a bare shell only has help, exit, clear, and history
-	// might come up with some more overtime, such as echo, but it's not a big priority.
-#ifndef NO_CLEAR_COMMAND
-	ws_registerCommand((ws_command_t) { clearMain, clearHelp, "clear", clear_aliases, 2 });
-#endif // NO_CLEAR_COMMAND
-
-#ifndef NO_HELP_COMMAND
-	ws_registerCommand((ws_command_t) { helpMain, helpHelp, "help", NULL, 0 });
-#endif // NO_HELP_COMMAND
-
-#ifndef NO_HISTORY_COMMAND
-	ws_registerCommand((ws_command_t) { historyMain, historyHelp, "history", history_aliases, 1 });
-#endif // NO_HISTORY_COMMAND
-
-#ifndef NO_EXIT_COMMAND
-	ws_registerCommand((ws_command_t) { exitMain, exitHelp, "exit", NULL, 0 });
-#endif // NO_EXIT_COMMAND
+void ws_cleanAll() {
+	// Sessions made with ws_createSession() are left alone, only the default one is reset.
+	current_session = NULL;
+	ws_internal_cleanSessionEvents(&default_session);
+	ws_internal_initSession(&default_session);
+#if defined(THREADED_SUPPORT) && !defined(NO_WS_THREAD_POOL)
+	ws_internal_cleanThreadPool();
+#endif // THREADED_SUPPORT && !NO_WS_THREAD_POOL
+	ws_internal_cleanCommands();
+#ifndef DISABLE_MALLOC
+	ws_internal_cleanOutputCache();
+#endif // DISABLE_MALLOC
+#ifdef WS_PLUGIN_COMMANDS
+	ws_internal_cleanPlugins();
+#endif // WS_PLUGIN_COMMANDS
+	ws_internal_cleanColors();
+#ifndef NO_WS_LOGGING
+	ws_internal_cleanLogger();
+#endif // NO_WS_LOGGING
+#if defined(WS_BINARY_LOGGING) && !defined(NO_WS_LOGGING)
+	ws_internal_cleanBinaryLog();
+#endif // WS_BINARY_LOGGING
+	ws_resetConsoleState();
 }
 
-// ------------------------------------------------------------------------------------------------
-// ------------------------------------------------------------------------------------------------
-// Virtual Sequences and Cursor Control
-// ------------------------------------------------------------------------------------------------
-// ------------------------------------------------------------------------------------------------
-/* Input */
-typedef enum {
-	NONE = 0,
-	CURSOR,
-	FUNCTION,
-} input_type_t;
+/**
+ * @internal
+ * @brief Prints the prompt if the last command line was finished, and starts a new one.
+ */
+void ws_internal_startLine(ws_session_t* session) {
+	if (!session->new_command) return;
+	fprintf(ws_out_stream, "%s", session->prefix);
+	session->new_command = false;
+	session->tab_pressed = false;
+	session->position_in_previous = 0;
+	session->current_position = 1;
+	memset(session->old_command, 0, MAX_COMMAND_BUF);
+	memset(session->command_buf, 0, MAX_COMMAND_BUF);
+}
 
-#ifndef CUSTOM_CURSOR_CONTROL
 /**
- * @brief Move the cursor n times in the provided direction.
- * @param direction Direction to move the cursor, using ws_cursor_t.
- * @param n Amount of times to move in that direction.
+ * @internal
+ * @brief Handles an arrow key.
+ * @param direction Which arrow, using ws_cursor_t.
  */
-void ws_moveCursor_n(ws_cursor_t direction, size_t n) {
+void ws_internal_cursorInput(ws_session_t* session, int direction) {
+	char* commandBuf = session->command_buf;
 	switch (direction) {
-		case WS_CURSOR_LEFT: {
-				fprintf(ws_out_stream, "\033[%zuD", n);
+		case WS_CURSOR_UP: {
+				CLEAR_ROW;
+				if (session->position_in_previous == 0) {
+					memset(session->old_command, 0, MAX_COMMAND_BUF);
+					memcpy(session->old_command, commandBuf, MAX_COMMAND_BUF);
+				}
+				const char* previous = session->history[session->position_in_previous];
+				memset(commandBuf, 0, MAX_COMMAND_BUF);
+				memcpy(commandBuf, previous, strlen(previous));
+				fprintf(ws_out_stream, "\r%s%s", session->prefix, commandBuf);
+				if (session->history_size > 0 && session->position_in_previous < session->history_size - 1) {
+					session->position_in_previous++;
+				}
+				session->current_position = 1;
 				break;
 			}
-		case WS_CURSOR_RIGHT: {
-				fprintf(ws_out_stream, "\033[%zuC", n);
+		case WS_CURSOR_DOWN: {
+				CLEAR_ROW;
+				if (session->history_size == 1 && session->position_in_previous == 1) session->position_in_previous--;
+				memset(commandBuf, 0, MAX_COMMAND_BUF);
+				if (session->position_in_previous > 0) {
+					session->position_in_previous--;
+					const char* previous = session->history[session->position_in_previous];
+					memcpy(commandBuf, previous, strlen(previous));
+				} else {
+					memcpy(commandBuf, session->old_command, MAX_COMMAND_BUF);
+				}
+				fprintf(ws_out_stream, "\r%s%s", session->prefix, commandBuf);
+				session->current_position = 1;
 				break;
 			}
-		case WS_CURSOR_UP: {
-				fprintf(ws_out_stream, "\033[%zuA", n);
+		case WS_CURSOR_RIGHT: {
+				if (session->current_position == (strlen(commandBuf) + 1)) break;
+				session->current_position++;
+				ws_moveCursor(WS_CURSOR_RIGHT);
 				break;
 			}
-		case WS_CURSOR_DOWN: {
-				fprintf(ws_out_stream, "\033[%zuB", n);
+		case WS_CURSOR_LEFT: {
+				if (session->current_position == 1) break;
+				session->current_position--;
+				ws_moveCursor(WS_CURSOR_LEFT);
 				break;
 			}
 		default: break;
 	}
 }
 
-/**
- * @brief Moves the cursor once in the provided direction.
- * @param direction Direction to move, using ws_cursor_t.
+/*
+ * A possible completion of the word being typed: lead followed by name.
+ * Options are "--" followed by their name, so nothing has to be copied to complete them.
  */
-void ws_moveCursor(ws_cursor_t direction) { ws_moveCursor_n(direction, 1); }
-#endif // CUSTOM_CURSOR_CONTROL
-
 typedef struct {
-	input_type_t type;
-	uint64_t result;
-} input_result_t;
+	const char* lead;
+	const char* name;
+} ws_completion_t;
 
 /**
  * @internal
- * @brief Processes a virtual terminal sequence
- *
- * @return input_result_t The type of input that the sequence was.
+ * @brief Gets a character of a completion, as if lead and name were one string. Past the end, it's '\0'.
  */
-input_result_t ws_internal_processVirtualSequence() {
-	// The next character should be '[', and we can parse input until we know it should end with a certain character.
-	// For simplicity's sake we're just going to preallocate a buffer for the input
-	// If it doesn't end up being used it's not a big deal.
-	input_result_t result = { NONE, 0 };
-	int next = ws_get_char_blocking(ws_in_stream);
-	if (next != '[' && next != 'O') {
-		fprintf(ws_out_stream, "%c", next);
-		return result;
-	}
+char ws_internal_completionAt(const ws_completion_t* completion, size_t i) {
+	size_t lead_len = strlen(completion->lead);
+	if (i < lead_len) return completion->lead[i];
+	return completion->name[i - lead_len];
+}
 
-	char seq[10];
-	int i = 0;
+/**
+ * @internal
+ * @brief Checks if a completion starts with what's been typed so far.
+ */
+bool ws_internal_completionMatches(const ws_completion_t* completion, const char* word) {
+	for (size_t i = 0; word[i]; i++) {
+		if (ws_internal_completionAt(completion, i) != word[i]) return false;
+	}
+	return true;
+}
 
-	// Read until we encounter a non-numeric character
-	next = ws_get_char_blocking(ws_in_stream);
-	while (next >= '0' && next <= '9' || next == ';') {
-		seq[i++] = (char) next;
-		next = ws_get_char_blocking(ws_in_stream);
+/**
+ * @internal
+ * @brief Lists the subcommands of the command at a path that start with word, along with their aliases.
+ * @param path_len How many words the path has. 0 lists the top level commands.
+ * @return How many were put in list.
+ */
+int ws_internal_completeCommands(int path_len, char** path, const char* word, ws_completion_t* list, int list_limit) {
+	// Names point into the user's strings, not the registry, so the list stays valid after it changes.
+	const char* names[50];
+	if (list_limit > 50) list_limit = 50;
+	int list_size = ws_internal_listSubcommands(path_len, path, word, true, names, list_limit);
+	for (int i = 0; i < list_size; i++) {
+		list[i] = (ws_completion_t) { "", names[i] };
 	}
-	seq[i] = '\0';
+	return list_size;
+}
 
-	// Handle the end character of the escape sequence
-	switch (next) {
-		case 'A': result.type = CURSOR;
-			result.result = WS_CURSOR_UP;
-			break;
-		case 'B': result.type = CURSOR;
-			result.result = WS_CURSOR_DOWN;
-			break;
-		case 'C': result.type = CURSOR;
-			result.result = WS_CURSOR_RIGHT;
-			break;
-		case 'D': result.type = CURSOR;
-			result.result = WS_CURSOR_LEFT;
-			break;
-			//case '~': printf("Function key, sequence: %s\n", seq);
-			//	break;
-			//case 'P':
-			//case 'Q':
-			//case 'R':
-			//case 'S': printf("Special function key\n");
-			//	break;
-		default: break;
+/**
+ * @brief Adds a candidate from inside a command's completer. See ws_command_t::completer.
+ * @param completions The completions the completer was given.
+ * @param candidate A possible value of the argument. It's copied, so it doesn't have to outlive the call.
+ * Candidates that don't start with the prefix are ignored.
+ */
+void ws_addCompletion(ws_completions_t* completions, const char* candidate) {
+	if (!completions || !candidate) return;
+	const char* prefix = completions->data + completions->context_len;
+	if (strncmp(candidate, prefix, completions->prefix_len) != 0) return;
+	size_t len = strlen(candidate) + 1;
+	if (completions->size + len > WS_COMPLETION_BUF) {
+		completions->truncated = true;
+		return;
 	}
-	return result;
+	memcpy(completions->data + completions->size, candidate, len);
+	completions->size += len;
+	completions->count++;
 }
 
 /**
  * @internal
- * @brief Process E0 keys. This is mostly for arrow keys in custom OS's and Windows.
- *
- * @return input_result_t
+ * @brief Forgets everything command completers returned for a session.
  */
-input_result_t ws_internal_processEO() {
-	// Up: 0x48 -> Down: 0x50 -> Right: 0x4d -> Left: 0x4b
-	int next = ws_get_char_blocking(ws_in_stream);;
-	input_result_t result = { NONE, 0 };
-	switch (next) {
-		case WS_CURSOR_UP:
-		case WS_CURSOR_DOWN:
-		case WS_CURSOR_LEFT:
-		case WS_CURSOR_RIGHT: result.type = CURSOR;
-			result.result = next;
-			break;
-		default: break;
-	}
-	return result;
+void ws_internal_clearCompletions(ws_session_t* session) {
+	for (size_t i = 0; i < WS_COMPLETION_CACHE_SIZE; i++) session->completions[i].last_used = 0;
 }
 
-// ------------------------------------------------------------------------------------------------
-// ------------------------------------------------------------------------------------------------
-// Execute command & Main
-// ------------------------------------------------------------------------------------------------
-// ------------------------------------------------------------------------------------------------
 /**
- * @brief Execute a command with the provided buffer.
- * @param commandBuf Buffer containing the command to execute, including any flags, parameters, etc.
- * @return Can return WS_OUT_OF_MEMORY if malloc returns NULL when DISABLE_MALLOC is not defined.
+ * @internal
+ * @brief Lists what a command's completer returns for a word, calling it only if nothing cached covers the word.
+ * @param context The line before the word. Together with the completer, it identifies the command and argument.
+ * @param argc Passed on to the completer.
+ * @param argv Passed on to the completer.
+ * @return How many were put in list. They point into the cache, so they're valid until the next completion.
  */
-ws_error_t ws_executeCommand(char* commandBuf) {
-#ifdef DISABLE_MALLOC
-	// Split the commandBuf into arguments based on spaces or other delimiters
-	int argc = 0;
-	char* argv[MAX_ARGS];
-	char* current = strtok(commandBuf, " ");
-	while (current != NULL) {
-		if (argc >= MAX_ARGS) break;
-		// allocates memory for the string and copies it
-		argv[argc] = current;
-		current = strtok(NULL, " ");
-		argc++;
+int ws_internal_completeWithCompleter(ws_session_t* session, const ws_command_t* command, const char* context,
+									  int argc, char** argv, const char* word, ws_completion_t* list, int list_limit) {
+	size_t context_len = strlen(context) + 1;
+	size_t word_len = strlen(word);
+	ws_completions_t* entry = NULL;
+	for (size_t i = 0; i < WS_COMPLETION_CACHE_SIZE; i++) {
+		ws_completions_t* c = &session->completions[i];
+		if (!c->last_used || c->completer != command->completer) continue;
+		if (c->context_len != context_len || memcmp(c->data, context, context_len) != 0) continue;
+		if (c->prefix_len > word_len || strncmp(word, c->data + context_len, c->prefix_len) != 0) continue;
+		// Results for a shorter prefix cover this word too, as long as none were left out.
+		if (c->prefix_len != word_len && c->truncated) continue;
+		if (!entry || c->prefix_len > entry->prefix_len) entry = c;
 	}
-#else
-	// We treat this like system execution does with int argc & char** argv.
-	// argv[0] is always the command name, argc always is at least 1 because of this
-	int argc = 0;
-	char** argv = NULL;
-	char* current = strtok(commandBuf, " ");
 
-	while (current != NULL) {
-		char** newptr = (char**) realloc(argv, sizeof(char*) * (argc + 1));
-		if (!newptr) {
-			if (argv) {
-				// free each string allocated by strdup
-				for (int i = 0; i < argc; i++) free(argv[i]);
-				free(argv);
-			}
-			return WS_OUT_OF_MEMORY;
-		} else {
-			argv = newptr;
+	if (!entry) {
+		if (context_len + word_len + 1 > WS_COMPLETION_BUF) return 0;
+		entry = &session->completions[0];
+		for (size_t i = 1; i < WS_COMPLETION_CACHE_SIZE; i++) {
+			if (session->completions[i].last_used < entry->last_used) entry = &session->completions[i];
 		}
-		// allocates memory for the string and copies it
-		char* str = malloc(strlen(current) + 1);
-		strcpy(str, current);
-		argv[argc] = str;
-		current = strtok(NULL, " ");
-		argc++;
+		entry->completer = command->completer;
+		memcpy(entry->data, context, context_len);
+		memcpy(entry->data + context_len, word, word_len + 1);
+		entry->context_len = context_len;
+		entry->prefix_len = word_len;
+		entry->size = context_len + word_len + 1;
+		entry->count = 0;
+		entry->truncated = false;
+		entry->last_used = ++session->completion_clock;
+		command->completer(entry, argc, argv, word);
 	}
-	if (argc == 0) {
-		// Somehow got an empty command.
-		if (argv) free(argv);
-		return WS_NO_ERROR;
+	entry->last_used = ++session->completion_clock;
+
+	// Narrow them down to what's been typed since.
+	int list_size = 0;
+	const char* candidate = entry->data + entry->context_len + entry->prefix_len + 1;
+	for (int i = 0; i < entry->count && list_size < list_limit; i++) {
+		if (strncmp(candidate, word, word_len) == 0) list[list_size++] = (ws_completion_t) { "", candidate };
+		candidate += strlen(candidate) + 1;
+	}
+	return list_size;
+}
+
+/**
+ * @internal
+ * @brief Lists the arguments the last word of a line could be: the subcommands of the command it belongs to, the
+ * long options of the command's schema, and whatever the command's completer returns.
+ * @param line The whole line, starting with the command.
+ * @param word The last word of the line.
+ * @return How many were put in list.
+ */
+int ws_internal_completeArguments(ws_session_t* session, const char* line, const char* word, ws_completion_t* list, int list_limit) {
+	// Split up everything before the word, to find out which command it belongs to.
+	char buf[MAX_COMMAND_BUF];
+	size_t len = (size_t) (word - line);
+	memcpy(buf, line, len);
+	buf[len] = '\0';
+	char* words[MAX_COMMAND_BUF / 2 + 1];
+	int count = 0;
+	char* rest = buf;
+	while ((words[count] = ws_internal_nextToken(&rest)) != NULL) count++;
+
+	ws_command_t command;
+	ws_arg_index_t index;
+	int depth;
+	if (!ws_internal_resolveCommand(count, words, &command, &depth, NULL, &index)) return 0;
+	int list_size = 0;
+	// Subcommands can only come right after their parent, not after its arguments.
+	if (depth + 1 == count) list_size = ws_internal_completeCommands(count, words, word, list, list_limit);
+
+	// The schema belongs to the user, so it's still valid after the command has been copied out of the registry.
+	const ws_arg_schema_t* schema = command.schema;
+	if (word[0] == '-' && schema) {
+		// Already sorted by name.
+		for (size_t i = 0; i < index.long_count && list_size < list_limit; i++) {
+			ws_completion_t completion = { "--", schema->options[index.long_order[i]].name };
+			if (ws_internal_completionMatches(&completion, word)) list[list_size++] = completion;
+		}
 	}
-#endif // DISABLE_MALLOC
-	// Call Command (if it exists)
-	for (size_t i = 0; i < current_command_spot; i++) {
-		if (commands[i].commandName && strcmp(commands[i].commandName, argv[0]) == 0) {
-			int result = commands[i].mainCommand(argc, argv);
-			if (result != 0) {
-				// If the command function returns a non-zero value, it may indicate an error
-				ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
-				fprintf(ws_out_stream, "Command exited with code: %d\n", result);
-			}
-			goto cleanup;
+
+	if (command.completer) {
+		// The words were split up in place, so join them back together, with any extra spaces gone.
+		char context[MAX_COMMAND_BUF];
+		context[0] = '\0';
+		for (int i = 0; i < count; i++) {
+			if (i > 0) strcat(context, " ");
+			strcat(context, words[i]);
 		}
+		// The completer gets the arguments from the command's name on, like its mainCommand.
+		list_size += ws_internal_completeWithCompleter(session, &command, context, count - depth, words + depth, word,
+														list + list_size, list_limit - list_size);
+	}
+	return list_size;
+}
 
-		// Check that commands alias
-		for (size_t alias_idx = 0; alias_idx < commands[i].aliases_count; alias_idx++) {
-			if (commands[i].aliases[alias_idx] && strcmp(commands[i].aliases[alias_idx], argv[0]) == 0) {
-				int result = commands[i].mainCommand(argc, argv);
-				if (result != 0) {
-					// If the command function returns a non-zero value, it may indicate an error
-					ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
-					fprintf(ws_out_stream, "Command exited with code: %d\n", result);
-				}
-				goto cleanup;
+/**
+ * @internal
+ * @brief Handles tab, completing the last word if there's only one match, or listing them if it's pressed twice.
+ *
+ * The first word is completed from the registered commands, and the ones after it from the command's subcommands,
+ * schema and completer.
+ */
+void ws_internal_tabInput(ws_session_t* session) {
+	char* commandBuf = session->command_buf;
+	ws_completion_t list[50]; // List of current possible completions
+	const int list_limit = (int) (sizeof(list) / sizeof(list[0]));
+	char* word = strrchr(commandBuf, ' ');
+	word = word ? word + 1 : commandBuf;
+	bool first_word = word == commandBuf;
+	int list_size = first_word ? ws_internal_completeCommands(0, NULL, word, list, list_limit)
+							   : ws_internal_completeArguments(session, commandBuf, word, list, list_limit);
+
+	if (list_size == 1) {
+		// Print the rest of the word
+		for (size_t i = strlen(word); ws_internal_completionAt(&list[0], i) != '\0'; i++) {
+			char c = ws_internal_completionAt(&list[0], i);
+			fprintf(ws_out_stream, "%c", c);
+			ws_internal_strcat_c(commandBuf, c, MAX_COMMAND_BUF);
+		}
+		session->current_position = strlen(commandBuf) + 1;
+		session->tab_pressed = false;
+	} else if (session->tab_pressed) {
+		if (list_size == 0 && first_word) {
+			ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
+			fprintf(ws_out_stream, "\nNo command starting with: %s\n", commandBuf);
+			// Clear the buffer
+			memset(commandBuf, 0, MAX_COMMAND_BUF * sizeof(char));
+			session->new_command = true;
+		} else if (list_size > 1) {
+			// Print out all completions
+			ws_setConsoleColors((ws_color_t) { WS_FG_YELLOW, WS_BG_DEFAULT });
+			fprintf(ws_out_stream, "\n");
+			for (int i = 0; i < list_size; i++) {
+				fprintf(ws_out_stream, "%s%s\n", list[i].lead, list[i].name);
 			}
+			ws_setConsoleColors(ws_getDefaultColors());
+			// Reprint the command line
+			fprintf(ws_out_stream, "\r%s%s", session->prefix, commandBuf);
 		}
+		session->tab_pressed = false;
+	} else {
+		session->tab_pressed = true;
 	}
-	ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
-	fprintf(ws_out_stream, "Command not found: \"%s\"\n", argv[0]);
-cleanup:
-#ifndef DISABLE_MALLOC
-	for (int i = 0; i < argc; i++) free(argv[i]);
-	free(argv);
-#endif // DISABLE_MALLOC
 	ws_setConsoleColors(ws_getDefaultColors());
-	return WS_NO_ERROR;
 }
 
-// Default prefix
-const char* prefix = "> ";
 /**
- * @brief Set the prefix to the provided one.
+ * @internal
+ * @brief Feeds one character of input to a session's line editor. The session has to be the current one.
  *
- * The prefix is what is displayed at the start of a command line.
- * It is possible to use this function to imitate a bash like `user@name:path$`, or any other combination.
+ * Escape sequences are tracked across calls, so input can arrive in pieces of any size.
  *
- * @param newPrefix
+ * @param session Session the input is for.
+ * @param current The character, as returned by getc().
  */
-void ws_setConsolePrefix(const char* newPrefix) { prefix = newPrefix; }
+void ws_internal_sessionInput(ws_session_t* session, int current) {
+	char* commandBuf = session->command_buf;
+	ws_internal_startLine(session);
+
+	switch (session->escape) {
+		case WS_ESCAPE_START:
+			// The next character should be '[', and we can parse input until we know it should end with a certain character.
+			if (current == '[' || current == 'O') {
+				session->escape = WS_ESCAPE_SEQUENCE;
+			} else {
+				session->escape = WS_ESCAPE_NONE;
+				fprintf(ws_out_stream, "%c", current);
+			}
+			return;
+		case WS_ESCAPE_SEQUENCE:
+			// None of the keys we handle care about the parameters, so they're skipped.
+			if ((current >= '0' && current <= '9') || current == ';') return;
+			session->escape = WS_ESCAPE_NONE;
+			// Handle the end character of the escape sequence
+			switch (current) {
+				case 'A': ws_internal_cursorInput(session, WS_CURSOR_UP);
+					break;
+				case 'B': ws_internal_cursorInput(session, WS_CURSOR_DOWN);
+					break;
+				case 'C': ws_internal_cursorInput(session, WS_CURSOR_RIGHT);
+					break;
+				case 'D': ws_internal_cursorInput(session, WS_CURSOR_LEFT);
+					break;
+				default: break;
+			}
+			return;
+		case WS_ESCAPE_SCANCODE:
+			// Up: 0x48 -> Down: 0x50 -> Right: 0x4d -> Left: 0x4b
+			session->escape = WS_ESCAPE_NONE;
+			ws_internal_cursorInput(session, current);
+			return;
+		default: break;
+	}
 
-/**
- * @brief Cleans everything.
- *
- * Resets everything to it's default state, frees all allocations, etc.
- * Ideally you should call this before you exit, but the system garbage collector should clean it up.
- * Don't rely on the system gc for critical applications.
- */
-void ws_cleanAll() {
-	prefix = "> ";
-	backspace_as_ascii_delete = false;
-#ifdef THREADED_SUPPORT
-	if (exit_terminal) ws_destroyAtomicBool(exit_terminal);
-	exit_terminal = NULL;
-#else
-	exit_terminal = false;
-#endif // THREADED_SUPPORT
-	ws_internal_cleanStreams();
-	ws_internal_cleanCommands();
-	ws_internal_cleanColors();
-#ifndef NO_LOGGING
-	ws_internal_cleanLogger();
-#endif // NO_LOGGING
-	ws_resetConsoleState();
+	// Some clients end lines with "\r\n", which should only run the command once.
+	bool after_cr = session->last_was_cr;
+	session->last_was_cr = current == '\r';
+	if (current == '\n' && after_cr) return;
+
+	if (session->backspace_as_ascii_delete && current == 0x7f)
+		current = '\b';
+	if (current == '\n' || current == '\r') {
+		// If there's an empty command we just start a new line.
+		fprintf(ws_out_stream, "\n");
+		session->new_command = true;
+		if (strlen(commandBuf) == 0) return;
+
+		ws_internal_addHistory(session, commandBuf);
+		ws_internal_clearCompletions(session);
+		// Commands own the output stream while they run, logs are printed directly.
+		PROMPT_ACTIVE(false);
+		ws_executeCommand(commandBuf);
+		LOG_SUMMARY_TICK;
+		PROMPT_ACTIVE(true);
+	} else if (current == '\b') {
+		if (strlen(commandBuf) > 0) {
+			if (session->current_position <= 1) return;
+			// Remove the current position & shift to the left
+			size_t len = strlen(commandBuf);
+			for (size_t i = session->current_position - 2; i < len; i++) {
+				commandBuf[i] = commandBuf[i + 1];
+			}
+			// Ensure it's null terminated.
+			// In theory, it should already be, but I'd rather do this unnecessary step than have an overflow or messed up buffer.
+			commandBuf[len - 1] = '\0';
+
+			session->current_position--;
+			if (session->current_position != (strlen(commandBuf) + 1)) {
+				CLEAR_ROW;
+				fprintf(ws_out_stream, "%s%s", session->prefix, commandBuf);
+				ws_moveCursor(WS_CURSOR_LEFT);
+				for (size_t i = strlen(commandBuf); i > session->current_position; i--) {
+					ws_moveCursor(WS_CURSOR_LEFT);
+				}
+			} else {
+				// only clear the last char. much quicker than rewriting the line
+				ws_moveCursor(WS_CURSOR_LEFT);
+				fprintf(ws_out_stream, " ");
+				ws_moveCursor(WS_CURSOR_LEFT);
+			}
+		}
+	} else if (current == '\t') {
+		// see if we can autocomplete a command.
+		ws_internal_tabInput(session);
+	} else if (current == '\033') {
+		session->escape = WS_ESCAPE_START;
+	} else if (current == 0xE0) {
+		// Microsoft sometimes wants to work with virtual inputs but usually doesn't.
+		// At the very least this makes porting it to an os very easy.
+		// All the OS has to do is give this program raw input in the form of scancodes for special keys.
+		session->escape = WS_ESCAPE_SCANCODE;
+	} else {
+		ws_internal_insert_c(commandBuf, MAX_COMMAND_BUF, (char) current, session->current_position);
+		if (session->current_position != strlen(commandBuf)) {
+			CLEAR_ROW;
+			fprintf(ws_out_stream, "%s%s", session->prefix, commandBuf);
+			for (size_t i = strlen(commandBuf); i > session->current_position; i--) {
+				ws_moveCursor(WS_CURSOR_LEFT);
+			}
+		} else {
+			fprintf(ws_out_stream, "%c", current);
+		}
+		session->current_position++;
+	}
 }
 
 /**
- * @brief Main function for the terminal. Call after any configuration.
- * @return Can return WS_OUT_OF_MEMORY if DISABLE_MALLOC is not defined, and malloc returns NULL.
+ * @internal
+ * @brief Gets a session ready to take input, the same way for the terminal and anything else feeding it input.
  */
-ws_error_t ws_terminalMain() {
+void ws_internal_beginSession(ws_session_t* session) {
 	/* We're assuming that the user has printed everything they want prior to calling main. */
 	/* We're also assuming the colors have been defined, even if they are blank. */
 #ifndef NO_BASIC_COMMANDS
@@ -1790,267 +7575,495 @@ ws_error_t ws_terminalMain() {
 #endif
 
 	// Check for stream configurations
-	if (!ws_err_stream) ws_setStream(WS_ERROR, stderr);
+	if (!ws_err_stream) ws_setStream(WS_ERROR_S, stderr);
 	if (!ws_out_stream) ws_setStream(WS_OUTPUT, stdout);
 	if (!ws_in_stream) ws_setStream(WS_INPUT, stdin);
 
-#ifndef CUSTOM_WS_SETUP
-	ws_internal_setConsoleMode();
-#endif // CUSTOM_WS_SETUP
-
 	// Make sure the colors are set properly if they are defaults
 	ws_internal_updateColors();
 
-	/* Ideally something should've caught this before calling main, but we still need to check. */
-#ifndef DISABLE_MALLOC
-	if (!commands) commands = malloc(sizeof(ws_command_t));
-	if (!commands) return WS_OUT_OF_MEMORY;
-#endif
-	bool newCommand = true;
-	bool tabPressed = false; // allows for autocompletion
-
-	size_t position_in_previous = 0;
-	size_t current_position = 1;
-
-	char commandBuf[MAX_COMMAND_BUF];
-	char oldCommand[MAX_COMMAND_BUF];
-
-	input_result_t input_result = { 0, 0 };
-	CHECK_EXIT_BOOL_EXISTS;
-	while (!GET_EXIT_BOOL) {
-		if (newCommand) {
-			fprintf(ws_out_stream, "%s", prefix);
-			newCommand = false;
-			tabPressed = false;
-			position_in_previous = 0;
-			current_position = 1;
-			memset(oldCommand, 0, MAX_COMMAND_BUF);
-			memset(commandBuf, 0, MAX_COMMAND_BUF);
-#ifdef PRINTING_NEEDS_FLUSH
-			fflush(ws_out_stream);
-#endif
-		}
+	session->new_command = true;
+	session->escape = WS_ESCAPE_NONE;
+	session->last_was_cr = false;
+}
 
-		// Check for the previous input results
-		if (input_result.type != NONE) {
-			if (input_result.type == CURSOR) {
-				switch (input_result.result) {
-					case WS_CURSOR_UP: {
-							CLEAR_ROW;
-							if (position_in_previous == 0) {
-								memset(oldCommand, 0, MAX_COMMAND_BUF);
-								memcpy(oldCommand, commandBuf, MAX_COMMAND_BUF);
-							}
-							memset(commandBuf, 0, MAX_COMMAND_BUF);
-							memcpy(commandBuf, previousCommands[position_in_previous], strlen(previousCommands[position_in_previous]));
-							fprintf(ws_out_stream, "\r%s%s", prefix, commandBuf);
-							if (previous_commands_size > 0 && position_in_previous < previous_commands_size - 1) {
-								position_in_previous++;
-							}
-							input_result.type = NONE;
-							current_position = 1;
-							continue;
-						}
-					case WS_CURSOR_DOWN: {
-							CLEAR_ROW;
-							if (previous_commands_size == 1 && position_in_previous == 1) position_in_previous--;
-							if (position_in_previous > 0) {
-								position_in_previous--;
-								memset(commandBuf, 0, MAX_COMMAND_BUF);
-								memcpy(commandBuf, previousCommands[position_in_previous], strlen(previousCommands[position_in_previous]));
-							} else {
-								memset(commandBuf, 0, MAX_COMMAND_BUF);
-								memcpy(commandBuf, oldCommand, MAX_COMMAND_BUF);
-							}
-							fprintf(ws_out_stream, "\r%s%s", prefix, commandBuf);
-							current_position = 1;
-							input_result.type = NONE;
-							continue;
-						}
-					case WS_CURSOR_RIGHT: {
-							if (current_position == (strlen(commandBuf) + 1)) break;
-							current_position++;
-							ws_moveCursor(WS_CURSOR_RIGHT);
-							input_result.type = NONE;
-							continue;
-						}
-					case WS_CURSOR_LEFT: {
-							if (current_position == 1) break;
-							current_position--;
-							ws_moveCursor(WS_CURSOR_LEFT);
-							input_result.type = NONE;
-							continue;
-						}
-					default: break;
-				}
-			}
+/**
+ * @brief Main function for the terminal. Runs the current session, call after any configuration.
+ * @return Can return WS_OUT_OF_MEMORY if DISABLE_MALLOC is not defined, and malloc returns NULL.
+ */
+ws_error_t ws_terminalMain() { return ws_sessionTerminalMain(ws_internal_session()); }
+
+/**
+ * @brief Runs a session's terminal until it exits. Each session's terminal has to run on its own thread.
+ *
+ * The session is the calling thread's current one until this returns, so commands print to its streams.
+ *
+ * @param session Session to run.
+ * @return Can return WS_OUT_OF_MEMORY if DISABLE_MALLOC is not defined, and malloc returns NULL.
+ */
+ws_error_t ws_sessionTerminalMain(ws_session_t* session) {
+	ws_session_t* previous = ws_useSession(session);
+	ws_internal_beginSession(session);
+#ifndef CUSTOM_WS_SETUP
+	// Only the console needs setting up, other streams are expected to be raw already.
+	if (session->in_stream == stdin) ws_internal_setConsoleMode();
+#endif // CUSTOM_WS_SETUP
+
+#ifdef THREADED_SUPPORT
+	ws_event_t* stopped = ws_internal_getEvent(&session->stopped, true);
+	if (stopped) ws_resetEvent(stopped);
+	// If this can't be created, the terminal falls back to sleeping between polls.
+	ws_event_t* wake = ws_internal_getEvent(&session->wake, false);
+#endif // THREADED_SUPPORT
+	// Logs from other threads are printed above the prompt from here on.
+	PROMPT_ACTIVE(true);
+	while (!GET_EXIT_BOOL(session)) {
+		ws_internal_startLine(session);
 #ifdef PRINTING_NEEDS_FLUSH
-			fflush(ws_out_stream);
+		fflush(ws_out_stream);
 #endif
-		}
 
+#ifdef THREADED_SUPPORT
+		// Anything logged while the prompt is up is queued, so the summary is printed by the flush right after.
+		LOG_SUMMARY_TICK;
+#endif // THREADED_SUPPORT
+		FLUSH_LOG_QUEUE(session->prefix, session->command_buf, session->current_position);
 		int current = ws_get_char(ws_in_stream);
 
 		if (current == -2) {
-			ws_sleep(10);
+#ifdef THREADED_SUPPORT
+			ws_internal_terminalIdle(wake);
+#else
+			ws_sleep(WS_INPUT_POLL_MS);
+#endif // THREADED_SUPPORT
 			continue;
 		}
+		// Temporarily for development’s sake, this is how you exit the console.
+		// ctrl+d on unix, ctrl+z on windows
+		if (current == EOF) break;
+		ws_internal_sessionInput(session, current);
+	}
+#ifdef PRINTING_NEEDS_FLUSH
+	fflush(ws_out_stream);
+#endif
+	PROMPT_ACTIVE(false);
+#ifdef THREADED_SUPPORT
+	if (stopped) ws_setEvent(stopped);
+#endif // THREADED_SUPPORT
+	ws_useSession(previous);
+	return WS_NO_ERROR;
+}
 
-		// printf("current c: %c - %d\n", current, current);
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// Shell Server
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+#ifdef WS_SHELL_SERVER
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-		if (backspace_as_ascii_delete && current == 0x7f)
-			current = '\b';
-		if (current == '\n' || current == '\r') {
-			// If there's an empty command we just start a new line.
-			fprintf(ws_out_stream, "\n");
-			if (strlen(commandBuf) == 0) {
-				newCommand = true;
-				continue;
-			}
+// How many ready sockets are handled per epoll_wait().
+#ifndef WS_SERVER_MAX_EVENTS
+#define WS_SERVER_MAX_EVENTS 64
+#endif // WS_SERVER_MAX_EVENTS
 
-			// Move everything right in the previous buf
-			if (previous_commands_size > 0) {
-				if (strcmp(previousCommands[0], commandBuf) != 0) {
-					for (size_t i = previous_commands_size; i > 0; i--) {
-						memcpy(previousCommands[i], previousCommands[i - 1], strlen(previousCommands[i - 1]));
-						memset(previousCommands[i - 1], 0, MAX_COMMAND_BUF);
-					}
+// Clients with more output than this waiting to be sent are disconnected, rather than buffering forever.
+#ifndef WS_SERVER_OUTPUT_LIMIT
+#define WS_SERVER_OUTPUT_LIMIT (1024 * 1024)
+#endif // WS_SERVER_OUTPUT_LIMIT
 
-					if (previous_commands_size < PREVIOUS_BUF_SIZE) {
-						previous_commands_size++;
-					}
-				}
-				memcpy(previousCommands[0], commandBuf, strlen(commandBuf));
-			} else {
-				previous_commands_size++;
-				memcpy(previousCommands[0], commandBuf, strlen(commandBuf));
-			}
-			ws_executeCommand(commandBuf);
-			commandBuf[0] = '\0';
-			newCommand = true;
-		} else if (current == '\b') {
-			if (strlen(commandBuf) > 0) {
-				if (current_position <= 1) continue;
-				// Remove the current position & shift to the left
-				size_t len = strlen(commandBuf);
-				for (size_t i = current_position - 2; i < len; i++) {
-					commandBuf[i] = commandBuf[i + 1];
-				}
-				// Ensure it's null terminated.
-				// In theory, it should already be, but I'd rather do this unnecessary step than have an overflow or messed up buffer.
-				commandBuf[len - 1] = '\0';
-
-				current_position--;
-				if (current_position != (strlen(commandBuf) + 1)) {
-					CLEAR_ROW;
-					fprintf(ws_out_stream, "%s%s", prefix, commandBuf);
-					ws_moveCursor(WS_CURSOR_LEFT);
-					for (size_t i = strlen(commandBuf); i > current_position; i--) {
-						ws_moveCursor(WS_CURSOR_LEFT);
-					}
-				} else {
-					// only clear the last char. much quicker than rewriting the line
-					ws_moveCursor(WS_CURSOR_LEFT);
-					fprintf(ws_out_stream, " ");
-					ws_moveCursor(WS_CURSOR_LEFT);
-				}
-			}
-		} else if (current == '\t') {
-			// see if we can autocomplete a command.
-			const char* list[50]; // List of current possible commands
-			int list_size = 0;
-			for (int i = 0; i < command_size; i++) {
-				ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_GREEN, WS_BG_DEFAULT });
-				if (commands[i].commandName && ws_internal_startsWith(commands[i].commandName, commandBuf)) {
-					list[list_size] = commands[i].commandName;
-					list_size++;
-				}
+/*
+ * Everything a client prints goes into a memory stream, and is sent from there whenever the socket can take it.
+ * This way a slow client never blocks the loop, and output that fits in one send costs one syscall.
+ */
+typedef struct ws_server_client {
+	int fd;
+	ws_session_t* session;
+	FILE* out;
+	char* out_buf;
+	size_t out_size;
+	size_t out_sent;
+	bool want_write;
+	// Protocol clients only. Each command's output is captured, so its length is known before it's sent.
+	bool protocol;
+	FILE* capture;
+	char* capture_buf;
+	size_t capture_size;
+	size_t line_length;
+	bool line_too_long;
+	struct ws_server_client* prev;
+	struct ws_server_client* next;
+} ws_server_client_t;
+
+struct ws_server {
+	int listen_fd;
+	int epoll_fd;
+	// Written to by ws_stopServer(), so the loop can be stopped from any thread.
+	int wake_fd;
+	// Clients can't be prompted, so anything that reads from their session gets EOF.
+	FILE* null_in;
+	char path[sizeof(((struct sockaddr_un*) 0)->sun_path)];
+	// New clients start with these, copied from the session that created the server.
+	const char* prefix;
+	ws_color_t colors;
+	ws_server_mode_t mode;
+	ws_server_client_t* clients;
+};
 
-				// Check aliases for a match
-				for (size_t alias_idx = 0; alias_idx < commands[i].aliases_count; alias_idx++) {
-					if (commands[i].aliases[alias_idx] && ws_internal_startsWith(commands[i].aliases[alias_idx], commandBuf)) {
-						// If it's an alias of a command that's already in the list, we dont want it.
-						bool already_in_list = false;
-						for (int j = 0; j < list_size; j++) {
-							if (strcmp(list[j], commands[i].commandName) == 0) {
-								already_in_list = true;
-								break;
-							}
-						}
-						if (!already_in_list) {
-							list[list_size] = commands[i].aliases[alias_idx];
-							list_size++;
-						}
-					}
-				}
-				ws_setConsoleColors(ws_getDefaultColors());
-			}
+/**
+ * @internal
+ * @brief Makes a file descriptor non-blocking, and not inherited by child processes.
+ */
+bool ws_internal_setNonBlocking(int fd) {
+	int flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) return false;
+	return fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
 
-			if (list_size == 1) {
-				// Print the rest of the command
-				size_t len = strlen(commandBuf);
-				const char* currentCommand = list[0];
-				for (size_t i = len; i < strlen(currentCommand); i++) {
-					fprintf(ws_out_stream, "%c", currentCommand[i]);
-					ws_internal_strcat_c(commandBuf, currentCommand[i], MAX_COMMAND_BUF);
-				}
-				tabPressed = false;
-			} else if (tabPressed) {
-				if (list_size == 0) {
-					ws_setConsoleColors((ws_color_t) { WS_FG_BRIGHT_RED, WS_BG_DEFAULT });
-					fprintf(ws_out_stream, "\nNo command starting with: %s\n", commandBuf);
-					// Clear the buffer
-					memset(commandBuf, 0, MAX_COMMAND_BUF * sizeof(char));
-					commandBuf[0] = '\0';
-					newCommand = true;
-				} else if (list_size > 1) {
-					// Print out all commands
-					ws_setConsoleColors((ws_color_t) { WS_FG_YELLOW, WS_BG_DEFAULT });
-					fprintf(ws_out_stream, "\n");
-					for (int i = 0; i < list_size; i++) {
-						fprintf(ws_out_stream, "%s\n", list[i]);
-					}
-					ws_setConsoleColors(ws_getDefaultColors());
-					// Reprint the command line
-					fprintf(ws_out_stream, "\r%s%s", prefix, commandBuf);
-				}
-				tabPressed = false;
-			} else {
-				tabPressed = true;
+/**
+ * @brief Creates a shell server listening on a Unix domain socket. Run it with ws_runServer().
+ *
+ * A stale socket left at path by a previous run is replaced. Anything else at path makes this fail.
+ * Clients start with the prefix and default colors of the calling thread's current session.
+ *
+ * @param path Filesystem path of the socket.
+ * @return The server, or NULL if the socket couldn't be set up. errno is left set by the call that failed.
+ */
+ws_server_t* ws_createServer(const char* path) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	strcpy(addr.sun_path, path);
+
+	ws_server_t* server = calloc(1, sizeof(ws_server_t));
+	if (!server) return NULL;
+	strcpy(server->path, path);
+	server->prefix = ws_internal_session()->prefix;
+	server->colors = ws_getDefaultColors();
+	server->listen_fd = -1;
+	server->epoll_fd = -1;
+	server->wake_fd = -1;
+
+	struct stat st;
+	if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+	server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (server->listen_fd < 0 || !ws_internal_setNonBlocking(server->listen_fd)) goto fail;
+	if (bind(server->listen_fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) goto fail;
+	if (listen(server->listen_fd, SOMAXCONN) < 0) goto fail;
+
+	server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	server->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	server->null_in = fopen("/dev/null", "r");
+	if (server->epoll_fd < 0 || server->wake_fd < 0 || !server->null_in) goto fail;
+
+	// The listening socket and wake fd are told apart from clients by pointing at the server itself.
+	struct epoll_event ev = { 0 };
+	ev.events = EPOLLIN;
+	ev.data.ptr = server;
+	if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &ev) < 0) goto fail;
+	ev.data.ptr = &server->wake_fd;
+	if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->wake_fd, &ev) < 0) goto fail;
+	return server;
+
+fail:
+	ws_destroyServer(server);
+	return NULL;
+}
+
+/**
+ * @brief Sets how clients that connect from now on talk to the server.
+ *
+ * In WS_SERVER_PROTOCOL mode there's no prompt, echo or colors. Every line a client sends is run as a command, and
+ * answered with a header line `<status> <exit code> <length>`, followed by exactly length bytes of output.
+ * status is `ok` if the command ran, `not_found` if there's no such command, `too_long` if the line didn't fit in
+ * MAX_COMMAND_BUF, or `error` if it couldn't be run. Empty lines get no answer.
+ * Requests are answered in order, so a client can send as many as it likes without waiting.
+ *
+ * @param server Server to change.
+ * @param mode Mode for new clients.
+ */
+void ws_setServerMode(ws_server_t* server, ws_server_mode_t mode) {
+	server->mode = mode;
+}
+
+/**
+ * @internal
+ * @brief Disconnects a client and frees everything it had.
+ */
+void ws_internal_closeClient(ws_server_t* server, ws_server_client_t* client) {
+	epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+	close(client->fd);
+	if (client->prev) client->prev->next = client->next;
+	else server->clients = client->next;
+	if (client->next) client->next->prev = client->prev;
+	ws_destroySession(client->session);
+	fclose(client->out);
+	free(client->out_buf);
+	if (client->capture) fclose(client->capture);
+	free(client->capture_buf);
+	free(client);
+}
+
+/**
+ * @internal
+ * @brief Sends as much of a client's output as the socket takes right now.
+ *
+ * If some is left over, the loop is told to wait for the socket to become writable.
+ *
+ * @return false if the client should be disconnected.
+ */
+bool ws_internal_flushClient(ws_server_t* server, ws_server_client_t* client) {
+	if (fflush(client->out) != 0) return false;
+	while (client->out_sent < client->out_size) {
+		ssize_t sent = send(client->fd, client->out_buf + client->out_sent, client->out_size - client->out_sent, MSG_NOSIGNAL);
+		if (sent > 0) {
+			client->out_sent += (size_t) sent;
+		} else if (sent < 0 && errno == EINTR) {
+			continue;
+		} else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		} else {
+			return false;
+		}
+	}
+
+	bool pending = client->out_sent < client->out_size;
+	if (!pending) {
+		// Everything went out, so the stream starts over at the front of its buffer.
+		client->out_sent = 0;
+		if (fseek(client->out, 0, SEEK_SET) != 0 || fflush(client->out) != 0) return false;
+	} else if (client->out_size - client->out_sent > WS_SERVER_OUTPUT_LIMIT) {
+		return false;
+	}
+
+	if (pending != client->want_write) {
+		struct epoll_event ev = { 0 };
+		ev.events = EPOLLIN | (pending ? EPOLLOUT : 0);
+		ev.data.ptr = client;
+		if (epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev) < 0) return false;
+		client->want_write = pending;
+	}
+	return true;
+}
+
+/**
+ * @internal
+ * @brief Accepts every pending connection, giving each one a session and a prompt.
+ */
+void ws_internal_acceptClients(ws_server_t* server) {
+	for (;;) {
+		int fd = accept(server->listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR) continue;
+			// EAGAIN means there's nothing left. Anything else only affects that one connection.
+			return;
+		}
+		ws_server_client_t* client = calloc(1, sizeof(ws_server_client_t));
+		if (!client || !ws_internal_setNonBlocking(fd)) {
+			free(client);
+			close(fd);
+			continue;
+		}
+		client->fd = fd;
+		client->protocol = server->mode == WS_SERVER_PROTOCOL;
+		client->out = open_memstream(&client->out_buf, &client->out_size);
+		if (client->protocol) client->capture = open_memstream(&client->capture_buf, &client->capture_size);
+		bool streams = client->out && (!client->protocol || client->capture);
+		client->session = streams ? ws_createSession(NULL, client->out, client->out) : NULL;
+		struct epoll_event ev = { 0 };
+		ev.events = EPOLLIN;
+		ev.data.ptr = client;
+		if (!client->session || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			if (client->session) ws_destroySession(client->session);
+			if (client->out) fclose(client->out);
+			if (client->capture) fclose(client->capture);
+			free(client->out_buf);
+			free(client->capture_buf);
+			free(client);
+			close(fd);
+			continue;
+		}
+		client->session->in_stream = server->null_in;
+		client->next = server->clients;
+		if (server->clients) server->clients->prev = client;
+		server->clients = client;
+
+		ws_session_t* previous = ws_useSession(client->session);
+		ws_setConsolePrefix(server->prefix);
+		ws_setDefaultColors(server->colors);
+		// The other end of an interactive client is a terminal, it just isn't ours. A program wants plain output.
+		ws_setColorMode(client->protocol ? WS_COLOR_NEVER : WS_COLOR_ALWAYS);
+		ws_internal_beginSession(client->session);
+		if (!client->protocol) ws_internal_startLine(client->session);
+		ws_useSession(previous);
+		if (!ws_internal_flushClient(server, client)) ws_internal_closeClient(server, client);
+	}
+}
+
+/**
+ * @internal
+ * @brief Runs the line a protocol client has sent, and queues the answer.
+ */
+void ws_internal_protocolRequest(ws_server_client_t* client) {
+	ws_session_t* session = client->session;
+	session->command_buf[client->line_length] = '\0';
+	client->line_length = 0;
+	if (client->line_too_long) {
+		client->line_too_long = false;
+		fprintf(client->out, "too_long 0 0\n");
+		return;
+	}
+
+	const char* name;
+	bool found;
+	int result;
+	session->out_stream = session->err_stream = client->capture;
+	ws_error_t error = ws_internal_runCommand(session->command_buf, &name, &found, &result);
+	session->out_stream = session->err_stream = client->out;
+	fflush(client->capture);
+	if (error == WS_NO_ERROR && !name) return;
+
+	const char* status = error != WS_NO_ERROR ? "error" : found ? "ok" : "not_found";
+	fprintf(client->out, "%s %d %zu\n", status, result, client->capture_size);
+	fwrite(client->capture_buf, 1, client->capture_size, client->out);
+	fseek(client->capture, 0, SEEK_SET);
+	fflush(client->capture);
+}
+
+/**
+ * @internal
+ * @brief Adds a byte to the line a protocol client is sending, running it once it's complete.
+ */
+void ws_internal_protocolInput(ws_server_client_t* client, char c) {
+	if (c == '\n') {
+		ws_internal_protocolRequest(client);
+	} else if (c == '\r') {
+		// Lines may end in \r\n.
+	} else if (client->line_length < MAX_COMMAND_BUF - 1) {
+		client->session->command_buf[client->line_length++] = c;
+	} else {
+		client->line_too_long = true;
+	}
+}
+
+/**
+ * @internal
+ * @brief Reads everything a client has sent and feeds it to its session.
+ */
+void ws_internal_readClient(ws_server_t* server, ws_server_client_t* client) {
+	char buf[512];
+	bool connected = true;
+	ws_session_t* previous = ws_useSession(client->session);
+	while (!GET_EXIT_BOOL(client->session)) {
+		ssize_t received = recv(client->fd, buf, sizeof(buf), 0);
+		if (received > 0) {
+			for (ssize_t i = 0; i < received && !GET_EXIT_BOOL(client->session); i++) {
+				if (client->protocol) ws_internal_protocolInput(client, buf[i]);
+				else ws_internal_sessionInput(client->session, (unsigned char) buf[i]);
 			}
-			ws_setConsoleColors(ws_getDefaultColors());
-		} else if (current == EOF) {
-			// Temporarily for development’s sake, this is how you exit the console.
-			// ctrl+d on unix, ctrl+z on windows
+		} else if (received < 0 && errno == EINTR) {
+			continue;
+		} else if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
 			break;
-		} else if (current == '\033') {
-			input_result = ws_internal_processVirtualSequence();
-		} else if (current == 0xE0) {
-			// Microsoft sometimes wants to work with virtual inputs but usually doesn't.
-			// At the very least this makes porting it to an os very easy.
-			// All the OS has to do is give this program raw input in the form of scancodes for special keys.
-			input_result = ws_internal_processEO();
 		} else {
+			// Closed by the client, or broken.
+			connected = false;
+			break;
+		}
+	}
+	bool exited = GET_EXIT_BOOL(client->session);
+	if (connected && !exited && !client->protocol) ws_internal_startLine(client->session);
+	ws_useSession(previous);
+
+	if (!connected) {
+		ws_internal_closeClient(server, client);
+	} else if (!ws_internal_flushClient(server, client) || exited) {
+		// Whatever the exit command printed is sent on a best effort basis.
+		ws_internal_closeClient(server, client);
+	}
+}
 
-			ws_internal_insert_c(commandBuf, MAX_COMMAND_BUF, (char) current, current_position);
-			if (current_position != strlen(commandBuf)) {
-				CLEAR_ROW;
-				fprintf(ws_out_stream, "%s%s", prefix, commandBuf);
-				for (size_t i = strlen(commandBuf); i > current_position; i--) {
-					ws_moveCursor(WS_CURSOR_LEFT);
-				}
+/**
+ * @brief Runs the server until ws_stopServer() is called. Every client is handled on the calling thread.
+ *
+ * Commands run on this thread as well, one at a time, so a slow command holds up every client.
+ * Each client is running its own session while its commands run, so their output goes back to that client.
+ *
+ * @param server Server to run.
+ * @return WS_SERVER_ERROR if epoll fails, WS_NO_ERROR once it's been stopped.
+ */
+ws_error_t ws_runServer(ws_server_t* server) {
+	struct epoll_event events[WS_SERVER_MAX_EVENTS];
+	bool running = true;
+	while (running) {
+		int count = epoll_wait(server->epoll_fd, events, WS_SERVER_MAX_EVENTS, -1);
+		if (count < 0) {
+			if (errno == EINTR) continue;
+			return WS_SERVER_ERROR;
+		}
+		for (int i = 0; i < count; i++) {
+			void* ptr = events[i].data.ptr;
+			if (ptr == server) {
+				ws_internal_acceptClients(server);
+			} else if (ptr == &server->wake_fd) {
+				uint64_t value;
+				ssize_t ignored = read(server->wake_fd, &value, sizeof(value));
+				(void) ignored;
+				running = false;
 			} else {
-				fprintf(ws_out_stream, "%c", current);
+				// Each client shows up at most once per wait, so closing one can't affect the rest of the batch.
+				ws_server_client_t* client = (ws_server_client_t*) ptr;
+				if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+					ws_internal_readClient(server, client);
+				} else if (events[i].events & EPOLLOUT) {
+					if (!ws_internal_flushClient(server, client)) ws_internal_closeClient(server, client);
+				}
 			}
-			current_position++;
 		}
-#ifdef PRINTING_NEEDS_FLUSH
-		fflush(ws_out_stream);
-#endif
 	}
 	return WS_NO_ERROR;
 }
 
+/**
+ * @brief Makes ws_runServer() return. Safe to call from any thread, a command, or a signal handler.
+ * @param server Server to stop.
+ */
+void ws_stopServer(ws_server_t* server) {
+	uint64_t one = 1;
+	ssize_t ignored = write(server->wake_fd, &one, sizeof(one));
+	(void) ignored;
+}
+
+/**
+ * @brief Disconnects every client, closes the socket and removes it from the filesystem.
+ * @param server Server to destroy. It must not be running.
+ */
+void ws_destroyServer(ws_server_t* server) {
+	if (!server) return;
+	while (server->clients) ws_internal_closeClient(server, server->clients);
+	if (server->listen_fd >= 0) {
+		close(server->listen_fd);
+		unlink(server->path);
+	}
+	if (server->epoll_fd >= 0) close(server->epoll_fd);
+	if (server->wake_fd >= 0) close(server->wake_fd);
+	if (server->null_in) fclose(server->null_in);
+	free(server);
+}
+#endif // WS_SHELL_SERVER
+
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 // General Utility functions
@@ -2070,6 +8083,9 @@ bool ws_compareCommands(const ws_command_t c1, const ws_command_t c2) {
 	if (strcmp(c1.commandName, c2.commandName) != 0) return false;
 	if (c1.helpCommand != c2.helpCommand) return false;
 	if (c1.mainCommand != c2.mainCommand) return false;
+	if (c1.schema != c2.schema) return false;
+	if (c1.completer != c2.completer) return false;
+	if (c1.cache_ttl_ms != c2.cache_ttl_ms) return false;
 	return true;
 }
 
@@ -2181,13 +8197,16 @@ bool ws_promptUser(const char* format, ...) {
 	va_end(arg);
 
 	fprintf(ws_out_stream, " [Y/n] ");
+	if (!ws_in_stream) return false;
 	int first_input = ws_get_char_blocking(ws_in_stream);
+	// Nothing to read the answer from.
+	if (first_input == EOF) return false;
 	fprintf(ws_out_stream, "%c", first_input);
 	int input;
 	do {
 		 input = ws_get_char_blocking(ws_in_stream);
 		fprintf(ws_out_stream, "%c", input);
-	} while (input != '\n' && input != '\r');
+	} while (input != '\n' && input != '\r' && input != EOF);
 	if (first_input == 'Y' || first_input == 'y') return true;
 	return false;
 }
@@ -2240,6 +8259,30 @@ bool ws_promptUser(const char* format, ...) {
  *
  * This should act like strlen, it's the count, not the indexes.
  * If this number is inaccurate, WallShell will either not read all you entries (if count is too small) or create a buffer overflow (and likely a segfault).
+ *
+ * @var ws_command_t::schema
+ * @brief Optional description of the command's arguments. See ws_arg_schema_t.
+ *
+ * When set, WallShell parses the arguments itself, and calls the schema's handler instead of `mainCommand`, which can be `NULL`.
+ * The schema is also used for `help <command>` when there's no help function, and for completing options with tab.
+ * @warning The schema is written to when the command is registered, so it can't be `const`, and has to outlive the command.
+ *
+ * @var ws_command_t::completer
+ * @brief Optional function that completes the command's arguments when tab is pressed.
+ *
+ * `argv` holds the arguments before the one being completed, starting with the command's name, and `argc` is how many
+ * there are, which is also the index of the one being completed. Every candidate starting with `prefix` should be
+ * added with ws_addCompletion(), which copies it.
+ *
+ * Each session caches the results until the line is run, so it's called at most once per prefix. Once it has been
+ * called for a prefix, completing a longer one narrows down the same results without calling it again.
+ *
+ * @var ws_command_t::cache_ttl_ms
+ * @brief How long, in milliseconds, the output of a line can be reused. 0, the default, runs the command every time.
+ *
+ * When set, running the exact same line again within that time prints a copy of what the first run printed to the
+ * output stream, and returns the same exit code, without calling the command. See ws_invalidateCachedOutput().
+ * Only for commands whose output depends on nothing but their arguments for that long. Ignored with `DISABLE_MALLOC`.
  */
 
 /**
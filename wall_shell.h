@@ -68,6 +68,16 @@ typedef CRITICAL_SECTION ws_mutex_t;
  * @note `DWORD` is replaced with your systems thread handle type.
  */
 typedef DWORD ws_thread_id_t;
+/**
+ * @brief Wrapper around your system's thread handle.
+ * @note `HANDLE` is replaced with your systems thread handle type.
+ */
+typedef HANDLE ws_thread_t;
+/**
+ * @brief Wrapper around your system's condition variable.
+ * @note `CONDITION_VARIABLE` is replaced with your systems condition variable type.
+ */
+typedef CONDITION_VARIABLE ws_cond_t;
 
 #else
 #include <pthread.h>
@@ -81,6 +91,16 @@ typedef pthread_mutex_t ws_mutex_t;
  * @note `uint64_t` is replaced with your systems thread handle type.
  */
 typedef uint64_t ws_thread_id_t;
+/**
+ * @brief Wrapper around your system's thread handle.
+ * @note `pthread_t` is replaced with your systems thread handle type.
+ */
+typedef pthread_t ws_thread_t;
+/**
+ * @brief Wrapper around your system's condition variable.
+ * @note `pthread_cond_t` is replaced with your systems condition variable type.
+ */
+typedef pthread_cond_t ws_cond_t;
 #endif // _WIN32
 #endif
 /* Mutex */
@@ -92,20 +112,98 @@ void ws_destroyMutex(ws_mutex_t* mut);
 /* Thread ID */
 ws_thread_id_t ws_getThreadID();
 
+/* Condition variables */
+#define WS_WAIT_FOREVER ((size_t) -1)
+ws_cond_t* ws_createCond();
+void ws_destroyCond(ws_cond_t* cond);
+bool ws_waitCond(ws_cond_t* cond, ws_mutex_t* mut, size_t timeout_ms);
+void ws_signalCond(ws_cond_t* cond);
+void ws_broadcastCond(ws_cond_t* cond);
+
+/* Events. Built on top of the mutex and condition variable wrappers. */
+typedef struct ws_event ws_event_t;
+ws_event_t* ws_createEvent(bool manual_reset);
+void ws_destroyEvent(ws_event_t* event);
+void ws_setEvent(ws_event_t* event);
+void ws_resetEvent(ws_event_t* event);
+bool ws_waitEvent(ws_event_t* event, size_t timeout_ms);
+
+/* Threads */
+typedef void (*ws_thread_func_t)(void* arg);
+bool ws_createThread(ws_thread_t* thread, ws_thread_func_t func, void* arg);
+void ws_joinThread(ws_thread_t thread);
+size_t ws_getCoreCount();
+
+/*
+ * Atomics. C11 <stdatomic.h> is used when it's available, then GCC/Clang builtins, then the Interlocked functions.
+ * If none of those exist (or WS_ATOMICS_MUTEX is defined), every operation takes a mutex instead.
+ */
+#if !defined(WS_ATOMICS_MUTEX)
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#define WS_ATOMICS_C11
+#elif defined(__GNUC__) || defined(__clang__)
+#define WS_ATOMICS_GNU
+#elif defined(_MSC_VER)
+#define WS_ATOMICS_MSVC
+#else
+#define WS_ATOMICS_MUTEX
+#endif
+#endif // WS_ATOMICS_MUTEX
+
+#ifdef WS_ATOMICS_C11
+#include <stdatomic.h>
+typedef struct {
+	atomic_long value;
+} ws_atomic_int_t;
+
+typedef struct {
+	_Atomic(void*) value;
+} ws_atomic_ptr_t;
+#else
+typedef struct {
+	volatile long value;
+} ws_atomic_int_t;
+
+typedef struct {
+	void* volatile value;
+} ws_atomic_ptr_t;
+#endif // WS_ATOMICS_C11
+
+/* Initializer for static atomics, e.g. `static ws_atomic_int_t counter = WS_ATOMIC_INIT(0);` */
+#define WS_ATOMIC_INIT(v) { (v) }
+
+void ws_initAtomicInt(ws_atomic_int_t* a, long v);
+long ws_getAtomicInt(ws_atomic_int_t* a);
+void ws_setAtomicInt(ws_atomic_int_t* a, long v);
+long ws_addAtomicInt(ws_atomic_int_t* a, long v);
+long ws_exchangeAtomicInt(ws_atomic_int_t* a, long v);
+bool ws_compareExchangeAtomicInt(ws_atomic_int_t* a, long* expected, long desired);
+
+void ws_initAtomicPtr(ws_atomic_ptr_t* a, void* p);
+void* ws_getAtomicPtr(ws_atomic_ptr_t* a);
+void ws_setAtomicPtr(ws_atomic_ptr_t* a, void* p);
+void* ws_exchangeAtomicPtr(ws_atomic_ptr_t* a, void* p);
+bool ws_compareExchangeAtomicPtr(ws_atomic_ptr_t* a, void** expected, void* desired);
+
 /* Atomic Bool */
+#ifdef WS_ATOMICS_MUTEX
 typedef struct {
 	bool b;
 	ws_mutex_t* mut;
 } ws_atomic_bool_t;
+#else
+typedef struct {
+	ws_atomic_int_t value;
+} ws_atomic_bool_t;
+#endif // WS_ATOMICS_MUTEX
 
 bool ws_getAtomicBool(ws_atomic_bool_t* ab);
 void ws_setAtomicBool(ws_atomic_bool_t* ab, bool b);
 ws_atomic_bool_t* ws_createAtomicBool(bool b);
 void ws_destroyAtomicBool(ws_atomic_bool_t* ab);
 
-void ws_sleep(size_t ms);
-
 void ws_stopTerminal();
+void ws_waitTerminalStopped();
 
 /* Thread names for logging */
 #ifndef NO_WS_LOGGING
@@ -130,15 +228,86 @@ typedef enum {
 	WS_OUT_OF_MEMORY,
 	WS_COMMAND_LIMIT_REACHED,
 	WS_OUT_STREAM_NOT_SET,
-	WS_WS_SETUP_ERROR
+	WS_WS_SETUP_ERROR,
+	WS_SERVER_ERROR,
+	WS_COMMAND_NOT_FOUND,
+	WS_STREAM_LIMIT_REACHED,
+	WS_INVALID_SCHEMA
 } ws_error_t;
 
+/* Argument schemas. A command with one has its arguments parsed and checked before it runs. */
+#ifndef WS_SCHEMA_MAX_OPTIONS
+#define WS_SCHEMA_MAX_OPTIONS 32
+#endif
+#ifndef WS_SCHEMA_MAX_POSITIONALS
+#define WS_SCHEMA_MAX_POSITIONALS 16
+#endif
+
+typedef enum {
+	WS_ARG_FLAG,   /* No value. Can be given more than once, e.g. -vvv. */
+	WS_ARG_STRING,
+	WS_ARG_INT,
+	WS_ARG_DOUBLE
+} ws_arg_type_t;
+
+typedef struct {
+	const char* name;       /* Used as --name. Can be NULL if there's a short name. */
+	char shortName;         /* Used as -c. 0 for none. */
+	ws_arg_type_t type;
+	const char* valueName;  /* Shown in help, as in --name <valueName>. Can be NULL. */
+	const char* description;
+} ws_arg_option_t;
+
+typedef struct {
+	const char* name;
+	ws_arg_type_t type;     /* Anything but WS_ARG_FLAG. */
+	const char* description;
+	bool required;          /* Required positionals have to come before optional ones. */
+} ws_arg_positional_t;
+
+typedef struct {
+	bool present;
+	int count;              /* How many times it was given. */
+	const char* string;     /* The value as it was typed. NULL for flags. */
+	long integer;           /* Set for WS_ARG_INT. */
+	double number;          /* Set for WS_ARG_DOUBLE. */
+} ws_arg_value_t;
+
+/* Lookup tables built from a schema when its command is registered. They're kept in the registry. */
+struct ws_arg_index;
+
+typedef struct {
+	const struct ws_arg_schema* schema;
+	const struct ws_arg_index* index; /* Internal, used by ws_getOption(). */
+	const char* command;    /* The name or alias the command was run with. */
+	ws_arg_value_t options[WS_SCHEMA_MAX_OPTIONS];         /* In the same order as the schema's options. */
+	ws_arg_value_t positionals[WS_SCHEMA_MAX_POSITIONALS]; /* In the same order as the schema's positionals. */
+	char** rest;            /* Positionals past the declared ones, if the schema is variadic. */
+	int rest_count;
+} ws_args_t;
+
+typedef struct ws_arg_schema {
+	const char* description;
+	const ws_arg_option_t* options;
+	size_t options_count;
+	const ws_arg_positional_t* positionals;
+	size_t positionals_count;
+	bool variadic;          /* Allow more positionals than are declared. They end up in ws_args_t::rest. */
+	int (*handler)(const ws_args_t* args);
+} ws_arg_schema_t;
+
+/* Candidates for the argument being completed. A command's completer adds them with ws_addCompletion(). */
+typedef struct ws_completions ws_completions_t;
+
 typedef struct {
 	int (*mainCommand)(int argc, char** argv);
 	int (*helpCommand)(int argc, char** argv);
 	const char* commandName;
 	const char** aliases;
 	size_t aliases_count;
+	const ws_arg_schema_t* schema;
+	void (*completer)(ws_completions_t* completions, int argc, char** argv, const char* prefix);
+	size_t cache_ttl_ms;
 } ws_command_t;
 
 typedef struct {
@@ -216,6 +385,15 @@ ws_error_t ws_setForegroundColor(ws_fg_color_t color);
 ws_error_t ws_setBackgroundColor(ws_bg_color_t color);
 ws_error_t ws_setConsoleColors(ws_color_t colors);
 
+/* When colors are written. Auto only writes them when the output stream is a terminal. */
+typedef enum {
+	WS_COLOR_AUTO,
+	WS_COLOR_ALWAYS,
+	WS_COLOR_NEVER
+} ws_color_mode_t;
+
+void ws_setColorMode(ws_color_mode_t mode);
+
 /* Stream configurations. */
 typedef enum {
 	WS_INPUT,  /* Input stream. Defaults to stdin. */
@@ -224,6 +402,10 @@ typedef enum {
 } ws_stream;
 
 void ws_setStream(ws_stream type, FILE* stream);
+FILE* ws_getStream(ws_stream type);
+/* Per-thread stream overrides. They take precedence over the current session's streams, on the calling thread only. */
+ws_error_t ws_pushThreadStream(ws_stream type, FILE* stream);
+FILE* ws_popThreadStream(ws_stream type);
 
 /* Cursors */
 typedef enum {
@@ -238,10 +420,68 @@ void ws_moveCursor_n(ws_cursor_t direction, size_t n);
 
 /* General operations */
 ws_error_t ws_registerCommand(const ws_command_t c);
+ws_error_t ws_registerSubcommand(const char* parent, const ws_command_t c);
 void ws_deregisterCommand(const ws_command_t c);
 ws_error_t ws_executeCommand(char* commandBuf);
+#ifndef DISABLE_MALLOC
+ws_error_t ws_executeCommandCapture(char* commandBuf, char** output, size_t* length, int* exitCode);
+void ws_invalidateCachedOutput(const char* command);
+#endif // DISABLE_MALLOC
 ws_error_t ws_terminalMain();
 
+/* Sessions. Each has its own streams, history, prompt and colors, and they all share the registered commands. */
+typedef struct ws_session ws_session_t;
+ws_session_t* ws_createSession(FILE* in, FILE* out, FILE* err);
+void ws_destroySession(ws_session_t* session);
+ws_session_t* ws_useSession(ws_session_t* session);
+ws_session_t* ws_getSession();
+ws_error_t ws_sessionExecuteCommand(ws_session_t* session, char* commandBuf);
+ws_error_t ws_sessionTerminalMain(ws_session_t* session);
+#ifdef THREADED_SUPPORT
+void ws_stopSession(ws_session_t* session);
+void ws_waitSessionStopped(ws_session_t* session);
+#endif // THREADED_SUPPORT
+
+#ifdef WS_SHELL_SERVER
+#ifndef __linux__
+#error "WS_SHELL_SERVER uses epoll, which is only available on Linux."
+#endif
+#ifdef DISABLE_MALLOC
+#error "WS_SHELL_SERVER can't exist without malloc."
+#endif
+/* Shell server. Every client connecting to a Unix domain socket gets its own session. */
+typedef struct ws_server ws_server_t;
+/* How clients talk to a server. */
+typedef enum {
+	WS_SERVER_INTERACTIVE, /* A terminal with a prompt, line editing and colors. The default. */
+	WS_SERVER_PROTOCOL     /* One command per line, each answered with its exit code and output. */
+} ws_server_mode_t;
+
+ws_server_t* ws_createServer(const char* path);
+void ws_setServerMode(ws_server_t* server, ws_server_mode_t mode);
+ws_error_t ws_runServer(ws_server_t* server);
+void ws_stopServer(ws_server_t* server);
+void ws_destroyServer(ws_server_t* server);
+#endif // WS_SHELL_SERVER
+
+#ifdef WS_PLUGIN_COMMANDS
+#ifdef DISABLE_MALLOC
+#error "WS_PLUGIN_COMMANDS can't exist without malloc."
+#endif
+/* Plugin commands. Only their names are registered up front, their library is loaded the first time they're used. */
+typedef struct {
+	const char* commandName;
+	const char** aliases;
+	size_t aliases_count;
+	const char* library;    /* Path of the shared library. NULL looks in the program itself. */
+	const char* mainSymbol; /* Name of the library's mainCommand. */
+	const char* helpSymbol; /* Name of the library's helpCommand. NULL if it doesn't have one. */
+} ws_plugin_command_t;
+
+ws_error_t ws_registerPluginCommand(const ws_plugin_command_t plugin);
+void ws_deregisterPluginCommand(const char* name);
+#endif // WS_PLUGIN_COMMANDS
+
 /* Console Setup */
 void ws_setAsciiDeleteAsBackspace(bool b);
 void ws_setConsoleLocale();
@@ -251,24 +491,202 @@ void ws_initializeDefaultStreams();
 /* Utility functions */
 void ws_printGeneralHelp(ws_help_entry_general_t* entry);
 void ws_printSpecificHelp(ws_help_entry_specific_t* entry);
+void ws_printSchemaHelp(const char* commandName, const ws_arg_schema_t* schema);
+const ws_arg_value_t* ws_getOption(const ws_args_t* args, const char* name);
+void ws_addCompletion(ws_completions_t* completions, const char* candidate);
 bool ws_promptUser(const char* format, ...);
 bool ws_compareCommands(const ws_command_t c1, const ws_command_t c2);
+void ws_sleep(size_t ms);
 void ws_cleanAll();
 
+#if defined(THREADED_SUPPORT) && !defined(NO_WS_THREAD_POOL)
+/* Thread pool */
+typedef struct ws_threadpool ws_threadpool_t;
+typedef void (*ws_task_func_t)(void* arg);
+/* Called with a chunk [begin, end) of a ws_parallelFor range. */
+typedef void (*ws_parallel_for_func_t)(size_t begin, size_t end, void* arg);
+
+ws_threadpool_t* ws_createThreadPool(size_t threads);
+void ws_destroyThreadPool(ws_threadpool_t* pool);
+ws_threadpool_t* ws_getDefaultThreadPool();
+ws_error_t ws_submitTask(ws_threadpool_t* pool, ws_task_func_t func, void* arg);
+void ws_waitThreadPool(ws_threadpool_t* pool);
+ws_error_t ws_parallelFor(ws_threadpool_t* pool, size_t count, size_t grain, ws_parallel_for_func_t func, void* arg);
+#endif // THREADED_SUPPORT && !NO_WS_THREAD_POOL
+
 /* Logger */
+/* Numeric log levels. These match ws_logtype_t, but can be used in preprocessor conditionals. */
+#define WS_LEVEL_LOG   0
+#define WS_LEVEL_DEBUG 1
+#define WS_LEVEL_INFO  2
+#define WS_LEVEL_WARN  3
+#define WS_LEVEL_ERROR 4
+#define WS_LEVEL_FATAL 5
+
+#ifndef WS_COMPILE_LOG_LEVEL
+#define WS_COMPILE_LOG_LEVEL WS_LEVEL_LOG
+#endif // WS_COMPILE_LOG_LEVEL
+
 #ifndef NO_WS_LOGGING
 typedef enum {
-	WS_LOG,
-	WS_DEBUG,
-	WS_INFO,
-	WS_WARN,
-	WS_ERROR,
-	WS_FATAL
+	WS_LOG = WS_LEVEL_LOG,
+	WS_DEBUG = WS_LEVEL_DEBUG,
+	WS_INFO = WS_LEVEL_INFO,
+	WS_WARN = WS_LEVEL_WARN,
+	WS_ERROR = WS_LEVEL_ERROR,
+	WS_FATAL = WS_LEVEL_FATAL
 } ws_logtype_t;
 
 void ws_logger(ws_logtype_t type, const char* format, ...);
 void ws_vlogger(ws_logtype_t type, const char* format, va_list args);
 void ws_setLoggerColors(ws_logtype_t type, ws_fg_color_t fg, ws_bg_color_t bg);
+void ws_setLogLevel(ws_logtype_t type);
+ws_logtype_t ws_getLogLevel();
+void ws_doPrintTimestamp(bool b);
+
+/* Log categories */
+typedef int ws_log_category_t;
+#define WS_NO_LOG_CATEGORY (-1)
+
+ws_log_category_t ws_registerLogCategory(const char* name, ws_logtype_t level);
+ws_log_category_t ws_findLogCategory(const char* name);
+void ws_setLogCategoryLevel(ws_log_category_t category, ws_logtype_t level);
+void ws_enableLogCategory(ws_log_category_t category, bool enabled);
+void ws_logc(ws_log_category_t category, ws_logtype_t type, const char* format, ...);
+void ws_vlogc(ws_log_category_t category, ws_logtype_t type, const char* format, va_list args);
+
+/* Hex dumps */
+void ws_logHex(ws_logtype_t type, const void* data, size_t size, const char* format, ...);
+
+/* Log sinks */
+typedef struct {
+	ws_logtype_t type;
+	const char* text;    /* Full record without colors: tag, thread and message. Not '\0' terminated. */
+	size_t text_len;
+	const char* message; /* Just the message. Points into text. */
+	size_t message_len;
+	const char* thread;  /* Name or ID of the logging thread. NULL without THREADED_SUPPORT. */
+	size_t thread_len;
+	unsigned long long timestamp; /* Nanoseconds since the Unix epoch. 0 unless timestamps are on. */
+	const char* category;         /* Name of the record's category, NULL if it doesn't have one. */
+	size_t category_len;
+} ws_log_record_t;
+
+typedef struct ws_log_sink ws_log_sink_t;
+typedef void (*ws_log_sink_write_t)(void* data, const ws_log_record_t* record);
+typedef void (*ws_log_sink_close_t)(void* data);
+
+ws_log_sink_t* ws_addLogSink(ws_log_sink_write_t write, ws_log_sink_close_t close, void* data, ws_logtype_t level);
+ws_log_sink_t* ws_addMemorySink(char* buffer, size_t size, ws_logtype_t level);
+void ws_dumpMemorySink(ws_log_sink_t* sink, FILE* stream);
+#ifndef NO_WS_FILE_SINKS
+ws_log_sink_t* ws_addFileSink(const char* path, size_t max_bytes, size_t max_files, ws_logtype_t level);
+ws_log_sink_t* ws_addJsonSink(const char* path, size_t max_bytes, size_t max_files, ws_logtype_t level);
+#endif // NO_WS_FILE_SINKS
+void ws_setLogSinkLevel(ws_log_sink_t* sink, ws_logtype_t level);
+void ws_removeLogSink(ws_log_sink_t* sink);
+void ws_flushLogSinks();
+
+#ifndef NO_WS_FLIGHT_RECORDER
+/* Flight recorder */
+size_t ws_dumpFlightRecorder(FILE* stream, size_t n, ws_logtype_t level);
+void ws_setFlightRecorderLevel(ws_logtype_t type);
+#endif // NO_WS_FLIGHT_RECORDER
+
+/*
+ * Per call site rate limiting and sampling. Each WS_LOG_RATELIMITED / WS_LOG_SAMPLED expands to a static
+ * ws_log_site_t, so the arguments describing the limit must be constant. Treat the struct as opaque.
+ */
+typedef struct ws_log_site {
+	const char* file;
+	int line;
+	unsigned long long interval; /* Nanoseconds per token, 0 for no rate limit. */
+	unsigned long long limit;    /* interval * burst. */
+	unsigned long long sample;   /* Log 1 in every sample records. */
+	volatile unsigned long long tat;
+	volatile unsigned long long count;
+	volatile unsigned long long suppressed; /* Dropped by the rate limit, reported the next time the site logs. */
+	volatile unsigned long long sampled;    /* Dropped by sampling, only reported by the periodic summary. */
+	volatile unsigned long long registered;
+	ws_logtype_t type;
+	struct ws_log_site* next;
+} ws_log_site_t;
+
+#define WS_LOG_SITE_INIT(per_second, burst, sample) \
+	{ __FILE__, __LINE__, (per_second) > 0 ? 1000000000ULL / (per_second) : 0, \
+	  ((per_second) > 0 ? 1000000000ULL / (per_second) : 0) * ((burst) > 0 ? (burst) : 1), (sample), 0, 0, 0, 0, 0, WS_LOG, NULL }
+
+void ws_siteLogger(ws_log_site_t* site, ws_logtype_t type, const char* format, ...);
+void ws_logSuppressedSummary();
+
+#ifdef WS_BINARY_LOGGING
+/* Binary logger */
+ws_error_t ws_openBinaryLog(FILE* stream);
+void ws_closeBinaryLog();
+void ws_binaryLogger(ws_logtype_t type, const char* format, ...);
+void ws_vbinaryLogger(ws_logtype_t type, const char* format, va_list args);
+ws_error_t ws_decodeBinaryLog(FILE* in, FILE* out);
+#endif // WS_BINARY_LOGGING
+#endif // NO_WS_LOGGING
+
+/*
+ * Level specific logging macros.
+ * Anything below WS_COMPILE_LOG_LEVEL expands to nothing, so the arguments are never evaluated.
+ */
+#if !defined(NO_WS_LOGGING) && WS_COMPILE_LOG_LEVEL <= WS_LEVEL_LOG
+#define WS_LOGL(...) ws_logger(WS_LOG, __VA_ARGS__)
+#else
+#define WS_LOGL(...) ((void) 0)
+#endif
+
+#if !defined(NO_WS_LOGGING) && WS_COMPILE_LOG_LEVEL <= WS_LEVEL_DEBUG
+#define WS_LOGD(...) ws_logger(WS_DEBUG, __VA_ARGS__)
+#else
+#define WS_LOGD(...) ((void) 0)
+#endif
+
+#if !defined(NO_WS_LOGGING) && WS_COMPILE_LOG_LEVEL <= WS_LEVEL_INFO
+#define WS_LOGI(...) ws_logger(WS_INFO, __VA_ARGS__)
+#else
+#define WS_LOGI(...) ((void) 0)
+#endif
+
+#if !defined(NO_WS_LOGGING) && WS_COMPILE_LOG_LEVEL <= WS_LEVEL_WARN
+#define WS_LOGW(...) ws_logger(WS_WARN, __VA_ARGS__)
+#else
+#define WS_LOGW(...) ((void) 0)
+#endif
+
+#if !defined(NO_WS_LOGGING) && WS_COMPILE_LOG_LEVEL <= WS_LEVEL_ERROR
+#define WS_LOGE(...) ws_logger(WS_ERROR, __VA_ARGS__)
+#else
+#define WS_LOGE(...) ((void) 0)
+#endif
+
+#if !defined(NO_WS_LOGGING) && WS_COMPILE_LOG_LEVEL <= WS_LEVEL_FATAL
+#define WS_LOGF(...) ws_logger(WS_FATAL, __VA_ARGS__)
+#else
+#define WS_LOGF(...) ((void) 0)
+#endif
+
+/*
+ * Rate limited logging. Allows `burst` records at once, refilling at `per_second` records per second.
+ * Anything over the limit is counted and reported as "suppressed N messages" instead of being printed.
+ */
+#ifndef NO_WS_LOGGING
+#define WS_LOG_RATELIMITED(type, per_second, burst, ...) do { \
+		static ws_log_site_t ws_log_site_ = WS_LOG_SITE_INIT(per_second, burst, 1); \
+		ws_siteLogger(&ws_log_site_, type, __VA_ARGS__); \
+	} while (0)
+
+/* Sampled logging. Only 1 in every `every` records is logged. */
+#define WS_LOG_SAMPLED(type, every, ...) do { \
+		static ws_log_site_t ws_log_site_ = WS_LOG_SITE_INIT(0, 0, every); \
+		ws_siteLogger(&ws_log_site_, type, __VA_ARGS__); \
+	} while (0)
+#else
+#define WS_LOG_RATELIMITED(type, per_second, burst, ...) ((void) 0)
+#define WS_LOG_SAMPLED(type, every, ...) ((void) 0)
 #endif // NO_WS_LOGGING
 
 #endif // COMMAND_HANDLER_H
\ No newline at end of file
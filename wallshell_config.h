@@ -14,4 +14,7 @@
 #ifndef WS_CONFIG_H
 #define WS_CONFIG_H
 
+/* Log macros (WS_LOGD, WS_LOGI, etc.) below this level compile to nothing. See docs/logging.md. */
+// #define WS_COMPILE_LOG_LEVEL WS_LEVEL_INFO
+
 #endif // WS_CONFIG_H
\ No newline at end of file